@@ -1,9 +1,79 @@
 #include "adc.h"
+#include "esp_timer.h"
+#include "metrics.h"
 
 adc_oneshot_unit_handle_t adc1_handle;
 
 QueueHandle_t ADC_QUEUE;
 
+// Latest reading, shared with the HTTP server and protected by adc_snapshot_lock
+static adc_snapshot_t adc_snapshot;
+static portMUX_TYPE adc_snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// History ring and the bucket being filled, also protected by adc_snapshot_lock
+static adc_history_bucket_t adc_history[ADC_HISTORY_LEN];
+static int adc_history_head;
+static int adc_history_count;
+static adc_history_bucket_t adc_history_current;
+static double adc_history_sum;
+static int adc_history_samples;
+
+/**
+ * Adds a sample to the current history bucket and moves the bucket into the ring once it is full.
+ * Called with adc_snapshot_lock held.
+ */
+static void adc_update_history(double temperature)
+{
+    if (adc_history_samples == 0)
+    {
+        adc_history_current.min = temperature;
+        adc_history_current.max = temperature;
+        adc_history_sum = 0;
+    }
+    adc_history_current.min = fminf(adc_history_current.min, temperature);
+    adc_history_current.max = fmaxf(adc_history_current.max, temperature);
+    adc_history_sum += temperature;
+
+    if (++adc_history_samples < ADC_HISTORY_BUCKET_SAMPLES)
+    {
+        return;
+    }
+
+    adc_history_current.mean = adc_history_sum / adc_history_samples;
+    adc_history[adc_history_head] = adc_history_current;
+    adc_history_head = (adc_history_head + 1) % ADC_HISTORY_LEN;
+    if (adc_history_count < ADC_HISTORY_LEN)
+    {
+        adc_history_count++;
+    }
+    adc_history_samples = 0;
+}
+
+/**
+ * Stores a new sample in the cached snapshot and updates the filtered statistics.
+ */
+static void adc_update_snapshot(double temperature)
+{
+    portENTER_CRITICAL(&adc_snapshot_lock);
+    if (adc_snapshot.samples == 0)
+    {
+        adc_snapshot.filtered = temperature;
+        adc_snapshot.min = temperature;
+        adc_snapshot.max = temperature;
+    }
+    else
+    {
+        adc_snapshot.filtered += (temperature - adc_snapshot.filtered) / (1 << ADC_FILTER_SHIFT);
+        adc_snapshot.min = fmin(adc_snapshot.min, temperature);
+        adc_snapshot.max = fmax(adc_snapshot.max, temperature);
+    }
+    adc_snapshot.temperature = temperature;
+    adc_snapshot.samples++;
+    adc_snapshot.timestamp = esp_timer_get_time();
+    adc_update_history(temperature);
+    portEXIT_CRITICAL(&adc_snapshot_lock);
+}
+
 void adc_config(void)
 {
     adc_oneshot_unit_init_cfg_t init_config1 = {
@@ -23,7 +93,13 @@ void adc_config(void)
     ADC_QUEUE = xQueueCreate(10, sizeof(double));
 
     // Create a task to read ADC
-    xTaskCreate(adc_read_task, "adc_read_task", 2048, NULL, 5, NULL);
+    TaskHandle_t adc_task_handle = NULL;
+    xTaskCreate(adc_read_task, "adc_read_task", 2048, NULL, 5, &adc_task_handle);
+
+    // Export the sampling counters
+    metrics_register("adc_samples_total", "Temperature samples taken", METRICS_TYPE_COUNTER, &adc_snapshot.samples);
+    metrics_register("adc_overruns_total", "Samples dropped because ADC_QUEUE was full", METRICS_TYPE_COUNTER, &adc_snapshot.overruns);
+    metrics_register_task(adc_task_handle);
 }
 
 void adc_read_task(void *pvParameters)
@@ -41,11 +117,39 @@ void adc_read_task(void *pvParameters)
 
         // double temperature_kelvin = 1 / (A_COEFFICIENT + B_COEFFICIENT * log(resistance) + C_COEFFICIENT * pow(log(resistance), 3));
         // double temperature_celsius = temperature_kelvin - 273.15;
-        xQueueSend(ADC_QUEUE, &temperature_celsius, portMAX_DELAY);
-        // if (xQueueReceive(ADC_QUEUE, &data, portMAX_DELAY))
-        // {
-        //     printf("Received: %d\n", data);
-        // }
+        adc_update_snapshot(temperature_celsius);
+
+        // Never block the sampling loop on a slow consumer, count the dropped sample instead
+        if (xQueueSend(ADC_QUEUE, &temperature_celsius, 0) != pdTRUE)
+        {
+            portENTER_CRITICAL(&adc_snapshot_lock);
+            adc_snapshot.overruns++;
+            portEXIT_CRITICAL(&adc_snapshot_lock);
+        }
         vTaskDelay(pdMS_TO_TICKS(DELAY));
     }
-}
\ No newline at end of file
+}
+
+void adc_get_snapshot(adc_snapshot_t *snapshot)
+{
+    portENTER_CRITICAL(&adc_snapshot_lock);
+    *snapshot = adc_snapshot;
+    portEXIT_CRITICAL(&adc_snapshot_lock);
+}
+
+int adc_get_history(adc_history_bucket_t *buckets, int max_buckets)
+{
+    int count;
+    int start;
+
+    portENTER_CRITICAL(&adc_snapshot_lock);
+    count = (adc_history_count < max_buckets) ? adc_history_count : max_buckets;
+    start = adc_history_head - count + ADC_HISTORY_LEN;
+    for (int i = 0; i < count; i++)
+    {
+        buckets[i] = adc_history[(start + i) % ADC_HISTORY_LEN];
+    }
+    portEXIT_CRITICAL(&adc_snapshot_lock);
+
+    return count;
+}
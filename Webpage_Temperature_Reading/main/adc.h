@@ -17,6 +17,54 @@
 #define B_COEFFICIENT 0.000234125
 #define C_COEFFICIENT 0.0000000876741
 #define CELCIUS_RATE 10
+
+// Weight of a new sample in the exponential moving average (1 / 2^ADC_FILTER_SHIFT)
+#define ADC_FILTER_SHIFT 3
+
+// Samples rolled up into one history bucket, 10 s at the DELAY sampling period
+#define ADC_HISTORY_BUCKET_SAMPLES 100
+
+// History buckets kept, 64 x 10 s covers the last ~10 minutes
+#define ADC_HISTORY_LEN 64
+
+/**
+ * Rollup of ADC_HISTORY_BUCKET_SAMPLES samples
+ */
+typedef struct adc_history_bucket
+{
+    float min;
+    float max;
+    float mean;
+} adc_history_bucket_t;
+
+/**
+ * Cached view of the latest reading and its filtered statistics
+ */
+typedef struct adc_snapshot
+{
+    double temperature; // Latest sample in Celsius
+    double filtered;    // Exponential moving average
+    double min;         // Lowest sample since boot
+    double max;         // Highest sample since boot
+    uint32_t samples;   // Number of samples taken
+    uint32_t overruns;  // Samples dropped because ADC_QUEUE was full
+    int64_t timestamp;  // esp_timer time of the latest sample in microseconds
+} adc_snapshot_t;
+
 void adc_config(void);
 
 void adc_read_task();
+
+/**
+ * Copies the latest cached reading without blocking on ADC_QUEUE.
+ * @param snapshot destination for the snapshot.
+ */
+void adc_get_snapshot(adc_snapshot_t *snapshot);
+
+/**
+ * Copies the most recent completed history buckets.
+ * @param buckets destination, oldest bucket first.
+ * @param max_buckets size of buckets.
+ * @return number of buckets copied, fewer than max_buckets shortly after boot.
+ */
+int adc_get_history(adc_history_bucket_t *buckets, int max_buckets);
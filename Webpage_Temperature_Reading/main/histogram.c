@@ -0,0 +1,121 @@
+/*
+ * histogram.c
+ *
+ *  Fixed bucket log-scale histograms with a single writer and lock-free readers.
+ *  Every field is a 32 bit word written with a plain store, the 64 bit sum is
+ *  read consistently through the sequence count.
+ */
+
+#include <string.h>
+
+#include "histogram.h"
+
+void histogram_init(histogram_t *histogram, uint8_t shift)
+{
+	memset(histogram, 0x00, sizeof(histogram_t));
+	histogram->shift = shift;
+}
+
+void histogram_record(histogram_t *histogram, uint32_t value)
+{
+	int bucket = 0;
+
+	// Bucket i holds (2^(shift + i - 1), 2^(shift + i)]
+	if (value > 1)
+	{
+		uint32_t scaled = (value - 1) >> histogram->shift;
+		if (scaled != 0)
+		{
+			bucket = 32 - __builtin_clz(scaled);
+		}
+	}
+	if (bucket >= HISTOGRAM_BUCKETS)
+	{
+		bucket = HISTOGRAM_BUCKETS - 1;
+	}
+
+	uint32_t seq = histogram->sum_seq;
+	uint32_t lo = histogram->sum_lo + value;
+
+	// Single writer: read-modify-write without a compare and swap loop
+	__atomic_store_n(&histogram->buckets[bucket], histogram->buckets[bucket] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&histogram->sum_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (lo < histogram->sum_lo)
+	{
+		__atomic_store_n(&histogram->sum_hi, histogram->sum_hi + 1, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&histogram->sum_lo, lo, __ATOMIC_RELAXED);
+	__atomic_store_n(&histogram->sum_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+uint64_t histogram_sum(const histogram_t *histogram)
+{
+	uint32_t seq, lo, hi;
+
+	do
+	{
+		seq = __atomic_load_n(&histogram->sum_seq, __ATOMIC_ACQUIRE);
+		lo = __atomic_load_n(&histogram->sum_lo, __ATOMIC_RELAXED);
+		hi = __atomic_load_n(&histogram->sum_hi, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) != 0 || seq != __atomic_load_n(&histogram->sum_seq, __ATOMIC_RELAXED));
+
+	return ((uint64_t)hi << 32) | lo;
+}
+
+uint32_t histogram_bucket_bound(const histogram_t *histogram, int bucket)
+{
+	if (bucket >= HISTOGRAM_BUCKETS - 1)
+	{
+		return UINT32_MAX;
+	}
+
+	return 1UL << (histogram->shift + bucket);
+}
+
+void histogram_write_metrics(metrics_writer_t *writer, const char *name, const char *labels, const histogram_t *histogram)
+{
+	const char *sep = (labels[0] != '\0') ? "," : "";
+	uint32_t cumulative = 0;
+
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		cumulative += __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+
+		if (i < HISTOGRAM_BUCKETS - 1)
+		{
+			metrics_writer_printf(writer, "%s_bucket{%s%sle=\"%lu\"} %lu\n", name, labels, sep,
+								  (unsigned long)histogram_bucket_bound(histogram, i), (unsigned long)cumulative);
+		}
+		else
+		{
+			metrics_writer_printf(writer, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, (unsigned long)cumulative);
+		}
+	}
+
+	metrics_writer_printf(writer, "%s_sum{%s} %llu\n", name, labels, (unsigned long long)histogram_sum(histogram));
+	metrics_writer_printf(writer, "%s_count{%s} %lu\n", name, labels,
+						  (unsigned long)__atomic_load_n(&histogram->count, __ATOMIC_RELAXED));
+}
+
+void histogram_write_json(metrics_writer_t *writer, const histogram_t *histogram)
+{
+	metrics_writer_printf(writer, "{\"le\":[");
+	for (int i = 0; i < HISTOGRAM_BUCKETS - 1; i++)
+	{
+		metrics_writer_printf(writer, "%s%lu", i ? "," : "", (unsigned long)histogram_bucket_bound(histogram, i));
+	}
+
+	metrics_writer_printf(writer, "],\"counts\":[");
+	for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		metrics_writer_printf(writer, "%s%lu", i ? "," : "", (unsigned long)__atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED));
+	}
+
+	metrics_writer_printf(writer, "],\"count\":%lu,\"sum\":%llu}",
+						  (unsigned long)__atomic_load_n(&histogram->count, __ATOMIC_RELAXED),
+						  (unsigned long long)histogram_sum(histogram));
+}
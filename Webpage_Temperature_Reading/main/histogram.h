@@ -0,0 +1,75 @@
+/*
+ * histogram.h
+ *
+ *  Fixed bucket log-scale histograms with a single writer and lock-free readers.
+ */
+
+#ifndef MAIN_HISTOGRAM_H_
+#define MAIN_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include "metrics.h"
+
+// Number of buckets, the last one collects everything above the largest bound
+#define HISTOGRAM_BUCKETS 16
+
+/**
+ * Histogram with power of two bucket bounds: bucket i counts values <= 2^(shift + i).
+ * The 64 bit sum is kept as two words under a sequence count, the ESP32 has no
+ * 64 bit atomics and the libatomic fallback takes a critical section.
+ */
+typedef struct histogram
+{
+	uint8_t shift;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+	uint32_t count;
+	uint32_t sum_seq; // Odd while the writer updates the sum
+	uint32_t sum_lo;
+	uint32_t sum_hi;
+} histogram_t;
+
+/**
+ * Clears a histogram and sets the bound of its first bucket to 2^shift.
+ * @param histogram histogram to initialize.
+ * @param shift log2 of the first bucket's upper bound.
+ */
+void histogram_init(histogram_t *histogram, uint8_t shift);
+
+/**
+ * Records a value with plain 32 bit stores, never locking. Only one task may
+ * record into a histogram, readers may run concurrently.
+ * @param histogram histogram to update.
+ * @param value value to record.
+ */
+void histogram_record(histogram_t *histogram, uint32_t value);
+
+/**
+ * Gets the sum of the recorded values, retrying while the writer updates it.
+ * @return sum.
+ */
+uint64_t histogram_sum(const histogram_t *histogram);
+
+/**
+ * Gets the upper bound of a bucket.
+ * @return bound, or UINT32_MAX for the overflow bucket.
+ */
+uint32_t histogram_bucket_bound(const histogram_t *histogram, int bucket);
+
+/**
+ * Writes the histogram as a Prometheus histogram (cumulative buckets, _sum and _count).
+ * @param writer metrics writer.
+ * @param name metric family name.
+ * @param labels label pairs without braces, e.g. uri="/", may be empty.
+ * @param histogram histogram to write.
+ */
+void histogram_write_metrics(metrics_writer_t *writer, const char *name, const char *labels, const histogram_t *histogram);
+
+/**
+ * Writes the histogram as a JSON object {"le":[...],"counts":[...],"count":n,"sum":s}.
+ * @param writer metrics writer.
+ * @param histogram histogram to write.
+ */
+void histogram_write_json(metrics_writer_t *writer, const histogram_t *histogram);
+
+#endif /* MAIN_HISTOGRAM_H_ */
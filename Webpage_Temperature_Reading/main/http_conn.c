@@ -0,0 +1,287 @@
+/*
+ * http_conn.c
+ *
+ *  Connection manager for the HTTP server. The server closes the least
+ *  recently used socket when a new client arrives and every slot is taken
+ *  (lru_purge_enable), and a timer closes sockets that stay idle, so a few
+ *  forgotten browser tabs can't lock new clients out.
+ *  Everything except the timer callback runs in the httpd task, the table
+ *  needs no locking.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "http_conn.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "http_conn";
+
+/**
+ * Tracked connection
+ */
+typedef struct http_conn
+{
+	int fd; // -1 if the slot is free
+	char peer[HTTP_CONN_PEER_STR_LEN];
+	int64_t opened;		 // esp_timer time in microseconds
+	int64_t last_active; // esp_timer time in microseconds
+	uint32_t requests;
+	uint32_t bytes_in; // Request body bytes
+	uint32_t bytes_out; // Response body bytes
+} http_conn_t;
+
+static http_conn_t http_conn_table[HTTP_CONN_MAX_CONNECTIONS];
+static httpd_handle_t http_conn_server = NULL;
+static esp_timer_handle_t http_conn_purge_timer = NULL;
+
+// Exported to the metrics
+static volatile uint32_t http_conn_open = 0;
+static volatile uint32_t http_conn_opened_total = 0;
+static volatile uint32_t http_conn_closed_total = 0;
+static volatile uint32_t http_conn_purged_total = 0;
+static bool http_conn_metrics_registered = false;
+
+/**
+ * Formats the socket's peer address, IPv4 clients of the dual stack socket show as plain IPv4.
+ */
+static void http_conn_get_peer(int fd, char *buf, size_t size)
+{
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	char ip[INET6_ADDRSTRLEN];
+
+	if (getpeername(fd, (struct sockaddr *)&addr, &len) != 0)
+	{
+		snprintf(buf, size, "unknown");
+		return;
+	}
+
+	if (addr.ss_family == AF_INET)
+	{
+		struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+
+		inet_ntop(AF_INET, &addr4->sin_addr, ip, sizeof(ip));
+		snprintf(buf, size, "%s:%u", ip, ntohs(addr4->sin_port));
+		return;
+	}
+
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+	static const uint8_t v4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+
+	if (memcmp(addr6->sin6_addr.s6_addr, v4_mapped_prefix, sizeof(v4_mapped_prefix)) == 0)
+	{
+		inet_ntop(AF_INET, &addr6->sin6_addr.s6_addr[12], ip, sizeof(ip));
+		snprintf(buf, size, "%s:%u", ip, ntohs(addr6->sin6_port));
+	}
+	else
+	{
+		inet_ntop(AF_INET6, &addr6->sin6_addr, ip, sizeof(ip));
+		snprintf(buf, size, "[%s]:%u", ip, ntohs(addr6->sin6_port));
+	}
+}
+
+static http_conn_t *http_conn_find(int fd)
+{
+	for (int i = 0; i < HTTP_CONN_MAX_CONNECTIONS; i++)
+	{
+		if (http_conn_table[i].fd == fd)
+		{
+			return &http_conn_table[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Adds a socket to the table.
+ * @return the new entry, NULL if the table is full.
+ */
+static http_conn_t *http_conn_add(int fd)
+{
+	http_conn_t *conn = http_conn_find(-1);
+
+	if (conn == NULL)
+	{
+		ESP_LOGW(TAG, "http_conn_add: table full, socket %d not tracked", fd);
+		return NULL;
+	}
+
+	memset(conn, 0x00, sizeof(http_conn_t));
+	conn->fd = fd;
+	conn->opened = esp_timer_get_time();
+	conn->last_active = conn->opened;
+	http_conn_get_peer(fd, conn->peer, sizeof(conn->peer));
+
+	http_conn_open++;
+	http_conn_opened_total++;
+	ESP_LOGD(TAG, "http_conn_add: socket %d from %s", fd, conn->peer);
+
+	return conn;
+}
+
+/**
+ * Socket open callback, runs in the httpd task.
+ */
+static esp_err_t http_conn_open_fn(httpd_handle_t hd, int sockfd)
+{
+	http_conn_add(sockfd);
+
+	return ESP_OK;
+}
+
+/**
+ * Socket close callback, runs in the httpd task. Replaces the server's own close() call.
+ */
+static void http_conn_close_fn(httpd_handle_t hd, int sockfd)
+{
+	http_conn_t *conn = http_conn_find(sockfd);
+
+	if (conn != NULL)
+	{
+		ESP_LOGD(TAG, "http_conn_close_fn: socket %d from %s, %lu requests", sockfd, conn->peer, (unsigned long)conn->requests);
+		conn->fd = -1;
+		http_conn_open--;
+	}
+	http_conn_closed_total++;
+
+	close(sockfd);
+}
+
+/**
+ * Closes idle sockets, queued to the httpd task by the purge timer.
+ */
+static void http_conn_purge_idle(void *arg)
+{
+	int64_t now = esp_timer_get_time();
+
+	for (int i = 0; i < HTTP_CONN_MAX_CONNECTIONS; i++)
+	{
+		http_conn_t *conn = &http_conn_table[i];
+
+		if (conn->fd >= 0 && now - conn->last_active > (int64_t)HTTP_CONN_IDLE_TIMEOUT_S * 1000000)
+		{
+			ESP_LOGI(TAG, "http_conn_purge_idle: closing idle socket %d from %s", conn->fd, conn->peer);
+			// Don't trigger the close again before it has been processed
+			conn->last_active = now;
+			httpd_sess_trigger_close(http_conn_server, conn->fd);
+			http_conn_purged_total++;
+		}
+	}
+}
+
+/**
+ * Purge timer callback, the table belongs to the httpd task so the work is queued there.
+ */
+static void http_conn_purge_timer_cb(void *arg)
+{
+	if (http_conn_server != NULL)
+	{
+		httpd_queue_work(http_conn_server, http_conn_purge_idle, NULL);
+	}
+}
+
+void http_conn_configure(httpd_config_t *config)
+{
+	for (int i = 0; i < HTTP_CONN_MAX_CONNECTIONS; i++)
+	{
+		http_conn_table[i].fd = -1;
+	}
+	http_conn_open = 0;
+
+	// Close the least recently used socket instead of refusing new clients
+	config->lru_purge_enable = true;
+	config->open_fn = http_conn_open_fn;
+	config->close_fn = http_conn_close_fn;
+}
+
+void http_conn_start(httpd_handle_t server)
+{
+	const esp_timer_create_args_t purge_timer_args = {
+		.callback = &http_conn_purge_timer_cb,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "http_conn_purge"};
+
+	http_conn_server = server;
+
+	if (!http_conn_metrics_registered)
+	{
+		metrics_register("http_connections_open", "Open HTTP connections", METRICS_TYPE_GAUGE, &http_conn_open);
+		metrics_register("http_connections_opened_total", "HTTP connections accepted", METRICS_TYPE_COUNTER, &http_conn_opened_total);
+		metrics_register("http_connections_closed_total", "HTTP connections closed", METRICS_TYPE_COUNTER, &http_conn_closed_total);
+		metrics_register("http_connections_purged_total", "HTTP connections closed for being idle", METRICS_TYPE_COUNTER, &http_conn_purged_total);
+		http_conn_metrics_registered = true;
+	}
+
+	if (http_conn_purge_timer == NULL)
+	{
+		ESP_ERROR_CHECK(esp_timer_create(&purge_timer_args, &http_conn_purge_timer));
+	}
+	ESP_ERROR_CHECK(esp_timer_start_periodic(http_conn_purge_timer, (uint64_t)HTTP_CONN_PURGE_INTERVAL_S * 1000000));
+}
+
+void http_conn_stop(void)
+{
+	if (http_conn_purge_timer != NULL)
+	{
+		esp_timer_stop(http_conn_purge_timer);
+	}
+	http_conn_server = NULL;
+
+	for (int i = 0; i < HTTP_CONN_MAX_CONNECTIONS; i++)
+	{
+		http_conn_table[i].fd = -1;
+	}
+	http_conn_open = 0;
+}
+
+void http_conn_account(httpd_req_t *req, uint32_t bytes_sent)
+{
+	int fd = httpd_req_to_sockfd(req);
+	http_conn_t *conn = http_conn_find(fd);
+
+	if (conn == NULL)
+	{
+		conn = http_conn_add(fd);
+		if (conn == NULL)
+		{
+			return;
+		}
+	}
+
+	conn->requests++;
+	conn->bytes_in += req->content_len;
+	conn->bytes_out += bytes_sent;
+	conn->last_active = esp_timer_get_time();
+}
+
+void http_conn_write_json(metrics_writer_t *writer)
+{
+	int64_t now = esp_timer_get_time();
+	bool first = true;
+
+	metrics_writer_printf(writer, "[");
+	for (int i = 0; i < HTTP_CONN_MAX_CONNECTIONS; i++)
+	{
+		const http_conn_t *conn = &http_conn_table[i];
+
+		if (conn->fd < 0)
+		{
+			continue;
+		}
+
+		metrics_writer_printf(writer,
+							  "%s{\"fd\":%d,\"peer\":\"%s\",\"age_s\":%lu,\"idle_s\":%lu,\"requests\":%lu,\"bytes_in\":%lu,\"bytes_out\":%lu}",
+							  first ? "" : ",", conn->fd, conn->peer,
+							  (unsigned long)((now - conn->opened) / 1000000), (unsigned long)((now - conn->last_active) / 1000000),
+							  (unsigned long)conn->requests, (unsigned long)conn->bytes_in, (unsigned long)conn->bytes_out);
+		first = false;
+	}
+	metrics_writer_printf(writer, "]");
+}
@@ -0,0 +1,57 @@
+/*
+ * http_conn.h
+ *
+ *  Connection manager for the HTTP server: per socket request and byte
+ *  counters, purging of idle sockets and the /connections admin view.
+ */
+
+#ifndef MAIN_HTTP_CONN_H_
+#define MAIN_HTTP_CONN_H_
+
+#include "esp_http_server.h"
+#include "metrics.h"
+
+// Connections tracked, at least the server's max_open_sockets
+#define HTTP_CONN_MAX_CONNECTIONS 8
+
+// Sockets without a request for this long are closed
+#define HTTP_CONN_IDLE_TIMEOUT_S 30
+
+// How often idle sockets are looked for
+#define HTTP_CONN_PURGE_INTERVAL_S 5
+
+// Size of the peer address string, "[IPv6]:port"
+#define HTTP_CONN_PEER_STR_LEN 56
+
+/**
+ * Enables LRU purging and installs the socket open/close callbacks.
+ * @param config server configuration, before the server is started.
+ */
+void http_conn_configure(httpd_config_t *config);
+
+/**
+ * Starts the idle purge timer for a running server.
+ * @param server HTTP server handle.
+ */
+void http_conn_start(httpd_handle_t server);
+
+/**
+ * Stops the idle purge timer and forgets all connections.
+ */
+void http_conn_stop(void);
+
+/**
+ * Accounts a handled request to its connection, registering the socket if it is not known yet
+ * (with HTTPS the TLS layer owns the open callback).
+ * @param req HTTP request.
+ * @param bytes_sent response body bytes sent.
+ */
+void http_conn_account(httpd_req_t *req, uint32_t bytes_sent);
+
+/**
+ * Writes the live connections as a JSON array.
+ * @param writer metrics writer used as a chunked response buffer.
+ */
+void http_conn_write_json(metrics_writer_t *writer);
+
+#endif /* MAIN_HTTP_CONN_H_ */
@@ -0,0 +1,142 @@
+/*
+ * http_request.c
+ *
+ *  Shared request body reader and JSON binding used by the POST handlers.
+ *  Bodies are read into caller provided buffers so POST handling needs no heap allocation.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "http_request.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "http_request";
+
+// Body bytes sent for the request being handled
+static uint32_t http_request_bytes_sent = 0;
+
+int http_request_read_body(httpd_req_t *req, char *buf, size_t size)
+{
+	size_t received = 0;
+	int retries = 0;
+
+	if (req->content_len == 0)
+	{
+		ESP_LOGI(TAG, "Content-Length header is missing or invalid");
+		httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Content-Length header is missing or invalid");
+		return -1;
+	}
+
+	if (req->content_len >= size)
+	{
+		ESP_LOGI(TAG, "Request body too large: %u bytes", (unsigned int)req->content_len);
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request body too large");
+		return -1;
+	}
+
+	// httpd_req_recv may return fewer bytes than requested, keep reading until the whole body arrived
+	while (received < req->content_len)
+	{
+		int ret = httpd_req_recv(req, buf + received, req->content_len - received);
+
+		if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++retries <= HTTP_REQUEST_MAX_RECV_RETRIES)
+		{
+			continue;
+		}
+
+		if (ret <= 0)
+		{
+			ESP_LOGI(TAG, "Failed to receive request body");
+			if (ret == HTTPD_SOCK_ERR_TIMEOUT)
+			{
+				httpd_resp_send_408(req);
+			}
+			return -1;
+		}
+
+		received += ret;
+		retries = 0;
+	}
+
+	buf[received] = '\0';
+
+	return received;
+}
+
+int http_request_parse_json(httpd_req_t *req, char *buf, size_t size, json_token_t *tokens, unsigned int max_tokens)
+{
+	json_parser_t parser;
+	int len;
+	int num_tokens;
+
+	len = http_request_read_body(req, buf, size);
+	if (len < 0)
+	{
+		return -1;
+	}
+
+	json_parser_init(&parser);
+	num_tokens = json_parser_parse(&parser, buf, len, tokens, max_tokens);
+	if (num_tokens < 1 || tokens[0].type != JSON_TYPE_OBJECT)
+	{
+		ESP_LOGI(TAG, "Invalid JSON data (%d)", num_tokens);
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid JSON data");
+		return -1;
+	}
+
+	return num_tokens;
+}
+
+esp_err_t http_request_bind_json(httpd_req_t *req, char *buf, size_t size, const json_field_t *fields, size_t num_fields)
+{
+	json_token_t tokens[HTTP_REQUEST_MAX_JSON_TOKENS];
+	int num_tokens;
+
+	num_tokens = http_request_parse_json(req, buf, size, tokens, HTTP_REQUEST_MAX_JSON_TOKENS);
+	if (num_tokens < 0)
+	{
+		return ESP_FAIL;
+	}
+
+	if (json_parser_bind(buf, tokens, num_tokens, 0, fields, num_fields) != (int)num_fields)
+	{
+		ESP_LOGI(TAG, "Missing or invalid JSON data fields");
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing or invalid JSON data fields");
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t http_request_send(httpd_req_t *req, const char *buf, ssize_t len)
+{
+	if (len == HTTPD_RESP_USE_STRLEN)
+	{
+		len = (buf != NULL) ? strlen(buf) : 0;
+	}
+	http_request_bytes_sent += len;
+
+	return httpd_resp_send(req, buf, len);
+}
+
+esp_err_t http_request_send_chunk(httpd_req_t *req, const char *buf, ssize_t len)
+{
+	if (len == HTTPD_RESP_USE_STRLEN)
+	{
+		len = (buf != NULL) ? strlen(buf) : 0;
+	}
+	http_request_bytes_sent += len;
+
+	return httpd_resp_send_chunk(req, buf, len);
+}
+
+uint32_t http_request_take_bytes_sent(void)
+{
+	uint32_t bytes = http_request_bytes_sent;
+
+	http_request_bytes_sent = 0;
+
+	return bytes;
+}
@@ -0,0 +1,80 @@
+/*
+ * http_request.h
+ *
+ *  Shared request body reader and JSON binding used by the POST handlers.
+ */
+
+#ifndef MAIN_HTTP_REQUEST_H_
+#define MAIN_HTTP_REQUEST_H_
+
+#include "esp_http_server.h"
+#include "json_parser.h"
+
+// Largest request body accepted by the JSON POST handlers
+#define HTTP_REQUEST_MAX_BODY_LEN 512
+
+// Maximum number of JSON tokens per request body
+#define HTTP_REQUEST_MAX_JSON_TOKENS 48
+
+// Number of consecutive socket timeouts tolerated while reading a body
+#define HTTP_REQUEST_MAX_RECV_RETRIES 3
+
+/**
+ * Reads the whole request body into buf, looping over short reads and retrying on socket timeouts.
+ * On failure an error response has already been sent to the client.
+ * @param req HTTP request.
+ * @param buf destination buffer, NUL terminated on success.
+ * @param size size of buf.
+ * @return number of bytes read, or -1 on error.
+ */
+int http_request_read_body(httpd_req_t *req, char *buf, size_t size);
+
+/**
+ * Reads a JSON request body into buf and tokenizes it, for bodies that need more than http_request_bind_json.
+ * On failure an error response has already been sent to the client.
+ * @param req HTTP request.
+ * @param buf scratch buffer for the body.
+ * @param size size of buf.
+ * @param tokens token array.
+ * @param max_tokens number of entries in tokens.
+ * @return number of tokens, token 0 being the root object, or -1 on error.
+ */
+int http_request_parse_json(httpd_req_t *req, char *buf, size_t size, json_token_t *tokens, unsigned int max_tokens);
+
+/**
+ * Reads a JSON request body into buf and binds the keys of the root object into fields.
+ * On failure an error response has already been sent to the client.
+ * @param req HTTP request.
+ * @param buf scratch buffer for the body (usually on the caller's stack).
+ * @param size size of buf.
+ * @param fields field descriptions.
+ * @param num_fields number of entries in fields.
+ * @return ESP_OK on success, ESP_FAIL otherwise.
+ */
+esp_err_t http_request_bind_json(httpd_req_t *req, char *buf, size_t size, const json_field_t *fields, size_t num_fields);
+
+/**
+ * Sends a complete response and accounts its size in the per request byte counter.
+ * @param req HTTP request.
+ * @param buf response body.
+ * @param len length of buf, or HTTPD_RESP_USE_STRLEN.
+ * @return result of httpd_resp_send.
+ */
+esp_err_t http_request_send(httpd_req_t *req, const char *buf, ssize_t len);
+
+/**
+ * Sends one chunk of a chunked response and accounts its size in the per request byte counter.
+ * @param req HTTP request.
+ * @param buf chunk data, NULL with len 0 terminates the response.
+ * @param len length of buf, or HTTPD_RESP_USE_STRLEN.
+ * @return result of httpd_resp_send_chunk.
+ */
+esp_err_t http_request_send_chunk(httpd_req_t *req, const char *buf, ssize_t len);
+
+/**
+ * Returns the number of body bytes sent since the last call and resets the counter.
+ * All handlers run in the single httpd task, so the counter belongs to the current request.
+ */
+uint32_t http_request_take_bytes_sent(void);
+
+#endif /* MAIN_HTTP_REQUEST_H_ */
@@ -8,10 +8,15 @@
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_system.h"
 #include "esp_timer.h"
 #include "sys/param.h"
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "freertos/queue.h"
+#include "led_config.h"
+#include "led_rules.h"
 #include "rgb_led.h"
 #include "ntp.h"
 
@@ -19,7 +24,20 @@
 #include "tasks_common.h"
 #include "wifi_app.h"
 #include "adc.h"
-#include "cJSON.h"
+#include "http_request.h"
+#include "metrics.h"
+#include "histogram.h"
+#include "http_conn.h"
+#include "serializer.h"
+#include "rate_limit.h"
+#include "multipart.h"
+#include "ota_update.h"
+#include "webfs.h"
+#include "index_render.h"
+
+#if CONFIG_HTTP_SERVER_HTTPS
+#include "esp_https_server.h"
+#endif
 
 // Tag used for ESP serial console messages
 static const char TAG[] = "http_server";
@@ -37,7 +55,24 @@ static TaskHandle_t task_http_server_monitor = NULL;
 // Queue handle used to manipulate the main queue of eventsº
 static QueueHandle_t http_server_monitor_queue_handle;
 
-QueueHandle_t temperatureQueue;
+/**
+ * Per URI accounting, user_ctx of every registered URI points to one of these
+ */
+typedef struct http_server_uri_stats
+{
+	const char *uri;
+	httpd_method_t method;
+	esp_err_t (*handler)(httpd_req_t *req);
+	uint32_t requests;
+	histogram_t latency; // Time spent in the handler in microseconds
+	histogram_t bytes;	 // Response body bytes per request
+} http_server_uri_stats_t;
+
+static http_server_uri_stats_t http_server_uri_stats[HTTP_SERVER_MAX_URI_HANDLERS];
+static int http_server_uri_count = 0;
+
+// Metrics are registered once even if the server is restarted
+static bool g_metrics_registered = false;
 
 const esp_timer_create_args_t fw_update_reset_args = {
 	.callback = &http_server_fw_update_reset_callback,
@@ -46,10 +81,7 @@ const esp_timer_create_args_t fw_update_reset_args = {
 	.name = "fw_update_reset"};
 esp_timer_handle_t fw_update_reset;
 
-extern QueueHandle_t ADC_QUEUE;
-
-extern QueueHandle_t NTP_QUEUE;
-
+#if !CONFIG_HTTP_SERVER_WEBFS
 // Embedded files: JQuery, index.html, app.css, app.js and favicon.ico files
 extern const uint8_t jquery_3_3_1_min_js_start[] asm("_binary_jquery_3_3_1_min_js_start");
 extern const uint8_t jquery_3_3_1_min_js_end[] asm("_binary_jquery_3_3_1_min_js_end");
@@ -61,6 +93,15 @@ extern const uint8_t app_js_start[] asm("_binary_app_js_start");
 extern const uint8_t app_js_end[] asm("_binary_app_js_end");
 extern const uint8_t favicon_ico_start[] asm("_binary_favicon_ico_start");
 extern const uint8_t favicon_ico_end[] asm("_binary_favicon_ico_end");
+#endif
+
+#if CONFIG_HTTP_SERVER_HTTPS
+// Embedded TLS certificate and private key
+extern const uint8_t servercert_pem_start[] asm("_binary_servercert_pem_start");
+extern const uint8_t servercert_pem_end[] asm("_binary_servercert_pem_end");
+extern const uint8_t prvtkey_pem_start[] asm("_binary_prvtkey_pem_start");
+extern const uint8_t prvtkey_pem_end[] asm("_binary_prvtkey_pem_end");
+#endif
 
 /**
  * Checks the g_fw_update_status and creates the fw_update_reset timer if g_fw_update_status is true.
@@ -114,6 +155,7 @@ static void http_server_monitor(void *parameter)
 				ESP_LOGI(TAG, "HTTP_MSG_WIFI_CONNECT_FAIL");
 
 				g_wifi_connect_status = HTTP_WIFI_STATUS_CONNECT_FAILED;
+				rgb_led_wifi_connect_failed();
 
 				break;
 
@@ -127,6 +169,13 @@ static void http_server_monitor(void *parameter)
 			case HTTP_MSG_OTA_UPDATE_FAILED:
 				ESP_LOGI(TAG, "HTTP_MSG_OTA_UPDATE_FAILED");
 				g_fw_update_status = OTA_UPDATE_FAILED;
+				rgb_led_ota_update_failed();
+
+				break;
+
+			case HTTP_MSG_OTA_UPATE_INITIALIZED:
+				ESP_LOGI(TAG, "HTTP_MSG_OTA_UPATE_INITIALIZED");
+				g_fw_update_status = OTA_UPDATE_PENDING;
 
 				break;
 
@@ -137,6 +186,35 @@ static void http_server_monitor(void *parameter)
 	}
 }
 
+/**
+ * Sends index.html with the current temperature, WiFi status and time filled in,
+ * so the first response already shows them.
+ * @param req HTTP request.
+ * @param tmpl page holding the index_render placeholders.
+ * @param len page length.
+ * @return ESP_OK, or the render or send error.
+ */
+static esp_err_t http_server_render_index(httpd_req_t *req, const char *tmpl, size_t len)
+{
+	adc_snapshot_t adc;
+	char time_str[64];
+	index_render_values_t values;
+
+	adc_get_snapshot(&adc);
+	if (!ntp_get_time_str(time_str, sizeof(time_str)))
+	{
+		time_str[0] = '\0';
+	}
+
+	values.has_temperature = adc.samples > 0;
+	values.temperature = adc.temperature;
+	values.wifi_connect_status = g_wifi_connect_status;
+	values.time = time_str;
+
+	return index_render_send(req, tmpl, len, &values);
+}
+
+#if !CONFIG_HTTP_SERVER_WEBFS
 /**
  * Jquery get handler is requested when accessing the web page.
  * @param req HTTP request for which the uri needs to be handled.
@@ -144,25 +222,27 @@ static void http_server_monitor(void *parameter)
  */
 static esp_err_t http_server_jquery_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "Jquery requested");
+	ESP_LOGD(TAG, "Jquery requested");
 
 	httpd_resp_set_type(req, "application/javascript");
-	httpd_resp_send(req, (const char *)jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
+	http_request_send(req, (const char *)jquery_3_3_1_min_js_start, jquery_3_3_1_min_js_end - jquery_3_3_1_min_js_start);
 
 	return ESP_OK;
 }
 
 /**
- * Sends the index.html page.
+ * Sends the index.html page with the current readings filled in.
  * @param req HTTP request for which the uri needs to be handled.
  * @return ESP_OK
  */
 static esp_err_t http_server_index_html_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "index.html requested");
+	ESP_LOGD(TAG, "index.html requested");
 
-	httpd_resp_set_type(req, "text/html");
-	httpd_resp_send(req, (const char *)index_html_start, index_html_end - index_html_start);
+	if (http_server_render_index(req, (const char *)index_html_start, index_html_end - index_html_start) != ESP_OK)
+	{
+		httpd_resp_send_500(req);
+	}
 
 	return ESP_OK;
 }
@@ -174,10 +254,10 @@ static esp_err_t http_server_index_html_handler(httpd_req_t *req)
  */
 static esp_err_t http_server_app_css_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "app.css requested");
+	ESP_LOGD(TAG, "app.css requested");
 
 	httpd_resp_set_type(req, "text/css");
-	httpd_resp_send(req, (const char *)app_css_start, app_css_end - app_css_start);
+	http_request_send(req, (const char *)app_css_start, app_css_end - app_css_start);
 
 	return ESP_OK;
 }
@@ -189,10 +269,10 @@ static esp_err_t http_server_app_css_handler(httpd_req_t *req)
  */
 static esp_err_t http_server_app_js_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "app.js requested");
+	ESP_LOGD(TAG, "app.js requested");
 
 	httpd_resp_set_type(req, "application/javascript");
-	httpd_resp_send(req, (const char *)app_js_start, app_js_end - app_js_start);
+	http_request_send(req, (const char *)app_js_start, app_js_end - app_js_start);
 
 	return ESP_OK;
 }
@@ -204,42 +284,135 @@ static esp_err_t http_server_app_js_handler(httpd_req_t *req)
  */
 static esp_err_t http_server_favicon_ico_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "favicon.ico requested");
+	ESP_LOGD(TAG, "favicon.ico requested");
 
 	httpd_resp_set_type(req, "image/x-icon");
-	httpd_resp_send(req, (const char *)favicon_ico_start, favicon_ico_end - favicon_ico_start);
+	http_request_send(req, (const char *)favicon_ico_start, favicon_ico_end - favicon_ico_start);
 
 	return ESP_OK;
 }
 
+#else
+// Served when the www partition holds no valid image, enough to upload one
+static const char http_server_webfs_recovery_html[] =
+	"<!DOCTYPE html><html><head><meta charset=\"utf-8\"><title>ESP32 web page</title></head><body>"
+	"<h3>Web page image missing</h3>"
+	"<p>Build one with tools/mkwebfs.py and upload it here.</p>"
+	"<input type=\"file\" id=\"f\"><button onclick=\"var x=new XMLHttpRequest();"
+	"x.onload=function(){location.reload()};x.open('POST','/WWWupdate');"
+	"x.send(document.getElementById('f').files[0])\">Upload</button>"
+	"</body></html>";
+
+/**
+ * Sends static files from the www partition, straight from the memory mapped flash.
+ * Files are stored gzip compressed, the ETag lets browsers revalidate without downloading them again.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_webfs_handler(httpd_req_t *req)
+{
+	webfs_file_t file;
+	char etag[12];
+	char if_none_match[sizeof(etag)];
+	char accept_encoding[64];
+	esp_err_t err;
+
+	ESP_LOGD(TAG, "%s requested", req->uri);
+
+	if (!webfs_find(req->uri, &file))
+	{
+		if (!webfs_is_mounted() && (strcmp(req->uri, "/") == 0 || strcmp(req->uri, "/index.html") == 0))
+		{
+			httpd_resp_set_type(req, "text/html");
+			http_request_send(req, http_server_webfs_recovery_html, sizeof(http_server_webfs_recovery_html) - 1);
+			return ESP_OK;
+		}
+		httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "File not found");
+		return ESP_OK;
+	}
+
+	// Pages with placeholders are stored uncompressed and change with every reading
+	if (file.is_template)
+	{
+		if (http_server_render_index(req, (const char *)file.data, file.len) != ESP_OK)
+		{
+			httpd_resp_send_500(req);
+		}
+		return ESP_OK;
+	}
+
+	snprintf(etag, sizeof(etag), "\"%08lx\"", (unsigned long)file.etag);
+	httpd_resp_set_hdr(req, "ETag", etag);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+	if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+		strcmp(if_none_match, etag) == 0)
+	{
+		httpd_resp_set_status(req, "304 Not Modified");
+		http_request_send(req, NULL, 0);
+		return ESP_OK;
+	}
+
+	if (file.gzip)
+	{
+		// Every browser sends gzip, the device has no spare RAM to inflate for the rest
+		err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept_encoding, sizeof(accept_encoding));
+		if ((err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) || strstr(accept_encoding, "gzip") == NULL)
+		{
+			httpd_resp_set_status(req, "406 Not Acceptable");
+			http_request_send(req, "gzip encoding required", HTTPD_RESP_USE_STRLEN);
+			return ESP_OK;
+		}
+		httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+		httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+	}
+
+	httpd_resp_set_type(req, file.content_type);
+	http_request_send(req, (const char *)file.data, file.len);
+
+	return ESP_OK;
+}
+#endif
+
+/**
+ * adc_value handler responds with the latest cached temperature.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
 static esp_err_t http_server_adc_value_handler(httpd_req_t *req)
 {
-	double adc_value;
+	adc_snapshot_t adc;
+
+	adc_get_snapshot(&adc);
 
-	// Attempt to receive the ADC value from the queue
-	if (xQueueReceive(ADC_QUEUE, &adc_value, portMAX_DELAY))
+	if (adc.samples > 0)
 	{
-		char response[10];
-		snprintf(response, sizeof(response), "%f", adc_value); // sending just the value
-		httpd_resp_send(req, response, strlen(response));
+		char response[SERIALIZER_FLOAT_MAX_LEN];
+
+		// Sending just the value, formatted without printf's float path
+		http_request_send(req, response, serializer_format_float(response, adc.temperature, 2));
 	}
 	else
 	{
-		// Handle the error, e.g., send a response indicating failure.
+		// No sample has been taken yet
 		httpd_resp_send_500(req);
 	}
 
 	return ESP_OK;
 }
 
+/**
+ * ntp_value handler responds with the current local time once the clock is synchronized.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
 static esp_err_t http_server_ntp_value_handler(httpd_req_t *req)
 {
 	char ntp_value[64];
 
-	// Attempt to receive the ADC value from the queue
-	if (xQueueReceive(NTP_QUEUE, &ntp_value, portMAX_DELAY))
+	if (ntp_get_time_str(ntp_value, sizeof(ntp_value)))
 	{
-		httpd_resp_send(req, ntp_value, strlen(ntp_value));
+		http_request_send(req, ntp_value, strlen(ntp_value));
 	}
 	else
 	{
@@ -248,262 +421,479 @@ static esp_err_t http_server_ntp_value_handler(httpd_req_t *req)
 
 	return ESP_OK;
 }
+
 /**
- * wifiConnect.json handler is invoked after the connect button is pressed
- * and handles receiving the SSID and password entered by the user
+ * telemetry handler aggregates the cached device state in a single response,
+ * nothing in here blocks on the sampling or NTP tasks.
  * @param req HTTP request for which the uri needs to be handled.
  * @return ESP_OK
  */
-#include "cJSON.h"
+static esp_err_t http_server_telemetry_handler(httpd_req_t *req)
+{
+	adc_snapshot_t adc;
+	char time_str[64];
+	uint8_t telemetry[HTTP_SERVER_TELEMETRY_MAX_LEN];
+	serializer_t ser;
 
-static esp_err_t http_server_wifi_connect_json_handler(httpd_req_t *req)
+	adc_get_snapshot(&adc);
+	if (!ntp_get_time_str(time_str, sizeof(time_str)))
+	{
+		time_str[0] = '\0';
+	}
+
+	serializer_init(&ser, serializer_negotiate(req), telemetry, sizeof(telemetry));
+	serializer_begin_map(&ser);
+	serializer_key(&ser, "temp");
+	serializer_float(&ser, adc.temperature, 2);
+	serializer_key(&ser, "temp_avg");
+	serializer_float(&ser, adc.filtered, 2);
+	serializer_key(&ser, "temp_min");
+	serializer_float(&ser, adc.min, 2);
+	serializer_key(&ser, "temp_max");
+	serializer_float(&ser, adc.max, 2);
+	serializer_key(&ser, "samples");
+	serializer_uint(&ser, adc.samples);
+	serializer_key(&ser, "wifi_connect_status");
+	serializer_int(&ser, g_wifi_connect_status);
+	serializer_key(&ser, "rssi");
+	serializer_int(&ser, wifi_app_get_rssi());
+	serializer_key(&ser, "uptime");
+	serializer_int(&ser, esp_timer_get_time() / 1000000);
+	serializer_key(&ser, "time");
+	serializer_string(&ser, time_str);
+	serializer_key(&ser, "sync_time");
+	serializer_int(&ser, ntp_get_sync_time());
+	serializer_key(&ser, "free_heap");
+	serializer_uint(&ser, esp_get_free_heap_size());
+	serializer_end_map(&ser);
+
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	serializer_send(req, &ser);
+
+	return ESP_OK;
+}
+
+/**
+ * Destination of an uploaded body, the OTA slot or the www partition
+ */
+typedef struct http_server_upload
 {
-	size_t header_len;
-	char *header_value;
-	char *ssid_str = NULL;
-	char *pass_str = NULL;
-	int content_length;
+	esp_err_t (*begin)(size_t size);
+	esp_err_t (*write)(const uint8_t *data, size_t len);
+	esp_err_t (*end)(void);
+	void (*abort)(void);
+	const char *begin_failed_msg;
+	const char *rejected_msg;
+} http_server_upload_t;
 
-	ESP_LOGI(TAG, "/wifiConnect.json requested");
+/**
+ * Passes the first multipart part on to the upload target.
+ */
+static esp_err_t http_server_upload_write_cb(void *ctx, const uint8_t *data, size_t len)
+{
+	const http_server_upload_t *upload = ctx;
+
+	return upload->write(data, len);
+}
 
-	// Get the "Content-Length" header to determine the length of the request body
-	header_len = httpd_req_get_hdr_value_len(req, "Content-Length");
-	if (header_len <= 0)
+/**
+ * Streams the request body into an upload target as it is received.
+ * Accepts multipart/form-data (as sent by the web page) or a raw application/octet-stream body.
+ * The error response is sent here when the upload fails.
+ * @param req HTTP request.
+ * @param upload upload target.
+ * @param result set to ESP_OK once the target accepted the whole body, to the error otherwise.
+ * @return ESP_OK, otherwise ESP_FAIL if the connection must be closed.
+ */
+static esp_err_t http_server_receive_upload(httpd_req_t *req, const http_server_upload_t *upload, esp_err_t *result)
+{
+	char recv_buff[HTTP_SERVER_OTA_RECV_BUF_LEN];
+	char content_type[HTTP_SERVER_OTA_CONTENT_TYPE_LEN];
+	char boundary[MULTIPART_MAX_BOUNDARY_LEN + 1];
+	multipart_parser_t parser;
+	bool is_multipart = false;
+	size_t remaining = req->content_len;
+	int retries = 0;
+	esp_err_t err;
+
+	*result = ESP_FAIL;
+
+	if (req->content_len == 0)
 	{
-		// Content-Length header not found or invalid
-		// httpd_resp_send_err(req, HTTP_STATUS_411_LENGTH_REQUIRED, "Content-Length header is missing or invalid");
-		ESP_LOGI(TAG, "Content-Length header is missing or invalid");
+		httpd_resp_send_err(req, HTTPD_411_LENGTH_REQUIRED, "Content-Length header is missing or invalid");
 		return ESP_FAIL;
 	}
 
-	// Allocate memory to store the header value
-	header_value = (char *)malloc(header_len + 1);
-	if (httpd_req_get_hdr_value_str(req, "Content-Length", header_value, header_len + 1) != ESP_OK)
+	if (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) == ESP_OK &&
+		multipart_get_boundary(content_type, boundary) == ESP_OK)
 	{
-		// Failed to get Content-Length header value
-		free(header_value);
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Failed to get Content-Length header value");
-		ESP_LOGI(TAG, "Failed to get Content-Length header value");
+		multipart_parser_init(&parser, boundary, http_server_upload_write_cb, (void *)upload);
+		is_multipart = true;
+	}
+
+	// The multipart framing makes the body a little larger than the image
+	err = upload->begin(is_multipart ? 0 : req->content_len);
+	if (err != ESP_OK)
+	{
+		*result = err;
+		httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, upload->begin_failed_msg);
 		return ESP_FAIL;
 	}
 
-	// Convert the Content-Length header value to an integer
-	content_length = atoi(header_value);
-	free(header_value);
+	while (remaining > 0)
+	{
+		int recv_len = httpd_req_recv(req, recv_buff, MIN(remaining, sizeof(recv_buff)));
+
+		if (recv_len == HTTPD_SOCK_ERR_TIMEOUT && ++retries <= HTTP_REQUEST_MAX_RECV_RETRIES)
+		{
+			ESP_LOGD(TAG, "http_server_receive_upload: Socket Timeout");
+			continue;
+		}
+		if (recv_len <= 0)
+		{
+			ESP_LOGE(TAG, "http_server_receive_upload: receive error %d", recv_len);
+			err = ESP_FAIL;
+			break;
+		}
+		retries = 0;
+		remaining -= recv_len;
 
-	if (content_length <= 0)
+		if (is_multipart)
+		{
+			err = multipart_parser_feed(&parser, (const uint8_t *)recv_buff, recv_len);
+		}
+		else
+		{
+			err = upload->write((const uint8_t *)recv_buff, recv_len);
+		}
+		if (err != ESP_OK)
+		{
+			break;
+		}
+	}
+
+	if (err == ESP_OK && is_multipart && !multipart_parser_is_done(&parser))
 	{
-		// Content length is not a valid positive integer
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Invalid Content-Length value");
-		ESP_LOGI(TAG, "Invalid Content-Length value");
-		return ESP_FAIL;
+		ESP_LOGE(TAG, "http_server_receive_upload: multipart body ended before the closing boundary");
+		err = ESP_ERR_INVALID_RESPONSE;
 	}
 
-	// Allocate memory for the data buffer based on the content length
-	char *data_buffer = (char *)malloc(content_length + 1);
+	if (err == ESP_OK)
+	{
+		err = upload->end();
+	}
+	else
+	{
+		upload->abort();
+	}
 
-	// Read the request body into the data buffer
-	if (httpd_req_recv(req, data_buffer, content_length) <= 0)
+	*result = err;
+	if (err != ESP_OK)
 	{
-		// Handle error while receiving data
-		free(data_buffer);
-		// httpd_resp_send_err(req, HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to receive request body");
-		ESP_LOGI(TAG, "Failed to receive request body");
+		if (remaining == 0)
+		{
+			httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, upload->rejected_msg);
+			return ESP_OK;
+		}
+		// Unread body left on the socket, close the connection
 		return ESP_FAIL;
 	}
 
-	// Null-terminate the data buffer to treat it as a string
-	data_buffer[content_length] = '\0';
-
-	// Parse the received JSON data
-	cJSON *root = cJSON_Parse(data_buffer);
-	free(data_buffer);
+	return ESP_OK;
+}
 
-	if (root == NULL)
+/**
+ * Receives the .bin file via the web page and streams it into the next OTA partition.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK, otherwise ESP_FAIL if the connection must be closed.
+ */
+static esp_err_t http_server_OTA_update_handler(httpd_req_t *req)
+{
+	static const http_server_upload_t ota_upload = {
+		.begin = ota_update_begin,
+		.write = ota_update_write,
+		.end = ota_update_end,
+		.abort = ota_update_abort,
+		.begin_failed_msg = "Unable to start the firmware update",
+		.rejected_msg = "Firmware image rejected",
+	};
+	esp_err_t result;
+	esp_err_t ret;
+
+	ESP_LOGI(TAG, "/OTAupdate requested, %u bytes", (unsigned int)req->content_len);
+
+	http_server_monitor_send_message(HTTP_MSG_OTA_UPATE_INITIALIZED);
+
+	ret = http_server_receive_upload(req, &ota_upload, &result);
+	if (result != ESP_OK)
 	{
-		// JSON parsing error
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Invalid JSON data");
-		ESP_LOGI(TAG, "Invalid JSON data");
-		return ESP_FAIL;
+		http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_FAILED);
+		return ret;
 	}
 
-	cJSON *ssid_json = cJSON_GetObjectItem(root, "selectedSSID");
-	cJSON *pwd_json = cJSON_GetObjectItem(root, "pwd");
+	// Queue the status change before answering so the page's next /OTAstatus poll sees it
+	http_server_monitor_send_message(HTTP_MSG_OTA_UPDATE_SUCCESSFUL);
+	http_request_send(req, "{\"ota_update_status\":1}", HTTPD_RESP_USE_STRLEN);
 
-	if (ssid_json == NULL || pwd_json == NULL || !cJSON_IsString(ssid_json) || !cJSON_IsString(pwd_json))
+	return ESP_OK;
+}
+
+#if CONFIG_HTTP_SERVER_WEBFS
+/**
+ * Receives a www partition image built by tools/mkwebfs.py and serves it as soon as it is written.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK, otherwise ESP_FAIL if the connection must be closed.
+ */
+static esp_err_t http_server_webfs_update_handler(httpd_req_t *req)
+{
+	static const http_server_upload_t webfs_upload = {
+		.begin = webfs_update_begin,
+		.write = webfs_update_write,
+		.end = webfs_update_end,
+		.abort = webfs_update_abort,
+		.begin_failed_msg = "Unable to start the web page update",
+		.rejected_msg = "Web page image rejected",
+	};
+	esp_err_t result;
+	esp_err_t ret;
+
+	ESP_LOGI(TAG, "/WWWupdate requested, %u bytes", (unsigned int)req->content_len);
+
+	ret = http_server_receive_upload(req, &webfs_upload, &result);
+	if (result != ESP_OK)
 	{
-		cJSON_Delete(root);
-		// Missing or invalid JSON fields
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Missing or invalid JSON data fields");
-		ESP_LOGI(TAG, "Missing or invalid JSON data fields");
-		return ESP_FAIL;
+		return ret;
 	}
 
-	// Extract SSID and password from JSON
-	ssid_str = strdup(ssid_json->valuestring);
-	pass_str = strdup(pwd_json->valuestring);
+	// The new index.html may sit where the old one was mapped
+	index_render_invalidate();
+	http_request_send(req, "{\"www_update_status\":1}", HTTPD_RESP_USE_STRLEN);
+
+	return ESP_OK;
+}
+#endif
+
+/**
+ * OTA status handler responds with the firmware update status after the OTA update is started
+ * and responds with the compile time/date when the page is first requested.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_OTA_status_handler(httpd_req_t *req)
+{
+	uint8_t ota_status[HTTP_SERVER_OTA_STATUS_MAX_LEN];
+	const esp_app_desc_t *app_desc = esp_app_get_description();
+	ota_update_progress_t progress;
+	serializer_t ser;
+
+	ESP_LOGD(TAG, "/OTAstatus requested");
+
+	ota_update_get_progress(&progress);
+
+	serializer_init(&ser, serializer_negotiate(req), ota_status, sizeof(ota_status));
+	serializer_begin_map(&ser);
+	serializer_key(&ser, "ota_update_status");
+	serializer_int(&ser, g_fw_update_status);
+	serializer_key(&ser, "compile_time");
+	serializer_string(&ser, app_desc->time);
+	serializer_key(&ser, "compile_date");
+	serializer_string(&ser, app_desc->date);
+	serializer_key(&ser, "version");
+	serializer_string(&ser, app_desc->version);
+	serializer_key(&ser, "received");
+	serializer_uint(&ser, progress.received);
+	serializer_key(&ser, "written");
+	serializer_uint(&ser, progress.written);
+	serializer_key(&ser, "total");
+	serializer_uint(&ser, progress.total);
+	serializer_key(&ser, "elapsed_ms");
+	serializer_uint(&ser, progress.elapsed_ms);
+	serializer_end_map(&ser);
+
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	serializer_send(req, &ser);
+
+	return ESP_OK;
+}
 
-	cJSON_Delete(root);
+/**
+ * wifiConnect.json handler is invoked after the connect button is pressed
+ * and handles receiving the SSID and password entered by the user
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_wifi_connect_json_handler(httpd_req_t *req)
+{
+	char body[HTTP_REQUEST_MAX_BODY_LEN];
+	char ssid_str[MAX_SSID_LENGTH + 1];
+	char pass_str[MAX_PASSWORD_LENGTH + 1];
+
+	ESP_LOGI(TAG, "/wifiConnect.json requested");
+
+	const json_field_t fields[] = {
+		{"selectedSSID", JSON_FIELD_STRING, ssid_str, sizeof(ssid_str)},
+		{"pwd", JSON_FIELD_STRING, pass_str, sizeof(pass_str)},
+	};
+
+	if (http_request_bind_json(req, body, sizeof(body), fields, sizeof(fields) / sizeof(fields[0])) != ESP_OK)
+	{
+		return ESP_FAIL;
+	}
 
 	// Now, you have the SSID and password in ssid_str and pass_str
 	ESP_LOGI(TAG, "Received SSID: %s", ssid_str);
-	ESP_LOGI(TAG, "Received Password: %s", pass_str);
 
 	// Update the Wifi networks configuration and let the wifi application know
 	wifi_config_t *wifi_config = wifi_app_get_wifi_config();
-	// memset(wifi_config, 0x00, sizeof(wifi_config_t));
-	memset(wifi_config->sta.ssid, 0x00, 32);
-	memset(wifi_config->sta.password, 0x00, 64);
+	memset(wifi_config->sta.ssid, 0x00, MAX_SSID_LENGTH);
+	memset(wifi_config->sta.password, 0x00, MAX_PASSWORD_LENGTH);
 	memcpy(wifi_config->sta.ssid, ssid_str, strlen(ssid_str));
 	memcpy(wifi_config->sta.password, pass_str, strlen(pass_str));
 
 	wifi_app_send_message(WIFI_APP_MSG_CONNECTING_FROM_HTTP_SERVER);
-	free(ssid_str);
-	free(pass_str);
 
 	return ESP_OK;
 }
 
-static esp_err_t http_server_temp_range_handler(httpd_req_t *req)
+/**
+ * Reads the three ranges sent by the original page into a configuration: the
+ * high range, the medium range, and the third color for everything else.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if a field is missing.
+ */
+static esp_err_t http_server_temp_range_legacy(const char *js, const json_token_t *tokens, int num_tokens, led_config_t *config)
 {
-	size_t header_len;
-	char *header_value;
-	int high_temp_lvalue_num = 0;
-	int high_temp_uvalue_num = 0;
-	int medium_temp_lvalue_num = 0;
-	int medium_temp_uvalue_num = 0;
-	int low_temp_lvalue_num = 0;
-	int low_temp_uvalue_num = 0;
-	int r_value_first_led_num = 0;
-	int g_value_first_led_num = 0;
-	int b_value_first_led_num = 0;
-	int r_value_second_led_num = 0;
-	int g_value_second_led_num = 0;
-	int b_value_second_led_num = 0;
-	int r_value_third_led_num = 0;
-	int g_value_third_led_num = 0;
-	int b_value_third_led_num = 0;
-	int content_length;
-
-	ESP_LOGI(TAG, "/tempRange.json requested");
-
-	// Get the "Content-Length" header to determine the length of the request body
-	header_len = httpd_req_get_hdr_value_len(req, "Content-Length");
-	if (header_len <= 0)
+	int high_l, high_u, medium_l, medium_u;
+	int rgb[3][3];
+	led_rules_zone_t zones[2];
+
+	const json_field_t fields[] = {
+		{"high_temp_lvalue", JSON_FIELD_INT, &high_l, 0},
+		{"high_temp_uvalue", JSON_FIELD_INT, &high_u, 0},
+		{"medium_temp_lvalue", JSON_FIELD_INT, &medium_l, 0},
+		{"medium_temp_uvalue", JSON_FIELD_INT, &medium_u, 0},
+		{"r_value_first_led", JSON_FIELD_INT, &rgb[0][0], 0},
+		{"g_value_first_led", JSON_FIELD_INT, &rgb[0][1], 0},
+		{"b_value_first_led", JSON_FIELD_INT, &rgb[0][2], 0},
+		{"r_value_second_led", JSON_FIELD_INT, &rgb[1][0], 0},
+		{"g_value_second_led", JSON_FIELD_INT, &rgb[1][1], 0},
+		{"b_value_second_led", JSON_FIELD_INT, &rgb[1][2], 0},
+		{"r_value_third_led", JSON_FIELD_INT, &rgb[2][0], 0},
+		{"g_value_third_led", JSON_FIELD_INT, &rgb[2][1], 0},
+		{"b_value_third_led", JSON_FIELD_INT, &rgb[2][2], 0},
+	};
+
+	// The low range is still sent by the page but was never looked at, the third color covers everything else
+	if (json_parser_bind(js, tokens, num_tokens, 0, fields, sizeof(fields) / sizeof(fields[0])) != sizeof(fields) / sizeof(fields[0]))
 	{
-		// Content-Length header not found or invalid
-		// httpd_resp_send_err(req, HTTP_STATUS_411_LENGTH_REQUIRED, "Content-Length header is missing or invalid");
-		ESP_LOGI(TAG, "Content-Length header is missing or invalid");
-		return ESP_FAIL;
+		return ESP_ERR_NOT_FOUND;
 	}
 
-	// Allocate memory to store the header value
-	header_value = (char *)malloc(header_len + 1);
-	if (httpd_req_get_hdr_value_str(req, "Content-Length", header_value, header_len + 1) != ESP_OK)
+	ESP_LOGI(TAG, "Received Temp Range High: %d - %d", high_l, high_u);
+	ESP_LOGI(TAG, "Received Temp Range Medium: %d - %d", medium_l, medium_u);
+
+	zones[0].low = led_rules_to_tenths(high_l);
+	zones[0].high = led_rules_to_tenths(high_u);
+	zones[0].rgb = LED_RULES_RGB(rgb[0][0], rgb[0][1], rgb[0][2]);
+	zones[1].low = led_rules_to_tenths(medium_l);
+	zones[1].high = led_rules_to_tenths(medium_u);
+	zones[1].rgb = LED_RULES_RGB(rgb[1][0], rgb[1][1], rgb[1][2]);
+
+	// An empty range (low above high) matched nothing before, it is left out rather than rejected
+	config->kind = LED_CONFIG_ZONES;
+	config->count = 0;
+	config->default_rgb = LED_RULES_RGB(rgb[2][0], rgb[2][1], rgb[2][2]);
+	for (int i = 0; i < 2; i++)
 	{
-		// Failed to get Content-Length header value
-		free(header_value);
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Failed to get Content-Length header value");
-		ESP_LOGI(TAG, "Failed to get Content-Length header value");
-		return ESP_FAIL;
+		if (zones[i].low <= zones[i].high)
+		{
+			config->zones[config->count++] = zones[i];
+		}
 	}
 
-	// Convert the Content-Length header value to an integer
-	content_length = atoi(header_value);
-	free(header_value);
+	return ESP_OK;
+}
+
+/**
+ * tempRange.json handler receives the temperature zones and their colors and
+ * applies them through led_config, which hands them to the LED controller task
+ * and saves them for the next boot. The body is either
+ * {"zones":[{"low":20.5,"high":30,"color":"#ff8000"},...],"default":"#000000"},
+ * zones listed first winning where they overlap, a gradient
+ * {"gradient":[{"temp":10,"color":"#0000ff"},{"temp":35,"color":"#ff0000"},...]},
+ * or the three ranges of the original page. All take an optional "transition_ms".
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK, otherwise ESP_FAIL if the body could not be read or is invalid.
+ */
+static esp_err_t http_server_temp_range_handler(httpd_req_t *req)
+{
+	char body[HTTP_SERVER_TEMP_RANGE_MAX_BODY_LEN];
+	json_token_t tokens[HTTP_SERVER_TEMP_RANGE_MAX_JSON_TOKENS];
+	// Kept off the httpd stack, handlers only run in the httpd task
+	static led_config_t config;
+	int transition_ms = -1;
+	int num_tokens;
+	int num;
+	int index;
+	esp_err_t err;
 
-	if (content_length <= 0)
+	ESP_LOGI(TAG, "/tempRange.json requested");
+
+	num_tokens = http_request_parse_json(req, body, sizeof(body), tokens, HTTP_SERVER_TEMP_RANGE_MAX_JSON_TOKENS);
+	if (num_tokens < 0)
 	{
-		// Content length is not a valid positive integer
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Invalid Content-Length value");
-		ESP_LOGI(TAG, "Invalid Content-Length value");
 		return ESP_FAIL;
 	}
 
-	// Allocate memory for the data buffer based on the content length
-	char *data_buffer = (char *)malloc(content_length + 1);
+	memset(&config, 0, sizeof(config));
+	config.transition_ms = LED_CONFIG_TRANSITION_UNCHANGED;
 
-	// Read the request body into the data buffer
-	if (httpd_req_recv(req, data_buffer, content_length) <= 0)
+	if ((index = json_parser_find(body, tokens, num_tokens, 0, "gradient")) >= 0)
 	{
-		// Handle error while receiving data
-		free(data_buffer);
-		// httpd_resp_send_err(req, HTTP_STATUS_INTERNAL_SERVER_ERROR, "Failed to receive request body");
-		ESP_LOGI(TAG, "Failed to receive request body");
-		return ESP_FAIL;
+		config.kind = LED_CONFIG_GRADIENT;
+		err = led_rules_parse_points(body, tokens, num_tokens, index, config.points, &num);
+		config.count = num;
+	}
+	else if ((index = json_parser_find(body, tokens, num_tokens, 0, "zones")) >= 0)
+	{
+		config.kind = LED_CONFIG_ZONES;
+		err = led_rules_parse_zones(body, tokens, num_tokens, index, config.zones, &num);
+		config.count = num;
+		if (err == ESP_OK && (index = json_parser_find(body, tokens, num_tokens, 0, "default")) >= 0)
+		{
+			err = led_rules_parse_color(body, &tokens[index], &config.default_rgb);
+		}
+	}
+	else
+	{
+		err = http_server_temp_range_legacy(body, tokens, num_tokens, &config);
 	}
 
-	// Null-terminate the data buffer to treat it as a string
-	data_buffer[content_length] = '\0';
-	ESP_LOGI(TAG, "Received JSON data: %s", data_buffer);
-
-	// Parse the received JSON data
-	cJSON *root = cJSON_Parse(data_buffer);
-	if (root == NULL)
+	if (err == ESP_OK && (index = json_parser_find(body, tokens, num_tokens, 0, "transition_ms")) >= 0)
 	{
-		const char *error_ptr = cJSON_GetErrorPtr();
-		if (error_ptr != NULL)
+		err = (json_parser_token_to_int(body, &tokens[index], &transition_ms) == 0 && transition_ms >= 0) ? ESP_OK : ESP_ERR_INVALID_ARG;
+		if (err == ESP_OK)
 		{
-			ESP_LOGE(TAG, "Error before: %s", error_ptr);
+			config.transition_ms = (transition_ms < RGB_LED_TRANSITION_MAX_MS) ? transition_ms : RGB_LED_TRANSITION_MAX_MS;
 		}
-		return ESP_FAIL; // Or handle the error as needed
 	}
-	free(data_buffer);
 
-	if (root == NULL)
+	// Compiled and picked up by the LED controller task, the flash write happens later in the esp_timer task
+	if (err == ESP_OK)
 	{
-		// JSON parsing error
-		// httpd_resp_send_err(req, HTTP_STATUS_BAD_REQUEST, "Invalid JSON data");
-		ESP_LOGI(TAG, "Invalid JSON data");
+		err = led_config_apply(&config);
+	}
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGI(TAG, "Invalid temperature zones (%s)", esp_err_to_name(err));
+		httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid temperature zones");
 		return ESP_FAIL;
 	}
 
-	cJSON *high_temp_lvalue_json = cJSON_GetObjectItem(root, "high_temp_lvalue");
-	cJSON *high_temp_uvalue_json = cJSON_GetObjectItem(root, "high_temp_uvalue");
-	cJSON *medium_temp_lvalue_json = cJSON_GetObjectItem(root, "medium_temp_lvalue");
-	cJSON *medium_temp_uvalue_json = cJSON_GetObjectItem(root, "medium_temp_uvalue");
-	cJSON *low_temp_lvalue_json = cJSON_GetObjectItem(root, "low_temp_lvalue");
-	cJSON *low_temp_uvalue_json = cJSON_GetObjectItem(root, "low_temp_uvalue");
-	cJSON *r_value_first_led_json = cJSON_GetObjectItem(root, "r_value_first_led");
-	cJSON *g_value_first_led_json = cJSON_GetObjectItem(root, "g_value_first_led");
-	cJSON *b_value_first_led_json = cJSON_GetObjectItem(root, "b_value_first_led");
-	cJSON *r_value_second_led_json = cJSON_GetObjectItem(root, "r_value_second_led");
-	cJSON *g_value_second_led_json = cJSON_GetObjectItem(root, "g_value_second_led");
-	cJSON *b_value_second_led_json = cJSON_GetObjectItem(root, "b_value_second_led");
-	cJSON *r_value_third_led_json = cJSON_GetObjectItem(root, "r_value_third_led");
-	cJSON *g_value_third_led_json = cJSON_GetObjectItem(root, "g_value_third_led");
-	cJSON *b_value_third_led_json = cJSON_GetObjectItem(root, "b_value_third_led");
-
-	TemperatureValues tempVals;
-
-	tempVals.high_temp_lvalue = atoi(cJSON_GetStringValue(high_temp_lvalue_json));
-	tempVals.high_temp_uvalue = atoi(cJSON_GetStringValue(high_temp_uvalue_json));
-	tempVals.medium_temp_lvalue = atoi(cJSON_GetStringValue(medium_temp_lvalue_json));
-	tempVals.medium_temp_uvalue = atoi(cJSON_GetStringValue(medium_temp_uvalue_json));
-	tempVals.low_temp_lvalue = atoi(cJSON_GetStringValue(low_temp_lvalue_json));
-	tempVals.low_temp_uvalue = atoi(cJSON_GetStringValue(low_temp_uvalue_json));
-	tempVals.r_value_first_led = atoi(cJSON_GetStringValue(r_value_first_led_json));
-	tempVals.g_value_first_led = atoi(cJSON_GetStringValue(g_value_first_led_json));
-	tempVals.b_value_first_led = atoi(cJSON_GetStringValue(b_value_first_led_json));
-	tempVals.r_value_second_led = atoi(cJSON_GetStringValue(r_value_second_led_json));
-	tempVals.g_value_second_led = atoi(cJSON_GetStringValue(g_value_second_led_json));
-	tempVals.b_value_second_led = atoi(cJSON_GetStringValue(b_value_second_led_json));
-	tempVals.r_value_third_led = atoi(cJSON_GetStringValue(r_value_third_led_json));
-	tempVals.g_value_third_led = atoi(cJSON_GetStringValue(g_value_third_led_json));
-	tempVals.b_value_third_led = atoi(cJSON_GetStringValue(b_value_third_led_json));
-
-	cJSON_Delete(root);
-
-	temperatureQueue = xQueueCreate(10, sizeof(TemperatureValues));
-	xQueueSend(temperatureQueue, &tempVals, portMAX_DELAY);
+	ESP_LOGI(TAG, "Temperature rules: %d %s", config.count, (config.kind == LED_CONFIG_GRADIENT) ? "gradient points" : "zones");
 
-	// Now, you have the SSID and password in ssid_str and pass_str
-	ESP_LOGI(TAG, "Received Temp Range High: %d - %d", tempVals.high_temp_lvalue, tempVals.high_temp_uvalue);
-	ESP_LOGI(TAG, "Received Temp Range Medium: %d - %d", tempVals.medium_temp_lvalue, tempVals.medium_temp_uvalue);
-	ESP_LOGI(TAG, "Received Temp Range Low: %d - %d", tempVals.low_temp_lvalue, tempVals.low_temp_uvalue);
-	ESP_LOGI(TAG, "Received first RGB values: %d - %d - %d", tempVals.r_value_first_led, tempVals.g_value_first_led, tempVals.b_value_first_led);
+	http_request_send(req, "{\"temp_range_status\":1}", HTTPD_RESP_USE_STRLEN);
 
-	rgb_led_http_received();
 	return ESP_OK;
 }
 
@@ -514,18 +904,230 @@ static esp_err_t http_server_temp_range_handler(httpd_req_t *req)
  */
 static esp_err_t http_server_wifi_connect_status_json_handler(httpd_req_t *req)
 {
-	ESP_LOGI(TAG, "/wifiConnectStatus requested");
+	ESP_LOGD(TAG, "/wifiConnectStatus requested");
 
-	char statusJSON[100];
+	uint8_t status[HTTP_SERVER_STATUS_MAX_LEN];
+	serializer_t ser;
 
-	sprintf(statusJSON, "{\"wifi_connect_status\":%d}", g_wifi_connect_status);
+	serializer_init(&ser, serializer_negotiate(req), status, sizeof(status));
+	serializer_begin_map(&ser);
+	serializer_key(&ser, "wifi_connect_status");
+	serializer_int(&ser, g_wifi_connect_status);
+	serializer_end_map(&ser);
 
-	httpd_resp_set_type(req, "application/json");
-	httpd_resp_send(req, statusJSON, strlen(statusJSON));
+	serializer_send(req, &ser);
 
 	return ESP_OK;
 }
 
+/**
+ * metrics handler streams the registered counters and gauges in the Prometheus text format.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_metrics_handler(httpd_req_t *req)
+{
+	return metrics_write(req);
+}
+
+/**
+ * Writes the per URI request counters to the metrics output.
+ */
+static void http_server_metrics_collector(metrics_writer_t *writer, void *arg)
+{
+	metrics_writer_family(writer, "http_requests_total", "Requests handled per URI", METRICS_TYPE_COUNTER);
+	for (int i = 0; i < http_server_uri_count; i++)
+	{
+		const http_server_uri_stats_t *stats = &http_server_uri_stats[i];
+
+		metrics_writer_printf(writer, "http_requests_total{uri=\"%s\",method=\"%s\"} %lu\n",
+							  stats->uri, http_method_str(stats->method), (unsigned long)stats->requests);
+	}
+
+	metrics_writer_family(writer, "http_handler_duration_us", "Time spent in the handler per URI", METRICS_TYPE_HISTOGRAM);
+	for (int i = 0; i < http_server_uri_count; i++)
+	{
+		char labels[HTTP_SERVER_LABELS_MAX_LEN];
+
+		snprintf(labels, sizeof(labels), "uri=\"%s\"", http_server_uri_stats[i].uri);
+		histogram_write_metrics(writer, "http_handler_duration_us", labels, &http_server_uri_stats[i].latency);
+	}
+
+	metrics_writer_family(writer, "http_response_bytes", "Response body size per URI", METRICS_TYPE_HISTOGRAM);
+	for (int i = 0; i < http_server_uri_count; i++)
+	{
+		char labels[HTTP_SERVER_LABELS_MAX_LEN];
+
+		snprintf(labels, sizeof(labels), "uri=\"%s\"", http_server_uri_stats[i].uri);
+		histogram_write_metrics(writer, "http_response_bytes", labels, &http_server_uri_stats[i].bytes);
+	}
+}
+
+/**
+ * http_stats handler responds with the per URI request counts and latency / size histograms as JSON.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_http_stats_handler(httpd_req_t *req)
+{
+	metrics_writer_t writer = {
+		.req = req,
+		.len = 0,
+		.err = ESP_OK,
+	};
+
+	httpd_resp_set_type(req, "application/json");
+
+	metrics_writer_printf(&writer, "[");
+	for (int i = 0; i < http_server_uri_count; i++)
+	{
+		const http_server_uri_stats_t *stats = &http_server_uri_stats[i];
+
+		metrics_writer_printf(&writer, "%s{\"uri\":\"%s\",\"method\":\"%s\",\"requests\":%lu,\"latency_us\":",
+							  i ? "," : "", stats->uri, http_method_str(stats->method), (unsigned long)stats->requests);
+		histogram_write_json(&writer, &stats->latency);
+		metrics_writer_printf(&writer, ",\"bytes\":");
+		histogram_write_json(&writer, &stats->bytes);
+		metrics_writer_printf(&writer, "}");
+	}
+	metrics_writer_printf(&writer, "]");
+
+	return metrics_writer_end(&writer);
+}
+
+/**
+ * connections handler responds with the open connections and their request and byte counters.
+ * @param req HTTP request for which the uri needs to be handled.
+ * @return ESP_OK
+ */
+static esp_err_t http_server_connections_handler(httpd_req_t *req)
+{
+	metrics_writer_t writer = {
+		.req = req,
+		.len = 0,
+		.err = ESP_OK,
+	};
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+	http_conn_write_json(&writer);
+
+	return metrics_writer_end(&writer);
+}
+
+/**
+ * Common entry point of every registered URI, accounts the request and calls the real handler.
+ * @param req HTTP request, user_ctx points to the URI's stats slot.
+ * @return the handler's result.
+ */
+static esp_err_t http_server_dispatch(httpd_req_t *req)
+{
+	http_server_uri_stats_t *stats = (http_server_uri_stats_t *)req->user_ctx;
+	int64_t start = esp_timer_get_time();
+	uint32_t bytes_sent;
+	esp_err_t ret;
+
+	// Drop bytes accounted outside of a handler
+	http_request_take_bytes_sent();
+
+#if CONFIG_HTTP_SERVER_RATE_LIMIT
+	// Refuse over-limit clients before the handler does any work
+	uint32_t retry_after_s;
+	if (!rate_limit_allow(req, &retry_after_s))
+	{
+		rate_limit_send_429(req, retry_after_s);
+		http_conn_account(req, http_request_take_bytes_sent());
+
+		// Close the connection rather than reading a large body just to discard it
+		return (req->content_len > HTTP_REQUEST_MAX_BODY_LEN) ? ESP_FAIL : ESP_OK;
+	}
+#endif
+
+	__atomic_fetch_add(&stats->requests, 1, __ATOMIC_RELAXED);
+
+	ret = stats->handler(req);
+
+	bytes_sent = http_request_take_bytes_sent();
+	histogram_record(&stats->latency, (uint32_t)(esp_timer_get_time() - start));
+	histogram_record(&stats->bytes, bytes_sent);
+	http_conn_account(req, bytes_sent);
+
+	return ret;
+}
+
+/**
+ * Registers a URI handler through http_server_dispatch so every request is accounted for.
+ * @param uri_handler URI description, handler is the real handler and user_ctx must be NULL.
+ */
+static void http_server_register_uri_handler(const httpd_uri_t *uri_handler)
+{
+	http_server_uri_stats_t *stats;
+	httpd_uri_t dispatch_uri = *uri_handler;
+
+	if (http_server_uri_count >= HTTP_SERVER_MAX_URI_HANDLERS)
+	{
+		ESP_LOGE(TAG, "http_server_register_uri_handler: no slot left for %s", uri_handler->uri);
+		return;
+	}
+
+	stats = &http_server_uri_stats[http_server_uri_count];
+	stats->uri = uri_handler->uri;
+	stats->method = uri_handler->method;
+	stats->handler = uri_handler->handler;
+	stats->requests = 0;
+	histogram_init(&stats->latency, HTTP_SERVER_LATENCY_HISTOGRAM_SHIFT);
+	histogram_init(&stats->bytes, HTTP_SERVER_BYTES_HISTOGRAM_SHIFT);
+
+	dispatch_uri.handler = http_server_dispatch;
+	dispatch_uri.user_ctx = stats;
+	if (httpd_register_uri_handler(http_server_handle, &dispatch_uri) == ESP_OK)
+	{
+		http_server_uri_count++;
+	}
+}
+
+/**
+ * Starts the httpd instance, wrapped in TLS when HTTPS mode is configured.
+ * @param config server configuration.
+ * @return result of httpd_start / httpd_ssl_start.
+ */
+static esp_err_t http_server_start_httpd(const httpd_config_t *config)
+{
+#if CONFIG_HTTP_SERVER_HTTPS
+	httpd_ssl_config_t ssl_config = HTTPD_SSL_CONFIG_DEFAULT();
+
+	ssl_config.httpd = *config;
+
+	// The TLS stack needs a bigger task stack, and every connection holds an mbedTLS context
+	ssl_config.httpd.stack_size = HTTP_SERVER_TLS_TASK_STACK_SIZE;
+	ssl_config.httpd.max_open_sockets = CONFIG_HTTP_SERVER_HTTPS_MAX_SOCKETS;
+
+	ssl_config.servercert = servercert_pem_start;
+	ssl_config.servercert_len = servercert_pem_end - servercert_pem_start;
+	ssl_config.prvtkey_pem = prvtkey_pem_start;
+	ssl_config.prvtkey_len = prvtkey_pem_end - prvtkey_pem_start;
+
+#if CONFIG_HTTP_SERVER_HTTPS_SESSION_TICKETS
+	// Returning clients resume with a ticket and skip the full handshake
+	ssl_config.session_tickets = true;
+#endif
+
+	ESP_LOGI(TAG,
+			 "http_server_configure: Starting HTTPS server on port: '%d' with task priority: '%d'",
+			 ssl_config.port_secure,
+			 ssl_config.httpd.task_priority);
+
+	return httpd_ssl_start(&http_server_handle, &ssl_config);
+#else
+	ESP_LOGI(TAG,
+			 "http_server_configure: Starting server on port: '%d' with task priority: '%d'",
+			 config->server_port,
+			 config->task_priority);
+
+	return httpd_start(&http_server_handle, config);
+#endif
+}
+
 /**
  * Sets up the default httpd server configuration.
  * @return http server instance handle if successful, NULL otherwise.
@@ -537,6 +1139,7 @@ static httpd_handle_t http_server_configure(void)
 
 	// Create HTTP server monitor task
 	xTaskCreatePinnedToCore(&http_server_monitor, "http_server_monitor", HTTP_SERVER_MONITOR_STACK_SIZE, NULL, HTTP_SERVER_MONITOR_PRIORITY, &task_http_server_monitor, HTTP_SERVER_MONITOR_CORE_ID);
+	metrics_register_task(task_http_server_monitor);
 
 	// Create the message queue
 	http_server_monitor_queue_handle = xQueueCreate(3, sizeof(http_server_queue_message_t));
@@ -551,29 +1154,43 @@ static httpd_handle_t http_server_configure(void)
 	config.stack_size = HTTP_SERVER_TASK_STACK_SIZE;
 
 	// Increase uri handlers
-	config.max_uri_handlers = 20;
+	config.max_uri_handlers = HTTP_SERVER_MAX_URI_HANDLERS;
 
 	// Increase the timeout limits
 	config.recv_wait_timeout = 10;
 	config.send_wait_timeout = 10;
 
-	ESP_LOGI(TAG,
-			 "http_server_configure: Starting server on port: '%d' with task priority: '%d'",
-			 config.server_port,
-			 config.task_priority);
+	// Purge least recently used and idle sockets, track per socket statistics
+	http_conn_configure(&config);
+
+#if CONFIG_HTTP_SERVER_WEBFS
+	// Static files are served by one "/*" handler, exact URIs still match as before
+	config.uri_match_fn = httpd_uri_match_wildcard;
+
+	// Without an image the server still runs and offers the upload page
+	webfs_mount();
+#endif
 
 	// Start the httpd server
-	if (httpd_start(&http_server_handle, &config) == ESP_OK)
+	if (http_server_start_httpd(&config) == ESP_OK)
 	{
 		ESP_LOGI(TAG, "http_server_configure: Registering URI handlers");
 
+		http_server_uri_count = 0;
+		if (!g_metrics_registered)
+		{
+			metrics_register_collector(http_server_metrics_collector, NULL);
+			g_metrics_registered = true;
+		}
+
+#if !CONFIG_HTTP_SERVER_WEBFS
 		// register query handler
 		httpd_uri_t jquery_js = {
 			.uri = "/jquery-3.3.1.min.js",
 			.method = HTTP_GET,
 			.handler = http_server_jquery_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &jquery_js);
+		http_server_register_uri_handler(&jquery_js);
 
 		// register index.html handler
 		httpd_uri_t index_html = {
@@ -581,7 +1198,7 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_GET,
 			.handler = http_server_index_html_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &index_html);
+		http_server_register_uri_handler(&index_html);
 
 		// register app.css handler
 		httpd_uri_t app_css = {
@@ -589,7 +1206,7 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_GET,
 			.handler = http_server_app_css_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &app_css);
+		http_server_register_uri_handler(&app_css);
 
 		// register app.js handler
 		httpd_uri_t app_js = {
@@ -597,7 +1214,7 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_GET,
 			.handler = http_server_app_js_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &app_js);
+		http_server_register_uri_handler(&app_js);
 
 		// register favicon.ico handler
 		httpd_uri_t favicon_ico = {
@@ -605,7 +1222,9 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_GET,
 			.handler = http_server_favicon_ico_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &favicon_ico);
+		http_server_register_uri_handler(&favicon_ico);
+
+#endif
 
 		// Register the ADC value handler
 		httpd_uri_t adc_value = {
@@ -613,14 +1232,38 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_GET,
 			.handler = http_server_adc_value_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &adc_value);
+		http_server_register_uri_handler(&adc_value);
 
 		httpd_uri_t ntp_value = {
 			.uri = "/ntp_value",
 			.method = HTTP_GET,
 			.handler = http_server_ntp_value_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &ntp_value);
+		http_server_register_uri_handler(&ntp_value);
+
+		// Register the aggregated telemetry handler
+		httpd_uri_t telemetry = {
+			.uri = "/telemetry",
+			.method = HTTP_GET,
+			.handler = http_server_telemetry_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&telemetry);
+
+		// register OTAupdate handler
+		httpd_uri_t OTA_update = {
+			.uri = "/OTAupdate",
+			.method = HTTP_POST,
+			.handler = http_server_OTA_update_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&OTA_update);
+
+		// register OTAstatus handler
+		httpd_uri_t OTA_status = {
+			.uri = "/OTAstatus",
+			.method = HTTP_POST,
+			.handler = http_server_OTA_status_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&OTA_status);
 
 		// Register the Range value handler
 		httpd_uri_t temp_range = {
@@ -628,7 +1271,7 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_POST,
 			.handler = http_server_temp_range_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &temp_range);
+		http_server_register_uri_handler(&temp_range);
 
 		// register wifiConnect.json handler
 		httpd_uri_t wifi_connect_json = {
@@ -636,7 +1279,7 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_POST,
 			.handler = http_server_wifi_connect_json_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &wifi_connect_json);
+		http_server_register_uri_handler(&wifi_connect_json);
 
 		// register wifiConnectStatus.json handler
 		httpd_uri_t wifi_connect_status_json = {
@@ -644,7 +1287,54 @@ static httpd_handle_t http_server_configure(void)
 			.method = HTTP_POST,
 			.handler = http_server_wifi_connect_status_json_handler,
 			.user_ctx = NULL};
-		httpd_register_uri_handler(http_server_handle, &wifi_connect_status_json);
+		http_server_register_uri_handler(&wifi_connect_status_json);
+
+		// register metrics handler
+		httpd_uri_t metrics = {
+			.uri = "/metrics",
+			.method = HTTP_GET,
+			.handler = http_server_metrics_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&metrics);
+
+		// register http_stats handler
+		httpd_uri_t http_stats = {
+			.uri = "/http_stats",
+			.method = HTTP_GET,
+			.handler = http_server_http_stats_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&http_stats);
+
+		// register connections handler
+		httpd_uri_t connections = {
+			.uri = "/connections",
+			.method = HTTP_GET,
+			.handler = http_server_connections_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&connections);
+
+#if CONFIG_HTTP_SERVER_WEBFS
+		// register the www partition update handler
+		httpd_uri_t www_update = {
+			.uri = "/WWWupdate",
+			.method = HTTP_POST,
+			.handler = http_server_webfs_update_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&www_update);
+
+		// Static files last, the wildcard would shadow every GET registered after it
+		httpd_uri_t webfs_files = {
+			.uri = "/*",
+			.method = HTTP_GET,
+			.handler = http_server_webfs_handler,
+			.user_ctx = NULL};
+		http_server_register_uri_handler(&webfs_files);
+#endif
+
+		// Export the server's own task to the metrics
+		metrics_register_task(xTaskGetHandle("httpd"));
+
+		http_conn_start(http_server_handle);
 
 		return http_server_handle;
 	}
@@ -664,12 +1354,19 @@ void http_server_stop(void)
 {
 	if (http_server_handle)
 	{
+		metrics_unregister_task(xTaskGetHandle("httpd"));
+#if CONFIG_HTTP_SERVER_HTTPS
+		httpd_ssl_stop(http_server_handle);
+#else
 		httpd_stop(http_server_handle);
+#endif
+		http_conn_stop();
 		ESP_LOGI(TAG, "http_server_stop: stopping HTTP server");
 		http_server_handle = NULL;
 	}
 	if (task_http_server_monitor)
 	{
+		metrics_unregister_task(task_http_server_monitor);
 		vTaskDelete(task_http_server_monitor);
 		ESP_LOGI(TAG, "http_server_stop: stopping HTTP server monitor");
 		task_http_server_monitor = NULL;
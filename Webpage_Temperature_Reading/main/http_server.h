@@ -12,6 +12,37 @@
 #define OTA_UPDATE_SUCCESSFUL 1
 #define OTA_UPDATE_FAILED -1
 
+// Number of URI handlers the server can register
+#define HTTP_SERVER_MAX_URI_HANDLERS 20
+
+// First histogram bucket bounds: 2^7 = 128 us for handler latency, 2^6 = 64 bytes for response size
+#define HTTP_SERVER_LATENCY_HISTOGRAM_SHIFT 7
+#define HTTP_SERVER_BYTES_HISTOGRAM_SHIFT 6
+
+// Size of the label buffer used when exporting per URI metrics
+#define HTTP_SERVER_LABELS_MAX_LEN 64
+
+// Size of the /telemetry response buffer
+#define HTTP_SERVER_TELEMETRY_MAX_LEN 320
+
+// Size of the /wifiConnectStatus response buffer
+#define HTTP_SERVER_STATUS_MAX_LEN 64
+
+// OTA upload receive buffer, lives on the httpd task stack
+#define HTTP_SERVER_OTA_RECV_BUF_LEN 2048
+
+// Size of the Content-Type header buffer (carries the multipart boundary)
+#define HTTP_SERVER_OTA_CONTENT_TYPE_LEN 128
+
+// Size of the /OTAstatus response buffer
+#define HTTP_SERVER_OTA_STATUS_MAX_LEN 256
+
+// Largest /tempRange.json body, room for LED_RULES_MAX_ZONES zones
+#define HTTP_SERVER_TEMP_RANGE_MAX_BODY_LEN 1024
+
+// JSON tokens for a /tempRange.json body, 7 per zone
+#define HTTP_SERVER_TEMP_RANGE_MAX_JSON_TOKENS 128
+
 /**
  * Connection status for Wifi
  */
@@ -43,27 +74,6 @@ typedef struct http_server_queue_message
 	http_server_message_e msgID;
 } http_server_queue_message_t;
 
-/**
- * Structure for TemperatureValues
- */
-typedef struct TemperatureValues
-{
-	int high_temp_lvalue;
-	int high_temp_uvalue;
-	int medium_temp_lvalue;
-	int medium_temp_uvalue;
-	int low_temp_lvalue;
-	int low_temp_uvalue;
-	int r_value_first_led;
-	int g_value_first_led;
-	int b_value_first_led;
-	int r_value_second_led;
-	int g_value_second_led;
-	int b_value_second_led;
-	int r_value_third_led;
-	int g_value_third_led;
-	int b_value_third_led;
-} TemperatureValues;
 /**
  * Sends a message to the queue
  * @param msgID message ID from the http_server_message_e enum.
@@ -0,0 +1,292 @@
+/*
+ * index_render.c
+ *
+ *  Fills the current readings into index.html so the first response already
+ *  shows them. The template is scanned once for its placeholders, every
+ *  request then copies the text between them and formats a few short values
+ *  into a buffer allocated with the template, and sends it in one piece.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "sys/param.h"
+
+#include "http_request.h"
+#include "http_server.h"
+#include "index_render.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "index_render";
+
+// Temperature range shown with a green dot, same limits as updateTemperature() in app.js
+#define INDEX_RENDER_TEMP_LOW 0
+#define INDEX_RENDER_TEMP_HIGH 30
+
+/**
+ * Placeholders
+ */
+typedef enum index_render_field
+{
+	INDEX_RENDER_FIELD_TEMP = 0,		// <!--#temp--> temperature as shown by app.js
+	INDEX_RENDER_FIELD_DOT,				// <!--#dot--> colour of the temperature dot
+	INDEX_RENDER_FIELD_WIFI,			// <!--#wifi--> WiFi connect status text
+	INDEX_RENDER_FIELD_TIME,			// <!--#time--> local time
+	INDEX_RENDER_FIELD_TIME_DISPLAY,	// <!--#time_display--> shows the time element once there is a time
+	INDEX_RENDER_FIELD_COUNT,
+} index_render_field_e;
+
+static const char *const index_render_field_names[INDEX_RENDER_FIELD_COUNT] = {"temp", "dot", "wifi", "time", "time_display"};
+
+// WiFi connect status texts, same as app.js shows them
+static const char index_render_wifi_connecting[] = "Conectando...";
+static const char index_render_wifi_failed[] = "Failed to Connect. Please check your AP credentials and compatibility";
+static const char index_render_wifi_success[] = "Conexi&oacute;n Exitosa";
+
+// Fixed texts are copied whole, a longer one must grow the slot rather than be cut
+_Static_assert(sizeof(index_render_wifi_connecting) <= INDEX_RENDER_VALUE_MAX_LEN, "status text longer than a slot");
+_Static_assert(sizeof(index_render_wifi_failed) <= INDEX_RENDER_VALUE_MAX_LEN, "status text longer than a slot");
+_Static_assert(sizeof(index_render_wifi_success) <= INDEX_RENDER_VALUE_MAX_LEN, "status text longer than a slot");
+
+/**
+ * Placeholder position in the template
+ */
+typedef struct index_render_slot
+{
+	uint32_t offset;
+	uint16_t len; // Length of the whole marker, skipped in the output
+	uint8_t field;
+} index_render_slot_t;
+
+// Compiled template, only used from the HTTP server task
+static const char *index_render_tmpl = NULL;
+static size_t index_render_tmpl_len;
+static index_render_slot_t index_render_slots[INDEX_RENDER_MAX_SLOTS];
+static int index_render_slot_count;
+static char *index_render_buf = NULL;
+static size_t index_render_buf_len;
+
+/**
+ * Looks up a placeholder name.
+ * @return the field, or -1 if the name is unknown.
+ */
+static int index_render_find_field(const char *name, size_t len)
+{
+	for (int i = 0; i < INDEX_RENDER_FIELD_COUNT; i++)
+	{
+		if (strlen(index_render_field_names[i]) == len && memcmp(index_render_field_names[i], name, len) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Finds the next marker at or after pos.
+ * @return pointer to the marker, NULL if there is none.
+ */
+static const char *index_render_next_marker(const char *pos, const char *end)
+{
+	size_t start_len = strlen(INDEX_RENDER_MARKER_START);
+
+	while (end - pos >= (ptrdiff_t)start_len)
+	{
+		pos = memchr(pos, INDEX_RENDER_MARKER_START[0], end - pos - start_len + 1);
+		if (pos == NULL)
+		{
+			return NULL;
+		}
+		if (memcmp(pos, INDEX_RENDER_MARKER_START, start_len) == 0)
+		{
+			return pos;
+		}
+		pos++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Records the placeholder offsets of a template and sizes the output buffer for it.
+ */
+static esp_err_t index_render_compile(const char *tmpl, size_t len)
+{
+	const char *end = tmpl + len;
+	const char *pos = tmpl;
+	const char *marker;
+	size_t start_len = strlen(INDEX_RENDER_MARKER_START);
+	size_t end_len = strlen(INDEX_RENDER_MARKER_END);
+	size_t buf_len;
+
+	index_render_tmpl = NULL;
+	index_render_slot_count = 0;
+
+	while ((marker = index_render_next_marker(pos, end)) != NULL && index_render_slot_count < INDEX_RENDER_MAX_SLOTS)
+	{
+		const char *name = marker + start_len;
+		const char *close = name;
+		int field;
+
+		while (close + end_len <= end && memcmp(close, INDEX_RENDER_MARKER_END, end_len) != 0)
+		{
+			close++;
+		}
+		if (close + end_len > end)
+		{
+			break;
+		}
+
+		// Other comments starting with '#' are left in the page
+		field = index_render_find_field(name, close - name);
+		if (field >= 0)
+		{
+			index_render_slots[index_render_slot_count].offset = marker - tmpl;
+			index_render_slots[index_render_slot_count].len = close + end_len - marker;
+			index_render_slots[index_render_slot_count].field = field;
+			index_render_slot_count++;
+		}
+		pos = close + end_len;
+	}
+
+	buf_len = len + index_render_slot_count * INDEX_RENDER_VALUE_MAX_LEN;
+	if (index_render_buf == NULL || index_render_buf_len < buf_len)
+	{
+		free(index_render_buf);
+		index_render_buf = malloc(buf_len);
+		if (index_render_buf == NULL)
+		{
+			ESP_LOGE(TAG, "index_render_compile: unable to allocate %u bytes", (unsigned int)buf_len);
+			index_render_buf_len = 0;
+			return ESP_ERR_NO_MEM;
+		}
+		index_render_buf_len = buf_len;
+	}
+
+	index_render_tmpl = tmpl;
+	index_render_tmpl_len = len;
+
+	ESP_LOGI(TAG, "index_render_compile: %d placeholders in %u bytes", index_render_slot_count, (unsigned int)len);
+
+	return ESP_OK;
+}
+
+/**
+ * Formats one value into out, which has room for INDEX_RENDER_VALUE_MAX_LEN
+ * bytes. Fixed texts fit whole, the time string is cut to the slot.
+ * @return number of bytes written, without a NUL.
+ */
+static size_t index_render_format(char *out, index_render_field_e field, const index_render_values_t *values)
+{
+	const char *text = "";
+	int temp = (int)values->temperature;
+	size_t len;
+
+	switch (field)
+	{
+	case INDEX_RENDER_FIELD_TEMP:
+		if (values->has_temperature)
+		{
+			return snprintf(out, INDEX_RENDER_VALUE_MAX_LEN, "%d", temp);
+		}
+		break;
+
+	case INDEX_RENDER_FIELD_DOT:
+		if (!values->has_temperature)
+		{
+			break;
+		}
+		if (temp > INDEX_RENDER_TEMP_HIGH)
+		{
+			text = "red";
+		}
+		else if (temp >= INDEX_RENDER_TEMP_LOW)
+		{
+			text = "green";
+		}
+		else
+		{
+			text = "blue";
+		}
+		break;
+
+	case INDEX_RENDER_FIELD_WIFI:
+		switch (values->wifi_connect_status)
+		{
+		case HTTP_WIFI_STATUS_CONNECTING:
+			text = index_render_wifi_connecting;
+			break;
+		case HTTP_WIFI_STATUS_CONNECT_FAILED:
+			text = index_render_wifi_failed;
+			break;
+		case HTTP_WIFI_STATUS_CONNECT_SUCCESS:
+			text = index_render_wifi_success;
+			break;
+		default:
+			break;
+		}
+		break;
+
+	case INDEX_RENDER_FIELD_TIME:
+		text = values->time;
+		break;
+
+	case INDEX_RENDER_FIELD_TIME_DISPLAY:
+		if (values->time[0] != '\0')
+		{
+			text = "block";
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	// Only the time string can reach the bound, the fixed texts are asserted to fit
+	len = MIN(strlen(text), INDEX_RENDER_VALUE_MAX_LEN);
+	memcpy(out, text, len);
+
+	return len;
+}
+
+esp_err_t index_render_send(httpd_req_t *req, const char *tmpl, size_t len, const index_render_values_t *values)
+{
+	size_t in = 0;
+	size_t out = 0;
+	esp_err_t err;
+
+	// The www image can be replaced at runtime, recompile when the template moved
+	if (tmpl != index_render_tmpl || len != index_render_tmpl_len)
+	{
+		err = index_render_compile(tmpl, len);
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+	}
+
+	for (int i = 0; i < index_render_slot_count; i++)
+	{
+		const index_render_slot_t *slot = &index_render_slots[i];
+		memcpy(index_render_buf + out, tmpl + in, slot->offset - in);
+		out += slot->offset - in;
+		in = slot->offset + slot->len;
+
+		out += index_render_format(index_render_buf + out, slot->field, values);
+	}
+	memcpy(index_render_buf + out, tmpl + in, len - in);
+	out += len - in;
+
+	httpd_resp_set_type(req, "text/html");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+	return http_request_send(req, index_render_buf, out);
+}
+
+void index_render_invalidate(void)
+{
+	index_render_tmpl = NULL;
+}
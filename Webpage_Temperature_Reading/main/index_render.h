@@ -0,0 +1,54 @@
+/*
+ * index_render.h
+ *
+ *  Fills the current readings into index.html so the first response already
+ *  shows them, before app.js has loaded or fetched anything.
+ */
+
+#ifndef MAIN_INDEX_RENDER_H_
+#define MAIN_INDEX_RENDER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_http_server.h"
+
+// Placeholders are HTML comments, e.g. <!--#temp-->, so the page is still valid when sent as is
+#define INDEX_RENDER_MARKER_START "<!--#"
+#define INDEX_RENDER_MARKER_END "-->"
+
+// Placeholders recognised in one template
+#define INDEX_RENDER_MAX_SLOTS 8
+
+// Room reserved in the output buffer for each value, fits the longest fixed
+// text (checked in index_render.c), only the time string is cut to it
+#define INDEX_RENDER_VALUE_MAX_LEN 80
+
+/**
+ * Current readings, formatted into the placeholders
+ */
+typedef struct index_render_values
+{
+	bool has_temperature;
+	double temperature;
+	int wifi_connect_status;
+	const char *time; // Empty until the clock is synchronized
+} index_render_values_t;
+
+/**
+ * Renders the template and sends it as the response. The placeholder offsets
+ * are found on the first call for a template and reused afterwards.
+ * @param req HTTP request.
+ * @param tmpl page template, must stay valid and unchanged while in use.
+ * @param len template length.
+ * @param values readings to fill in.
+ * @return ESP_OK, ESP_ERR_NO_MEM, or the send error.
+ */
+esp_err_t index_render_send(httpd_req_t *req, const char *tmpl, size_t len, const index_render_values_t *values);
+
+/**
+ * Forgets the compiled template, needed when a template is replaced in place (a new www image).
+ */
+void index_render_invalidate(void);
+
+#endif /* MAIN_INDEX_RENDER_H_ */
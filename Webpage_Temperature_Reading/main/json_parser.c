@@ -0,0 +1,607 @@
+/*
+ * json_parser.c
+ *
+ *  In-place JSON tokenizer (jsmn style) and key binding helpers.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "json_parser.h"
+
+/**
+ * Allocates a fresh token from the token pool.
+ */
+static json_token_t *json_parser_alloc_token(json_parser_t *parser, json_token_t *tokens, unsigned int num_tokens)
+{
+	json_token_t *tok;
+
+	if (parser->toknext >= num_tokens)
+	{
+		return NULL;
+	}
+
+	tok = &tokens[parser->toknext++];
+	tok->start = tok->end = -1;
+	tok->size = 0;
+	tok->parent = -1;
+	tok->type = JSON_TYPE_UNDEFINED;
+
+	return tok;
+}
+
+/**
+ * Fills a token with its type and boundaries.
+ */
+static void json_parser_fill_token(json_token_t *token, json_type_e type, int start, int end)
+{
+	token->type = type;
+	token->start = start;
+	token->end = end;
+	token->size = 0;
+}
+
+/**
+ * Parses a primitive value (number, true, false, null).
+ */
+static int json_parser_parse_primitive(json_parser_t *parser, const char *js, size_t len, json_token_t *tokens, unsigned int num_tokens)
+{
+	json_token_t *token;
+	int start = parser->pos;
+
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++)
+	{
+		switch (js[parser->pos])
+		{
+		case '\t':
+		case '\r':
+		case '\n':
+		case ' ':
+		case ',':
+		case ']':
+		case '}':
+			goto found;
+
+		default:
+			break;
+		}
+
+		if (js[parser->pos] < 32 || js[parser->pos] >= 127)
+		{
+			parser->pos = start;
+			return JSON_PARSER_ERROR_INVAL;
+		}
+	}
+
+	// A primitive must be followed by a delimiter, a top level primitive is not a full packet
+	parser->pos = start;
+	return JSON_PARSER_ERROR_PART;
+
+found:
+	token = json_parser_alloc_token(parser, tokens, num_tokens);
+	if (token == NULL)
+	{
+		parser->pos = start;
+		return JSON_PARSER_ERROR_NOMEM;
+	}
+	json_parser_fill_token(token, JSON_TYPE_PRIMITIVE, start, parser->pos);
+	token->parent = parser->toksuper;
+	parser->pos--;
+
+	return 0;
+}
+
+/**
+ * Parses a string, the token boundaries exclude the quotes.
+ */
+static int json_parser_parse_string(json_parser_t *parser, const char *js, size_t len, json_token_t *tokens, unsigned int num_tokens)
+{
+	json_token_t *token;
+	int start = parser->pos;
+
+	// Skip the starting quote
+	parser->pos++;
+
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++)
+	{
+		char c = js[parser->pos];
+
+		if (c == '\"')
+		{
+			token = json_parser_alloc_token(parser, tokens, num_tokens);
+			if (token == NULL)
+			{
+				parser->pos = start;
+				return JSON_PARSER_ERROR_NOMEM;
+			}
+			json_parser_fill_token(token, JSON_TYPE_STRING, start + 1, parser->pos);
+			token->parent = parser->toksuper;
+
+			return 0;
+		}
+
+		if (c == '\\' && parser->pos + 1 < len)
+		{
+			parser->pos++;
+			switch (js[parser->pos])
+			{
+			case '\"':
+			case '/':
+			case '\\':
+			case 'b':
+			case 'f':
+			case 'r':
+			case 'n':
+			case 't':
+				break;
+
+			case 'u':
+				parser->pos++;
+				for (int i = 0; i < 4 && parser->pos < len && js[parser->pos] != '\0'; i++)
+				{
+					char h = js[parser->pos];
+					if (!((h >= '0' && h <= '9') || (h >= 'A' && h <= 'F') || (h >= 'a' && h <= 'f')))
+					{
+						parser->pos = start;
+						return JSON_PARSER_ERROR_INVAL;
+					}
+					parser->pos++;
+				}
+				parser->pos--;
+				break;
+
+			default:
+				parser->pos = start;
+				return JSON_PARSER_ERROR_INVAL;
+			}
+		}
+	}
+
+	parser->pos = start;
+	return JSON_PARSER_ERROR_PART;
+}
+
+void json_parser_init(json_parser_t *parser)
+{
+	parser->pos = 0;
+	parser->toknext = 0;
+	parser->toksuper = -1;
+}
+
+int json_parser_parse(json_parser_t *parser, const char *js, size_t len, json_token_t *tokens, unsigned int num_tokens)
+{
+	int r;
+	int i;
+	json_token_t *token;
+	int count = parser->toknext;
+
+	// Offsets are stored as int16_t
+	if (len > INT16_MAX)
+	{
+		return JSON_PARSER_ERROR_INVAL;
+	}
+
+	for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++)
+	{
+		char c = js[parser->pos];
+		json_type_e type;
+
+		switch (c)
+		{
+		case '{':
+		case '[':
+			count++;
+			token = json_parser_alloc_token(parser, tokens, num_tokens);
+			if (token == NULL)
+			{
+				return JSON_PARSER_ERROR_NOMEM;
+			}
+			if (parser->toksuper != -1)
+			{
+				json_token_t *t = &tokens[parser->toksuper];
+
+				// An object or array can't become a key
+				if (t->type == JSON_TYPE_OBJECT)
+				{
+					return JSON_PARSER_ERROR_INVAL;
+				}
+				t->size++;
+				token->parent = parser->toksuper;
+			}
+			token->type = (c == '{' ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY);
+			token->start = parser->pos;
+			parser->toksuper = parser->toknext - 1;
+			break;
+
+		case '}':
+		case ']':
+			type = (c == '}' ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY);
+			if (parser->toknext < 1)
+			{
+				return JSON_PARSER_ERROR_INVAL;
+			}
+			token = &tokens[parser->toknext - 1];
+			for (;;)
+			{
+				if (token->start != -1 && token->end == -1)
+				{
+					if (token->type != type)
+					{
+						return JSON_PARSER_ERROR_INVAL;
+					}
+					token->end = parser->pos + 1;
+					parser->toksuper = token->parent;
+					break;
+				}
+				if (token->parent == -1)
+				{
+					if (token->type != type || parser->toksuper == -1)
+					{
+						return JSON_PARSER_ERROR_INVAL;
+					}
+					break;
+				}
+				token = &tokens[token->parent];
+			}
+			break;
+
+		case '\"':
+			r = json_parser_parse_string(parser, js, len, tokens, num_tokens);
+			if (r < 0)
+			{
+				return r;
+			}
+			count++;
+			if (parser->toksuper != -1)
+			{
+				tokens[parser->toksuper].size++;
+			}
+			break;
+
+		case '\t':
+		case '\r':
+		case '\n':
+		case ' ':
+			break;
+
+		case ':':
+			parser->toksuper = parser->toknext - 1;
+			break;
+
+		case ',':
+			if (parser->toksuper != -1 &&
+				tokens[parser->toksuper].type != JSON_TYPE_ARRAY &&
+				tokens[parser->toksuper].type != JSON_TYPE_OBJECT)
+			{
+				parser->toksuper = tokens[parser->toksuper].parent;
+			}
+			break;
+
+		case '-':
+		case '0':
+		case '1':
+		case '2':
+		case '3':
+		case '4':
+		case '5':
+		case '6':
+		case '7':
+		case '8':
+		case '9':
+		case 't':
+		case 'f':
+		case 'n':
+			// Primitives are not allowed as keys and a key holds a single value
+			if (parser->toksuper != -1)
+			{
+				const json_token_t *t = &tokens[parser->toksuper];
+				if (t->type == JSON_TYPE_OBJECT || (t->type == JSON_TYPE_STRING && t->size != 0))
+				{
+					return JSON_PARSER_ERROR_INVAL;
+				}
+			}
+			r = json_parser_parse_primitive(parser, js, len, tokens, num_tokens);
+			if (r < 0)
+			{
+				return r;
+			}
+			count++;
+			if (parser->toksuper != -1)
+			{
+				tokens[parser->toksuper].size++;
+			}
+			break;
+
+		default:
+			return JSON_PARSER_ERROR_INVAL;
+		}
+	}
+
+	// Unclosed objects or arrays
+	for (i = parser->toknext - 1; i >= 0; i--)
+	{
+		if (tokens[i].start != -1 && tokens[i].end == -1)
+		{
+			return JSON_PARSER_ERROR_PART;
+		}
+	}
+
+	return count;
+}
+
+int json_parser_skip(const json_token_t *tokens, int num_tokens, int index)
+{
+	int end = tokens[index].end;
+	int i = index + 1;
+
+	while (i < num_tokens && tokens[i].start < end)
+	{
+		i++;
+	}
+
+	return i;
+}
+
+int json_parser_find(const char *js, const json_token_t *tokens, int num_tokens, int object, const char *key)
+{
+	size_t key_len = strlen(key);
+	int i = object + 1;
+
+	if (object < 0 || object >= num_tokens || tokens[object].type != JSON_TYPE_OBJECT)
+	{
+		return -1;
+	}
+
+	for (int k = 0; k < tokens[object].size && i + 1 < num_tokens; k++)
+	{
+		const json_token_t *t = &tokens[i];
+
+		if (t->type == JSON_TYPE_STRING &&
+			(size_t)(t->end - t->start) == key_len &&
+			memcmp(js + t->start, key, key_len) == 0)
+		{
+			return i + 1;
+		}
+
+		// Move past the value to the next key
+		i = json_parser_skip(tokens, num_tokens, i + 1);
+	}
+
+	return -1;
+}
+
+/**
+ * Appends a decimal digit, saturating at INT_MAX.
+ */
+static int json_parser_accumulate(int result, int digit)
+{
+	if (result > (INT_MAX - digit) / 10)
+	{
+		return INT_MAX;
+	}
+
+	return result * 10 + digit;
+}
+
+int json_parser_token_to_fixed(const char *js, const json_token_t *token, int decimals, int *value)
+{
+	const char *p = js + token->start;
+	const char *end = js + token->end;
+	int result = 0;
+	int negative = 0;
+
+	if (token->type != JSON_TYPE_PRIMITIVE && token->type != JSON_TYPE_STRING)
+	{
+		return -1;
+	}
+
+	while (p < end && *p == ' ')
+	{
+		p++;
+	}
+
+	// Empty form fields arrive as "", they used to be converted by atoi() to 0
+	if (p == end && token->type == JSON_TYPE_STRING)
+	{
+		*value = 0;
+		return 0;
+	}
+
+	if (p < end && (*p == '-' || *p == '+'))
+	{
+		negative = (*p == '-');
+		p++;
+	}
+
+	if (p == end || *p < '0' || *p > '9')
+	{
+		return -1;
+	}
+
+	for (; p < end && *p >= '0' && *p <= '9'; p++)
+	{
+		result = json_parser_accumulate(result, *p - '0');
+	}
+
+	// Keep the requested number of fraction digits, missing ones count as 0 and the rest is truncated
+	if (p < end && *p == '.')
+	{
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+		{
+			if (decimals > 0)
+			{
+				result = json_parser_accumulate(result, *p - '0');
+				decimals--;
+			}
+		}
+	}
+	for (; decimals > 0; decimals--)
+	{
+		result = json_parser_accumulate(result, 0);
+	}
+
+	while (p < end && *p == ' ')
+	{
+		p++;
+	}
+
+	if (p != end)
+	{
+		return -1;
+	}
+
+	*value = negative ? -result : result;
+
+	return 0;
+}
+
+int json_parser_token_to_int(const char *js, const json_token_t *token, int *value)
+{
+	return json_parser_token_to_fixed(js, token, 0, value);
+}
+
+/**
+ * Converts a hex digit to its value.
+ */
+static int json_parser_hex_value(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	return c - 'A' + 10;
+}
+
+int json_parser_token_to_str(const char *js, const json_token_t *token, char *buf, size_t size)
+{
+	size_t n = 0;
+
+	if (token->type != JSON_TYPE_STRING || size == 0)
+	{
+		return -1;
+	}
+
+	for (int i = token->start; i < token->end; i++)
+	{
+		char c = js[i];
+		char utf8[3];
+		size_t utf8_len = 1;
+
+		if (c == '\\')
+		{
+			c = js[++i];
+			switch (c)
+			{
+			case 'b':
+				c = '\b';
+				break;
+			case 'f':
+				c = '\f';
+				break;
+			case 'n':
+				c = '\n';
+				break;
+			case 'r':
+				c = '\r';
+				break;
+			case 't':
+				c = '\t';
+				break;
+			case 'u':
+			{
+				unsigned int cp = 0;
+				for (int h = 1; h <= 4; h++)
+				{
+					cp = (cp << 4) | json_parser_hex_value(js[i + h]);
+				}
+				i += 4;
+
+				// Encode the code point (basic multilingual plane only) as UTF-8
+				if (cp < 0x80)
+				{
+					c = (char)cp;
+				}
+				else if (cp < 0x800)
+				{
+					utf8[0] = (char)(0xC0 | (cp >> 6));
+					utf8[1] = (char)(0x80 | (cp & 0x3F));
+					utf8_len = 2;
+				}
+				else
+				{
+					utf8[0] = (char)(0xE0 | (cp >> 12));
+					utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+					utf8[2] = (char)(0x80 | (cp & 0x3F));
+					utf8_len = 3;
+				}
+				break;
+			}
+			default:
+				// '"', '\\' and '/' map to themselves
+				break;
+			}
+		}
+
+		if (n + utf8_len >= size)
+		{
+			return -1;
+		}
+
+		if (utf8_len == 1)
+		{
+			buf[n++] = c;
+		}
+		else
+		{
+			memcpy(&buf[n], utf8, utf8_len);
+			n += utf8_len;
+		}
+	}
+
+	buf[n] = '\0';
+
+	return 0;
+}
+
+int json_parser_bind(const char *js, const json_token_t *tokens, int num_tokens, int object, const json_field_t *fields, size_t num_fields)
+{
+	int bound = 0;
+
+	for (size_t f = 0; f < num_fields; f++)
+	{
+		int value = json_parser_find(js, tokens, num_tokens, object, fields[f].key);
+		int r;
+
+		if (value < 0)
+		{
+			continue;
+		}
+
+		switch (fields[f].type)
+		{
+		case JSON_FIELD_INT:
+			r = json_parser_token_to_int(js, &tokens[value], (int *)fields[f].dest);
+			break;
+
+		case JSON_FIELD_STRING:
+			r = json_parser_token_to_str(js, &tokens[value], (char *)fields[f].dest, fields[f].size);
+			break;
+
+		default:
+			r = -1;
+			break;
+		}
+
+		if (r < 0)
+		{
+			return -1;
+		}
+		bound++;
+	}
+
+	return bound;
+}
@@ -0,0 +1,144 @@
+/*
+ * json_parser.h
+ *
+ *  In-place JSON tokenizer (jsmn style) and key binding helpers.
+ *  Tokens only store offsets into the caller's buffer so parsing needs no heap.
+ */
+
+#ifndef MAIN_JSON_PARSER_H_
+#define MAIN_JSON_PARSER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Error codes returned by json_parser_parse
+#define JSON_PARSER_ERROR_NOMEM -1 // Not enough tokens were provided
+#define JSON_PARSER_ERROR_INVAL -2 // Invalid character inside the JSON string
+#define JSON_PARSER_ERROR_PART -3  // The string is not a full JSON packet
+
+/**
+ * JSON token types
+ */
+typedef enum json_type
+{
+	JSON_TYPE_UNDEFINED = 0,
+	JSON_TYPE_OBJECT,
+	JSON_TYPE_ARRAY,
+	JSON_TYPE_STRING,
+	JSON_TYPE_PRIMITIVE,
+} json_type_e;
+
+/**
+ * JSON token, start/end are offsets into the parsed buffer (end is exclusive).
+ * size is the number of direct children (for objects: number of keys).
+ */
+typedef struct json_token
+{
+	int16_t start;
+	int16_t end;
+	int16_t size;
+	int16_t parent;
+	uint8_t type;
+} json_token_t;
+
+/**
+ * Tokenizer state
+ */
+typedef struct json_parser
+{
+	unsigned int pos;
+	unsigned int toknext;
+	int toksuper;
+} json_parser_t;
+
+/**
+ * Field types for json_parser_bind
+ */
+typedef enum json_field_type
+{
+	JSON_FIELD_INT = 0,
+	JSON_FIELD_STRING,
+} json_field_type_e;
+
+/**
+ * Binds a top level object key to a destination variable.
+ * For JSON_FIELD_INT dest is an int *, numbers sent as strings ("12") are accepted as well.
+ * For JSON_FIELD_STRING dest is a char buffer of size bytes, the value is unescaped and NUL terminated.
+ */
+typedef struct json_field
+{
+	const char *key;
+	json_field_type_e type;
+	void *dest;
+	size_t size;
+} json_field_t;
+
+/**
+ * Resets the tokenizer state.
+ * @param parser tokenizer to initialize.
+ */
+void json_parser_init(json_parser_t *parser);
+
+/**
+ * Tokenizes a JSON string without copying it.
+ * @param parser initialized tokenizer.
+ * @param js JSON string.
+ * @param len length of js.
+ * @param tokens token array to fill.
+ * @param num_tokens number of entries in tokens.
+ * @return number of tokens used, or one of the JSON_PARSER_ERROR_* codes.
+ */
+int json_parser_parse(json_parser_t *parser, const char *js, size_t len, json_token_t *tokens, unsigned int num_tokens);
+
+/**
+ * Returns the index of the token following the subtree rooted at index.
+ * @param tokens token array.
+ * @param num_tokens number of valid tokens.
+ * @param index index of the subtree root.
+ * @return index of the next sibling (or num_tokens).
+ */
+int json_parser_skip(const json_token_t *tokens, int num_tokens, int index);
+
+/**
+ * Looks up the value of a key inside an object token.
+ * @param js JSON string.
+ * @param tokens token array.
+ * @param num_tokens number of valid tokens.
+ * @param object index of the object token.
+ * @param key key to search for.
+ * @return index of the value token, or -1 if not found.
+ */
+int json_parser_find(const char *js, const json_token_t *tokens, int num_tokens, int object, const char *key);
+
+/**
+ * Converts a primitive or string token to an int.
+ * @return 0 on success, -1 if the token is not a number.
+ */
+int json_parser_token_to_int(const char *js, const json_token_t *token, int *value);
+
+/**
+ * Converts a primitive or string token to a fixed point int, e.g. "21.57" with 1 decimal gives 215.
+ * @param decimals number of fraction digits kept, further digits are truncated.
+ * @return 0 on success, -1 if the token is not a number.
+ */
+int json_parser_token_to_fixed(const char *js, const json_token_t *token, int decimals, int *value);
+
+/**
+ * Copies a string token into buf, resolving escape sequences.
+ * @return 0 on success, -1 if the token is not a string or does not fit.
+ */
+int json_parser_token_to_str(const char *js, const json_token_t *token, char *buf, size_t size);
+
+/**
+ * Binds the keys of the object token at index object into the fields' destinations.
+ * @param js JSON string.
+ * @param tokens token array.
+ * @param num_tokens number of valid tokens.
+ * @param object index of the object token (0 for the root object).
+ * @param fields field descriptions.
+ * @param num_fields number of entries in fields.
+ * @return number of fields bound, or -1 if a present field has the wrong type.
+ */
+int json_parser_bind(const char *js, const json_token_t *tokens, int num_tokens, int object, const json_field_t *fields, size_t num_fields);
+
+#endif /* MAIN_JSON_PARSER_H_ */
@@ -0,0 +1,303 @@
+/*
+ * led_config.c
+ *
+ *  Applies and persists the LED rule configuration. The configuration as
+ *  posted (zones or gradient points, not the compiled tables) is packed into a
+ *  small versioned blob, at most LED_CONFIG_BLOB_MAX_LEN bytes. Posts only
+ *  refresh the pending blob and restart a one-shot timer, the timer callback
+ *  writes the blob to NVS unless it matches what is already stored.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+
+#include "led_config.h"
+#include "rgb_led.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "led_config";
+
+// Blob layout: version, kind, count, 1 reserved byte, transition_ms (16 bit), default color (24 bit),
+// then per zone low, high (16 bit each) and color (24 bit), or per point temp (16 bit) and color.
+// Multi byte fields are little endian.
+#define LED_CONFIG_HEADER_LEN 9
+#define LED_CONFIG_ZONE_LEN 7
+#define LED_CONFIG_POINT_LEN 5
+#define LED_CONFIG_BLOB_MAX_LEN (LED_CONFIG_HEADER_LEN + LED_RULES_MAX_ZONES * LED_CONFIG_ZONE_LEN)
+
+// Compiled rules, kept off the caller's stack
+static led_rules_t led_config_rules;
+
+// Transition time of the configuration shown
+static uint16_t led_config_transition_ms = RGB_LED_TRANSITION_MS;
+
+// Blob waiting for the save timer, guarded by led_config_lock
+static uint8_t led_config_pending[LED_CONFIG_BLOB_MAX_LEN];
+static size_t led_config_pending_len = 0;
+static portMUX_TYPE led_config_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Blob last read from or written to NVS, only used by the timer callback and restore
+static uint8_t led_config_saved[LED_CONFIG_BLOB_MAX_LEN];
+static size_t led_config_saved_len = 0;
+
+// Coalesces the saves of rapid posts
+static esp_timer_handle_t led_config_save_timer = NULL;
+
+static void led_config_put16(uint8_t *p, uint32_t value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+}
+
+static void led_config_put24(uint8_t *p, uint32_t value)
+{
+	led_config_put16(p, value);
+	p[2] = (value >> 16) & 0xFF;
+}
+
+static uint32_t led_config_get16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t led_config_get24(const uint8_t *p)
+{
+	return led_config_get16(p) | (p[2] << 16);
+}
+
+/**
+ * Packs a configuration into a blob.
+ * @return blob length.
+ */
+static size_t led_config_pack(const led_config_t *config, uint8_t *blob)
+{
+	uint8_t *p = blob + LED_CONFIG_HEADER_LEN;
+
+	blob[0] = LED_CONFIG_VERSION;
+	blob[1] = config->kind;
+	blob[2] = config->count;
+	blob[3] = 0;
+	led_config_put16(blob + 4, config->transition_ms);
+	led_config_put24(blob + 6, config->default_rgb);
+
+	for (int i = 0; i < config->count; i++)
+	{
+		if (config->kind == LED_CONFIG_GRADIENT)
+		{
+			led_config_put16(p, (uint16_t)config->points[i].temp);
+			led_config_put24(p + 2, config->points[i].rgb);
+			p += LED_CONFIG_POINT_LEN;
+		}
+		else
+		{
+			led_config_put16(p, (uint16_t)config->zones[i].low);
+			led_config_put16(p + 2, (uint16_t)config->zones[i].high);
+			led_config_put24(p + 4, config->zones[i].rgb);
+			p += LED_CONFIG_ZONE_LEN;
+		}
+	}
+
+	return p - blob;
+}
+
+/**
+ * Unpacks a blob, checking its version and length.
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION or ESP_ERR_INVALID_SIZE.
+ */
+static esp_err_t led_config_unpack(const uint8_t *blob, size_t len, led_config_t *config)
+{
+	const uint8_t *p = blob + LED_CONFIG_HEADER_LEN;
+	size_t entry_len;
+
+	if (len < LED_CONFIG_HEADER_LEN || blob[0] != LED_CONFIG_VERSION)
+	{
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	config->kind = blob[1];
+	config->count = blob[2];
+	config->transition_ms = led_config_get16(blob + 4);
+	config->default_rgb = led_config_get24(blob + 6);
+
+	entry_len = (config->kind == LED_CONFIG_GRADIENT) ? LED_CONFIG_POINT_LEN : LED_CONFIG_ZONE_LEN;
+	if (config->kind > LED_CONFIG_GRADIENT ||
+		config->count > ((config->kind == LED_CONFIG_GRADIENT) ? LED_RULES_MAX_POINTS : LED_RULES_MAX_ZONES) ||
+		len != LED_CONFIG_HEADER_LEN + config->count * entry_len)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	for (int i = 0; i < config->count; i++, p += entry_len)
+	{
+		if (config->kind == LED_CONFIG_GRADIENT)
+		{
+			config->points[i].temp = (int16_t)led_config_get16(p);
+			config->points[i].rgb = led_config_get24(p + 2);
+		}
+		else
+		{
+			config->zones[i].low = (int16_t)led_config_get16(p);
+			config->zones[i].high = (int16_t)led_config_get16(p + 2);
+			config->zones[i].rgb = led_config_get24(p + 4);
+		}
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Compiles a configuration and hands it to the LED controller task.
+ * Resolves LED_CONFIG_TRANSITION_UNCHANGED in place.
+ */
+static esp_err_t led_config_publish(led_config_t *config)
+{
+	esp_err_t err;
+
+	if (config->kind == LED_CONFIG_GRADIENT)
+	{
+		err = led_rules_compile_gradient(&led_config_rules, config->points, config->count);
+	}
+	else
+	{
+		err = led_rules_compile(&led_config_rules, config->zones, config->count, config->default_rgb);
+	}
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	if (config->transition_ms == LED_CONFIG_TRANSITION_UNCHANGED)
+	{
+		config->transition_ms = led_config_transition_ms;
+	}
+	led_config_transition_ms = config->transition_ms;
+
+	rgb_led_set_transition_time(config->transition_ms);
+	rgb_led_set_rules(&led_config_rules);
+
+	return ESP_OK;
+}
+
+/**
+ * Save timer callback, runs in the esp_timer task. Writes the pending blob
+ * unless NVS already holds the same bytes.
+ */
+static void led_config_save_timer_callback(void *arg)
+{
+	uint8_t blob[LED_CONFIG_BLOB_MAX_LEN];
+	size_t len;
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	portENTER_CRITICAL(&led_config_lock);
+	len = led_config_pending_len;
+	memcpy(blob, led_config_pending, len);
+	portEXIT_CRITICAL(&led_config_lock);
+
+	if (len == led_config_saved_len && memcmp(blob, led_config_saved, len) == 0)
+	{
+		ESP_LOGI(TAG, "led_config_save: unchanged, not written");
+		return;
+	}
+
+	err = nvs_open(LED_CONFIG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_set_blob(handle, LED_CONFIG_NVS_KEY, blob, len);
+		if (err == ESP_OK)
+		{
+			err = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "led_config_save: unable to write (%s)", esp_err_to_name(err));
+		return;
+	}
+
+	memcpy(led_config_saved, blob, len);
+	led_config_saved_len = len;
+
+	ESP_LOGI(TAG, "led_config_save: %u bytes written", (unsigned int)len);
+}
+
+esp_err_t led_config_apply(const led_config_t *config)
+{
+	// Kept off the caller's stack, only called from the HTTP server task
+	static led_config_t applied;
+	uint8_t blob[LED_CONFIG_BLOB_MAX_LEN];
+	size_t len;
+	esp_err_t err;
+
+	applied = *config;
+	err = led_config_publish(&applied);
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	len = led_config_pack(&applied, blob);
+	portENTER_CRITICAL(&led_config_lock);
+	memcpy(led_config_pending, blob, len);
+	led_config_pending_len = len;
+	portEXIT_CRITICAL(&led_config_lock);
+
+	if (led_config_save_timer == NULL)
+	{
+		const esp_timer_create_args_t save_timer_args = {
+			.callback = &led_config_save_timer_callback,
+			.arg = NULL,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "led_config_save"};
+
+		ESP_ERROR_CHECK(esp_timer_create(&save_timer_args, &led_config_save_timer));
+	}
+
+	// Every post restarts the window, only the last configuration is written
+	esp_timer_stop(led_config_save_timer);
+	ESP_ERROR_CHECK(esp_timer_start_once(led_config_save_timer, (uint64_t)LED_CONFIG_SAVE_DELAY_MS * 1000));
+
+	return ESP_OK;
+}
+
+esp_err_t led_config_restore(void)
+{
+	static led_config_t config;
+	nvs_handle_t handle;
+	size_t len = sizeof(led_config_saved);
+	esp_err_t err;
+
+	err = nvs_open(LED_CONFIG_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_get_blob(handle, LED_CONFIG_NVS_KEY, led_config_saved, &len);
+		nvs_close(handle);
+	}
+	if (err != ESP_OK)
+	{
+		// A namespace that was never written does not exist yet either
+		ESP_LOGI(TAG, "led_config_restore: no saved configuration (%s)", esp_err_to_name(err));
+		return err;
+	}
+	led_config_saved_len = len;
+
+	err = led_config_unpack(led_config_saved, len, &config);
+	if (err == ESP_OK)
+	{
+		err = led_config_publish(&config);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGW(TAG, "led_config_restore: saved configuration ignored (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	ESP_LOGI(TAG, "led_config_restore: %d %s restored", config.count, (config.kind == LED_CONFIG_GRADIENT) ? "gradient points" : "zones");
+
+	return ESP_OK;
+}
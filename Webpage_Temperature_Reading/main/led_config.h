@@ -0,0 +1,71 @@
+/*
+ * led_config.h
+ *
+ *  LED rule configuration posted to /tempRange.json, kept in NVS so the LED
+ *  shows the right colors again straight after a reboot.
+ */
+
+#ifndef MAIN_LED_CONFIG_H_
+#define MAIN_LED_CONFIG_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "led_rules.h"
+
+// NVS location of the configuration blob
+#define LED_CONFIG_NVS_NAMESPACE "led_config"
+#define LED_CONFIG_NVS_KEY "rules"
+
+// Blob layout version, a blob of another version is ignored
+#define LED_CONFIG_VERSION 1
+
+// Changes within this window after a post are written to flash once
+#define LED_CONFIG_SAVE_DELAY_MS 2000
+
+// transition_ms value keeping the transition time of the previous configuration
+#define LED_CONFIG_TRANSITION_UNCHANGED 0xFFFF
+
+/**
+ * Kind of rules in a configuration
+ */
+typedef enum led_config_kind
+{
+	LED_CONFIG_ZONES = 0,
+	LED_CONFIG_GRADIENT,
+} led_config_kind_e;
+
+/**
+ * Configuration as posted, compiled into led_rules_t when applied
+ */
+typedef struct led_config
+{
+	uint8_t kind;
+	uint8_t count; // Number of zones or points
+	uint16_t transition_ms; // Or LED_CONFIG_TRANSITION_UNCHANGED
+	uint32_t default_rgb; // Color outside every zone, unused for a gradient
+	union
+	{
+		led_rules_zone_t zones[LED_RULES_MAX_ZONES];
+		led_rules_point_t points[LED_RULES_MAX_POINTS];
+	};
+} led_config_t;
+
+/**
+ * Compiles a configuration, hands it to the LED controller task and schedules
+ * it to be saved. Saves are delayed by LED_CONFIG_SAVE_DELAY_MS and a save of
+ * an unchanged configuration is skipped, so rapid posts cost one flash write.
+ * Not reentrant, called from the HTTP server task.
+ * @param config configuration to apply.
+ * @return ESP_OK, or the led_rules error for an invalid configuration, which is then neither applied nor saved.
+ */
+esp_err_t led_config_apply(const led_config_t *config);
+
+/**
+ * Loads the saved configuration and hands it to the LED controller task.
+ * Called from app_main before WiFi and the HTTP server start.
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND if nothing was saved, or an error for an unreadable blob.
+ */
+esp_err_t led_config_restore(void);
+
+#endif /* MAIN_LED_CONFIG_H_ */
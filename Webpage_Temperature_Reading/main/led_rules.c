@@ -0,0 +1,351 @@
+/*
+ * led_rules.c
+ *
+ *  Temperature to color rules for the RGB LED. The zones, which may overlap,
+ *  are flattened into a table of non-overlapping intervals sorted by their
+ *  start, so a sample costs one binary search however many zones there are,
+ *  and nothing at all while it stays in the interval of the previous one.
+ *  A gradient is interpolated once into a color table, a sample then costs
+ *  one multiply and one table read.
+ */
+
+#include "led_rules.h"
+
+/**
+ * Color of the first zone containing t, or the default color.
+ */
+static uint32_t led_rules_color_at(const led_rules_zone_t *zones, int num_zones, int t, uint32_t default_rgb)
+{
+	for (int i = 0; i < num_zones; i++)
+	{
+		if (t >= zones[i].low && t <= zones[i].high)
+		{
+			return zones[i].rgb;
+		}
+	}
+
+	return default_rgb;
+}
+
+esp_err_t led_rules_compile(led_rules_t *rules, const led_rules_zone_t *zones, int num_zones, uint32_t default_rgb)
+{
+	int16_t bounds[LED_RULES_MAX_ENTRIES];
+	int num_bounds = 0;
+
+	if (num_zones < 0 || num_zones > LED_RULES_MAX_ZONES)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	// The covering zone can only change where a zone starts or just after one ends
+	bounds[num_bounds++] = INT16_MIN;
+	for (int i = 0; i < num_zones; i++)
+	{
+		if (zones[i].low > zones[i].high)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		bounds[num_bounds++] = zones[i].low;
+		if (zones[i].high < INT16_MAX)
+		{
+			bounds[num_bounds++] = zones[i].high + 1;
+		}
+	}
+
+	// Insertion sort, there are at most LED_RULES_MAX_ENTRIES bounds
+	for (int i = 1; i < num_bounds; i++)
+	{
+		int16_t b = bounds[i];
+		int j = i;
+
+		while (j > 0 && bounds[j - 1] > b)
+		{
+			bounds[j] = bounds[j - 1];
+			j--;
+		}
+		bounds[j] = b;
+	}
+
+	rules->count = 0;
+	rules->gradient = false;
+	for (int i = 0; i < num_bounds; i++)
+	{
+		uint32_t rgb;
+
+		if (i > 0 && bounds[i] == bounds[i - 1])
+		{
+			continue;
+		}
+
+		// Merged with the previous entry when the color does not change
+		rgb = led_rules_color_at(zones, num_zones, bounds[i], default_rgb);
+		if (rules->count > 0 && rules->rgb[rules->count - 1] == rgb)
+		{
+			continue;
+		}
+
+		rules->start[rules->count] = bounds[i];
+		rules->rgb[rules->count] = rgb;
+		rules->count++;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t led_rules_compile_gradient(led_rules_t *rules, const led_rules_point_t *points, int num_points)
+{
+	int span;
+	int segment = 0;
+
+	if (num_points < 1 || num_points > LED_RULES_MAX_POINTS)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	for (int i = 1; i < num_points; i++)
+	{
+		if (points[i].temp <= points[i - 1].temp)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+	}
+
+	span = points[num_points - 1].temp - points[0].temp;
+	rules->count = LED_RULES_GRADIENT_STEPS;
+	rules->gradient = true;
+	rules->gradient_low = points[0].temp;
+	rules->gradient_scale = (span > 0) ? ((uint32_t)(LED_RULES_GRADIENT_STEPS - 1) << 16) / span : 0;
+
+	// Positions are scaled by LED_RULES_GRADIENT_STEPS - 1, entry i sits at i * span
+	for (int i = 0; i < LED_RULES_GRADIENT_STEPS; i++)
+	{
+		int32_t t = i * span;
+		int32_t t0, t1;
+		uint32_t rgb = 0;
+
+		if (num_points == 1)
+		{
+			rules->gradient_rgb[i] = points[0].rgb;
+			continue;
+		}
+
+		while (segment + 2 < num_points && t >= (points[segment + 1].temp - points[0].temp) * (LED_RULES_GRADIENT_STEPS - 1))
+		{
+			segment++;
+		}
+		t0 = (points[segment].temp - points[0].temp) * (LED_RULES_GRADIENT_STEPS - 1);
+		t1 = (points[segment + 1].temp - points[0].temp) * (LED_RULES_GRADIENT_STEPS - 1);
+
+		for (int shift = 16; shift >= 0; shift -= 8)
+		{
+			int32_t c0 = (points[segment].rgb >> shift) & 0xFF;
+			int32_t c1 = (points[segment + 1].rgb >> shift) & 0xFF;
+
+			rgb |= (uint32_t)(((int64_t)c0 * (t1 - t) + (int64_t)c1 * (t - t0) + (t1 - t0) / 2) / (t1 - t0)) << shift;
+		}
+		rules->gradient_rgb[i] = rgb;
+	}
+
+	return ESP_OK;
+}
+
+int led_rules_search(const led_rules_t *rules, int16_t tenths, int hint)
+{
+	int low = 0;
+	int count = rules->count;
+
+	if (rules->gradient)
+	{
+		int32_t offset = tenths - rules->gradient_low;
+		uint32_t index;
+
+		if (offset <= 0)
+		{
+			return 0;
+		}
+		// Rounded to the nearest entry
+		index = ((uint64_t)offset * rules->gradient_scale + 0x8000) >> 16;
+
+		return (index < LED_RULES_GRADIENT_STEPS) ? index : LED_RULES_GRADIENT_STEPS - 1;
+	}
+
+	// Still inside the entry of the previous sample
+	if (hint >= 0 && hint < rules->count && tenths >= rules->start[hint] &&
+		(hint + 1 == rules->count || tenths < rules->start[hint + 1]))
+	{
+		return hint;
+	}
+
+	// Last entry starting at or below tenths, entry 0 starts at INT16_MIN. The
+	// range halves without a data dependent branch, a select instead of a jump.
+	while (count > 1)
+	{
+		int half = count / 2;
+
+		low = (rules->start[low + half] <= tenths) ? low + half : low;
+		count -= half;
+	}
+
+	return low;
+}
+
+int16_t led_rules_to_tenths(double celsius)
+{
+	// The small offset keeps 21.3 from becoming 212 through 212.99999...
+	double tenths = celsius * 10 + 1e-6;
+	int t;
+
+	// Written so NaN ends up at 0 without a call to isnan()
+	if (!(tenths > INT16_MIN))
+	{
+		return (tenths != tenths) ? 0 : INT16_MIN;
+	}
+	if (tenths >= INT16_MAX)
+	{
+		return INT16_MAX;
+	}
+
+	// Truncation rounds negative values up, floor() without the libm call
+	t = (int)tenths;
+	if (t > tenths)
+	{
+		t--;
+	}
+
+	return t;
+}
+
+/**
+ * Converts a hex digit to its value.
+ * @return 0 - 15, or -1 if c is not a hex digit.
+ */
+static int led_rules_hex(char c)
+{
+	if (c >= '0' && c <= '9')
+	{
+		return c - '0';
+	}
+	if (c >= 'a' && c <= 'f')
+	{
+		return c - 'a' + 10;
+	}
+	if (c >= 'A' && c <= 'F')
+	{
+		return c - 'A' + 10;
+	}
+
+	return -1;
+}
+
+esp_err_t led_rules_parse_color(const char *js, const json_token_t *token, uint32_t *rgb)
+{
+	const char *p = js + token->start;
+	uint32_t value = 0;
+
+	if (token->type != JSON_TYPE_STRING || token->end - token->start != 7 || p[0] != '#')
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	for (int i = 1; i < 7; i++)
+	{
+		int digit = led_rules_hex(p[i]);
+
+		if (digit < 0)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+		value = (value << 4) | digit;
+	}
+	*rgb = value;
+
+	return ESP_OK;
+}
+
+/**
+ * Reads a temperature in degrees into tenths, saturating at the int16 range.
+ */
+static esp_err_t led_rules_parse_bound(const char *js, const json_token_t *tokens, int num_tokens, int object, const char *key, int16_t *tenths)
+{
+	int index = json_parser_find(js, tokens, num_tokens, object, key);
+	int value;
+
+	if (index < 0 || json_parser_token_to_fixed(js, &tokens[index], 1, &value) < 0)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	*tenths = (value < INT16_MIN) ? INT16_MIN : (value > INT16_MAX) ? INT16_MAX : value;
+
+	return ESP_OK;
+}
+
+esp_err_t led_rules_parse_points(const char *js, const json_token_t *tokens, int num_tokens, int array, led_rules_point_t *points, int *num_points)
+{
+	int index = array + 1;
+
+	if (array < 0 || array >= num_tokens || tokens[array].type != JSON_TYPE_ARRAY)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (tokens[array].size > LED_RULES_MAX_POINTS)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	for (int i = 0; i < tokens[array].size; i++)
+	{
+		int color;
+
+		if (index >= num_tokens || led_rules_parse_bound(js, tokens, num_tokens, index, "temp", &points[i].temp) != ESP_OK)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		color = json_parser_find(js, tokens, num_tokens, index, "color");
+		if (color < 0 || led_rules_parse_color(js, &tokens[color], &points[i].rgb) != ESP_OK)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		index = json_parser_skip(tokens, num_tokens, index);
+	}
+	*num_points = tokens[array].size;
+
+	return ESP_OK;
+}
+
+esp_err_t led_rules_parse_zones(const char *js, const json_token_t *tokens, int num_tokens, int array, led_rules_zone_t *zones, int *num_zones)
+{
+	int index = array + 1;
+
+	if (array < 0 || array >= num_tokens || tokens[array].type != JSON_TYPE_ARRAY)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if (tokens[array].size > LED_RULES_MAX_ZONES)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	for (int i = 0; i < tokens[array].size; i++)
+	{
+		int color;
+
+		if (index >= num_tokens ||
+			led_rules_parse_bound(js, tokens, num_tokens, index, "low", &zones[i].low) != ESP_OK ||
+			led_rules_parse_bound(js, tokens, num_tokens, index, "high", &zones[i].high) != ESP_OK)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		color = json_parser_find(js, tokens, num_tokens, index, "color");
+		if (color < 0 || led_rules_parse_color(js, &tokens[color], &zones[i].rgb) != ESP_OK)
+		{
+			return ESP_ERR_INVALID_ARG;
+		}
+
+		index = json_parser_skip(tokens, num_tokens, index);
+	}
+	*num_zones = tokens[array].size;
+
+	return ESP_OK;
+}
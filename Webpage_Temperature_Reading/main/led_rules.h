@@ -0,0 +1,170 @@
+/*
+ * led_rules.h
+ *
+ *  Temperature to color rules for the RGB LED. Any number of zones, up to
+ *  LED_RULES_MAX_ZONES, is compiled into one sorted interval table that is
+ *  searched per sample. A gradient through up to LED_RULES_MAX_POINTS control
+ *  points is compiled into a color table indexed by temperature.
+ */
+
+#ifndef MAIN_LED_RULES_H_
+#define MAIN_LED_RULES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "json_parser.h"
+
+// Zones accepted by led_rules_compile
+#define LED_RULES_MAX_ZONES 16
+
+// Every zone adds at most two boundaries to the table, plus the entry starting at INT16_MIN
+#define LED_RULES_MAX_ENTRIES (2 * LED_RULES_MAX_ZONES + 1)
+
+// Tables up to this many entries are scanned instead of binary searched,
+// the three zone page compiles to four
+#define LED_RULES_LINEAR_MAX_ENTRIES 4
+
+// Control points accepted by led_rules_compile_gradient
+#define LED_RULES_MAX_POINTS 16
+
+// Colors in a compiled gradient, spread evenly from the first to the last control point
+#define LED_RULES_GRADIENT_STEPS 128
+
+// Packed 0xRRGGBB color
+#define LED_RULES_RGB(r, g, b) ((((uint32_t)(r) & 0xFF) << 16) | (((uint32_t)(g) & 0xFF) << 8) | ((uint32_t)(b) & 0xFF))
+
+/**
+ * Temperature zone, bounds in tenths of a degree Celsius, both inclusive
+ */
+typedef struct led_rules_zone
+{
+	int16_t low;
+	int16_t high;
+	uint32_t rgb;
+} led_rules_zone_t;
+
+/**
+ * Gradient control point, temperature in tenths of a degree Celsius
+ */
+typedef struct led_rules_point
+{
+	int16_t temp;
+	uint32_t rgb;
+} led_rules_point_t;
+
+/**
+ * Compiled rules, either zones or a gradient.
+ * Zones: entry i covers start[i] up to start[i + 1] - 1, the last one up to
+ * INT16_MAX. start[0] is INT16_MIN, so every temperature has an entry.
+ * Gradient: entry i is gradient_rgb[i], temperatures below the first control
+ * point use entry 0 and above the last one the last entry.
+ */
+typedef struct led_rules
+{
+	uint8_t count;
+	bool gradient;
+	int16_t start[LED_RULES_MAX_ENTRIES];
+	uint32_t rgb[LED_RULES_MAX_ENTRIES];
+	int16_t gradient_low;	 // Temperature of entry 0
+	uint32_t gradient_scale; // Entries per tenth of a degree, 16.16 fixed point
+	uint32_t gradient_rgb[LED_RULES_GRADIENT_STEPS];
+} led_rules_t;
+
+/**
+ * Builds the interval table. Where zones overlap the one listed first wins,
+ * temperatures outside every zone get the default color. Neighbouring
+ * entries with the same color are merged.
+ * @param rules compiled table.
+ * @param zones zones in priority order.
+ * @param num_zones number of zones, at most LED_RULES_MAX_ZONES.
+ * @param default_rgb color outside every zone.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for too many zones or a zone with low > high.
+ */
+esp_err_t led_rules_compile(led_rules_t *rules, const led_rules_zone_t *zones, int num_zones, uint32_t default_rgb);
+
+/**
+ * Builds the gradient table, interpolating each channel linearly between neighbouring control points.
+ * @param rules compiled table.
+ * @param points control points, temperatures strictly ascending.
+ * @param num_points number of points, 1 to LED_RULES_MAX_POINTS.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG for a bad number of points or unsorted temperatures.
+ */
+esp_err_t led_rules_compile_gradient(led_rules_t *rules, const led_rules_point_t *points, int num_points);
+
+/**
+ * Finds the entry of a temperature in a gradient or a table larger than
+ * LED_RULES_LINEAR_MAX_ENTRIES, use led_rules_lookup instead.
+ */
+int led_rules_search(const led_rules_t *rules, int16_t tenths, int hint);
+
+/**
+ * Finds the entry of a temperature. A table of up to LED_RULES_LINEAR_MAX_ENTRIES
+ * is checked inline without a branch on the data. In a larger one
+ * the entry found for the previous sample is checked first, it is still the
+ * right one unless the zone changed. A gradient entry is computed directly.
+ * @param rules compiled table.
+ * @param tenths temperature in tenths of a degree.
+ * @param hint entry of the previous sample, -1 if there is none.
+ * @return entry index, see led_rules_color.
+ */
+static inline int led_rules_lookup(const led_rules_t *rules, int16_t tenths, int hint)
+{
+	int count = rules->count;
+
+	if (rules->gradient || count > LED_RULES_LINEAR_MAX_ENTRIES)
+	{
+		return led_rules_search(rules, tenths, hint);
+	}
+
+	// The entry is the number of later starts at or below tenths, the starts are
+	// sorted. Written out for LED_RULES_LINEAR_MAX_ENTRIES of 4.
+	return ((count > 1) & (rules->start[1] <= tenths)) + ((count > 2) & (rules->start[2] <= tenths)) +
+		   ((count > 3) & (rules->start[3] <= tenths));
+}
+
+/**
+ * Color of an entry returned by led_rules_lookup.
+ */
+static inline uint32_t led_rules_color(const led_rules_t *rules, int entry)
+{
+	return rules->gradient ? rules->gradient_rgb[entry] : rules->rgb[entry];
+}
+
+/**
+ * Converts degrees Celsius to tenths, rounding down and saturating at the int16 range.
+ */
+int16_t led_rules_to_tenths(double celsius);
+
+/**
+ * Reads a JSON array of zones, e.g. [{"low":20.5,"high":30,"color":"#ff8000"}].
+ * @param js JSON text.
+ * @param tokens parsed tokens.
+ * @param num_tokens number of tokens.
+ * @param array index of the array token.
+ * @param zones destination, LED_RULES_MAX_ZONES entries.
+ * @param num_zones number of zones read.
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE for too many zones or ESP_ERR_INVALID_ARG for a malformed zone.
+ */
+esp_err_t led_rules_parse_zones(const char *js, const json_token_t *tokens, int num_tokens, int array, led_rules_zone_t *zones, int *num_zones);
+
+/**
+ * Reads a JSON array of gradient control points, e.g. [{"temp":10,"color":"#0000ff"},{"temp":35,"color":"#ff0000"}].
+ * @param js JSON text.
+ * @param tokens parsed tokens.
+ * @param num_tokens number of tokens.
+ * @param array index of the array token.
+ * @param points destination, LED_RULES_MAX_POINTS entries.
+ * @param num_points number of points read.
+ * @return ESP_OK, ESP_ERR_INVALID_SIZE for too many points or ESP_ERR_INVALID_ARG for a malformed point.
+ */
+esp_err_t led_rules_parse_points(const char *js, const json_token_t *tokens, int num_tokens, int array, led_rules_point_t *points, int *num_points);
+
+/**
+ * Reads a "#rrggbb" color.
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if the token is not such a string.
+ */
+esp_err_t led_rules_parse_color(const char *js, const json_token_t *token, uint32_t *rgb);
+
+#endif /* MAIN_LED_RULES_H_ */
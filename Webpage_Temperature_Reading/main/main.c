@@ -7,9 +7,13 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "http_server.h"
+#include "led_config.h"
 
 #include "wifi_app.h"
 #include "adc.h"
+#include "rgb_led.h"
+#include "sdkconfig.h"
+#include "strip_display.h"
 
 static const char *TAG = "Main";
 
@@ -24,9 +28,20 @@ void app_main(void)
 	}
 	ESP_ERROR_CHECK(ret);
 
+	// Start the LED controller before anything asks for a status color
+	rgb_led_task_start();
+
+	// Saved temperature colors, so the LED is right before WiFi is even up
+	led_config_restore();
+
+	// Config ADC, the first samples are colored as soon as they arrive
+	adc_config();
+
 	// Start Wifi
 	wifi_app_start();
 
-	// Config ADC
-	adc_config();
+#if CONFIG_STRIP_DISPLAY_ENABLE
+	// Renders from the ADC history, so after adc_config
+	strip_display_start();
+#endif
 }
@@ -0,0 +1,288 @@
+/*
+ * metrics.c
+ *
+ *  Registry of counters and gauges exported in the Prometheus text format.
+ *  Modules register their variables once at start up, every scrape streams the
+ *  current values through a small fixed buffer.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_system.h"
+
+#include "http_request.h"
+#include "metrics.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "metrics";
+
+/**
+ * Registered metric
+ */
+typedef struct metrics_entry
+{
+	const char *name;
+	const char *help;
+	metrics_type_e type;
+	const volatile uint32_t *value;
+	metrics_read_fn_t fn;
+	void *arg;
+} metrics_entry_t;
+
+/**
+ * Registered collector
+ */
+typedef struct metrics_collector
+{
+	metrics_collector_fn_t fn;
+	void *arg;
+} metrics_collector_t;
+
+// Registry, entries are only appended so scrapes can walk it without locking
+static metrics_entry_t metrics_entries[METRICS_MAX_ENTRIES];
+static metrics_collector_t metrics_collectors[METRICS_MAX_COLLECTORS];
+static TaskHandle_t metrics_tasks[METRICS_MAX_TASKS];
+static volatile int metrics_entry_count;
+static volatile int metrics_collector_count;
+static volatile int metrics_task_count;
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const metrics_type_names[] = {"counter", "gauge", "histogram"};
+
+/**
+ * Appends an entry to the registry.
+ */
+static esp_err_t metrics_add_entry(const metrics_entry_t *entry)
+{
+	esp_err_t ret = ESP_OK;
+
+	portENTER_CRITICAL(&metrics_lock);
+	if (metrics_entry_count < METRICS_MAX_ENTRIES)
+	{
+		metrics_entries[metrics_entry_count] = *entry;
+		metrics_entry_count++;
+	}
+	else
+	{
+		ret = ESP_ERR_NO_MEM;
+	}
+	portEXIT_CRITICAL(&metrics_lock);
+
+	if (ret != ESP_OK)
+	{
+		ESP_LOGE(TAG, "metrics_add_entry: registry full, dropping %s", entry->name);
+	}
+
+	return ret;
+}
+
+esp_err_t metrics_register(const char *name, const char *help, metrics_type_e type, const volatile uint32_t *value)
+{
+	metrics_entry_t entry = {
+		.name = name,
+		.help = help,
+		.type = type,
+		.value = value,
+	};
+
+	return metrics_add_entry(&entry);
+}
+
+esp_err_t metrics_register_fn(const char *name, const char *help, metrics_type_e type, metrics_read_fn_t fn, void *arg)
+{
+	metrics_entry_t entry = {
+		.name = name,
+		.help = help,
+		.type = type,
+		.fn = fn,
+		.arg = arg,
+	};
+
+	return metrics_add_entry(&entry);
+}
+
+esp_err_t metrics_register_collector(metrics_collector_fn_t fn, void *arg)
+{
+	esp_err_t ret = ESP_OK;
+
+	portENTER_CRITICAL(&metrics_lock);
+	if (metrics_collector_count < METRICS_MAX_COLLECTORS)
+	{
+		metrics_collectors[metrics_collector_count].fn = fn;
+		metrics_collectors[metrics_collector_count].arg = arg;
+		metrics_collector_count++;
+	}
+	else
+	{
+		ret = ESP_ERR_NO_MEM;
+	}
+	portEXIT_CRITICAL(&metrics_lock);
+
+	return ret;
+}
+
+esp_err_t metrics_register_task(TaskHandle_t task)
+{
+	esp_err_t ret = ESP_OK;
+
+	if (task == NULL)
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	portENTER_CRITICAL(&metrics_lock);
+	if (metrics_task_count < METRICS_MAX_TASKS)
+	{
+		metrics_tasks[metrics_task_count] = task;
+		metrics_task_count++;
+	}
+	else
+	{
+		ret = ESP_ERR_NO_MEM;
+	}
+	portEXIT_CRITICAL(&metrics_lock);
+
+	return ret;
+}
+
+void metrics_unregister_task(TaskHandle_t task)
+{
+	portENTER_CRITICAL(&metrics_lock);
+	for (int i = 0; i < metrics_task_count; i++)
+	{
+		if (metrics_tasks[i] == task)
+		{
+			metrics_tasks[i] = metrics_tasks[metrics_task_count - 1];
+			metrics_task_count--;
+			break;
+		}
+	}
+	portEXIT_CRITICAL(&metrics_lock);
+}
+
+/**
+ * Sends the buffered output as one chunk.
+ */
+static void metrics_writer_flush(metrics_writer_t *writer)
+{
+	if (writer->len > 0 && writer->err == ESP_OK)
+	{
+		writer->err = http_request_send_chunk(writer->req, writer->buf, writer->len);
+	}
+	writer->len = 0;
+}
+
+void metrics_writer_printf(metrics_writer_t *writer, const char *fmt, ...)
+{
+	va_list args;
+	int n;
+
+	if (writer->err != ESP_OK)
+	{
+		return;
+	}
+
+	va_start(args, fmt);
+	n = vsnprintf(writer->buf + writer->len, sizeof(writer->buf) - writer->len, fmt, args);
+	va_end(args);
+
+	// Did not fit, flush and format again into the empty buffer
+	if (n >= (int)(sizeof(writer->buf) - writer->len))
+	{
+		metrics_writer_flush(writer);
+
+		va_start(args, fmt);
+		n = vsnprintf(writer->buf, sizeof(writer->buf), fmt, args);
+		va_end(args);
+
+		if (n >= (int)sizeof(writer->buf))
+		{
+			ESP_LOGW(TAG, "metrics_writer_printf: line truncated");
+			n = sizeof(writer->buf) - 1;
+		}
+	}
+
+	if (n > 0)
+	{
+		writer->len += n;
+	}
+}
+
+void metrics_writer_family(metrics_writer_t *writer, const char *name, const char *help, metrics_type_e type)
+{
+	metrics_writer_printf(writer, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, metrics_type_names[type]);
+}
+
+esp_err_t metrics_writer_end(metrics_writer_t *writer)
+{
+	metrics_writer_flush(writer);
+	if (writer->err == ESP_OK)
+	{
+		// Terminate the chunked response
+		writer->err = http_request_send_chunk(writer->req, NULL, 0);
+	}
+
+	return writer->err;
+}
+
+/**
+ * Heap and task stack gauges, always exported.
+ */
+static void metrics_write_system(metrics_writer_t *writer)
+{
+	metrics_writer_family(writer, "heap_free_bytes", "Current free heap", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "heap_free_bytes %lu\n", (unsigned long)esp_get_free_heap_size());
+
+	metrics_writer_family(writer, "heap_min_free_bytes", "Lowest free heap since boot", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "heap_min_free_bytes %lu\n", (unsigned long)esp_get_minimum_free_heap_size());
+
+	TaskHandle_t tasks[METRICS_MAX_TASKS];
+	int count;
+
+	// Tasks can be unregistered, work on a copy of the list
+	portENTER_CRITICAL(&metrics_lock);
+	count = metrics_task_count;
+	memcpy(tasks, metrics_tasks, sizeof(tasks));
+	portEXIT_CRITICAL(&metrics_lock);
+
+	metrics_writer_family(writer, "task_stack_high_water_bytes", "Minimum free stack space ever seen per task", METRICS_TYPE_GAUGE);
+	for (int i = 0; i < count; i++)
+	{
+		metrics_writer_printf(writer, "task_stack_high_water_bytes{task=\"%s\"} %u\n",
+							  pcTaskGetName(tasks[i]), (unsigned int)uxTaskGetStackHighWaterMark(tasks[i]));
+	}
+}
+
+esp_err_t metrics_write(httpd_req_t *req)
+{
+	metrics_writer_t writer = {
+		.req = req,
+		.len = 0,
+		.err = ESP_OK,
+	};
+	int count = metrics_entry_count;
+
+	httpd_resp_set_type(req, "text/plain; version=0.0.4");
+
+	metrics_write_system(&writer);
+
+	for (int i = 0; i < count; i++)
+	{
+		const metrics_entry_t *entry = &metrics_entries[i];
+		uint32_t value = entry->fn ? entry->fn(entry->arg) : *entry->value;
+
+		metrics_writer_family(&writer, entry->name, entry->help, entry->type);
+		metrics_writer_printf(&writer, "%s %lu\n", entry->name, (unsigned long)value);
+	}
+
+	count = metrics_collector_count;
+	for (int i = 0; i < count; i++)
+	{
+		metrics_collectors[i].fn(&writer, metrics_collectors[i].arg);
+	}
+
+	return metrics_writer_end(&writer);
+}
@@ -0,0 +1,119 @@
+/*
+ * metrics.h
+ *
+ *  Registry of counters and gauges exported in the Prometheus text format.
+ */
+
+#ifndef MAIN_METRICS_H_
+#define MAIN_METRICS_H_
+
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Registry sizes
+#define METRICS_MAX_ENTRIES 24
+#define METRICS_MAX_COLLECTORS 4
+#define METRICS_MAX_TASKS 8
+
+// Size of the streaming writer buffer, flushed as one HTTP chunk when full
+#define METRICS_WRITER_BUF_LEN 256
+
+/**
+ * Prometheus metric types
+ */
+typedef enum metrics_type
+{
+	METRICS_TYPE_COUNTER = 0,
+	METRICS_TYPE_GAUGE,
+	METRICS_TYPE_HISTOGRAM,
+} metrics_type_e;
+
+/**
+ * Streaming writer, output is buffered and sent with httpd_resp_send_chunk
+ */
+typedef struct metrics_writer
+{
+	httpd_req_t *req;
+	size_t len;
+	esp_err_t err;
+	char buf[METRICS_WRITER_BUF_LEN];
+} metrics_writer_t;
+
+/**
+ * Reads the current value of a metric.
+ */
+typedef uint32_t (*metrics_read_fn_t)(void *arg);
+
+/**
+ * Writes a family of metrics (e.g. one sample per label set) to the writer.
+ */
+typedef void (*metrics_collector_fn_t)(metrics_writer_t *writer, void *arg);
+
+/**
+ * Registers a metric backed by a 32 bit variable owned by the caller.
+ * @param name metric name.
+ * @param help one line description.
+ * @param type counter or gauge.
+ * @param value variable to export, read without locking.
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the registry is full.
+ */
+esp_err_t metrics_register(const char *name, const char *help, metrics_type_e type, const volatile uint32_t *value);
+
+/**
+ * Registers a metric whose value is computed on every scrape.
+ * @param name metric name.
+ * @param help one line description.
+ * @param type counter or gauge.
+ * @param fn function returning the value.
+ * @param arg argument passed to fn.
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the registry is full.
+ */
+esp_err_t metrics_register_fn(const char *name, const char *help, metrics_type_e type, metrics_read_fn_t fn, void *arg);
+
+/**
+ * Registers a collector that writes its own metric families (used for labelled metrics).
+ * @param fn collector function.
+ * @param arg argument passed to fn.
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the registry is full.
+ */
+esp_err_t metrics_register_collector(metrics_collector_fn_t fn, void *arg);
+
+/**
+ * Adds a task to the stack high water mark gauge.
+ * @param task task handle.
+ * @return ESP_OK, or ESP_ERR_NO_MEM if the registry is full.
+ */
+esp_err_t metrics_register_task(TaskHandle_t task);
+
+/**
+ * Removes a task from the stack high water mark gauge, must be called before the task is deleted.
+ * @param task task handle.
+ */
+void metrics_unregister_task(TaskHandle_t task);
+
+/**
+ * Writes the HELP and TYPE lines of a metric family.
+ */
+void metrics_writer_family(metrics_writer_t *writer, const char *name, const char *help, metrics_type_e type);
+
+/**
+ * Writes printf style text to the writer, flushing the buffer as needed.
+ */
+void metrics_writer_printf(metrics_writer_t *writer, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Flushes the writer and terminates the chunked response.
+ * @param writer metrics writer.
+ * @return ESP_OK on success, the first send error otherwise.
+ */
+esp_err_t metrics_writer_end(metrics_writer_t *writer);
+
+/**
+ * Streams every registered metric as the response to req.
+ * @param req HTTP request.
+ * @return ESP_OK on success, the send error otherwise.
+ */
+esp_err_t metrics_write(httpd_req_t *req);
+
+#endif /* MAIN_METRICS_H_ */
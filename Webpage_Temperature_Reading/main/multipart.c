@@ -0,0 +1,215 @@
+/*
+ * multipart.c
+ *
+ *  Streaming multipart/form-data parser.
+ */
+
+#include <string.h>
+#include <strings.h>
+
+#include "multipart.h"
+
+esp_err_t multipart_get_boundary(const char *content_type, char *boundary)
+{
+	const char *p;
+	size_t len;
+
+	if (strncasecmp(content_type, "multipart/form-data", strlen("multipart/form-data")) != 0)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	p = strstr(content_type, "boundary=");
+	if (p == NULL)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+	p += strlen("boundary=");
+
+	// The boundary may be quoted
+	if (*p == '"')
+	{
+		p++;
+		len = strcspn(p, "\"");
+	}
+	else
+	{
+		len = strcspn(p, "; \t");
+	}
+
+	if (len == 0 || len > MULTIPART_MAX_BOUNDARY_LEN)
+	{
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	memcpy(boundary, p, len);
+	boundary[len] = '\0';
+
+	return ESP_OK;
+}
+
+void multipart_parser_init(multipart_parser_t *parser, const char *boundary, multipart_data_cb_t on_data, void *ctx)
+{
+	memset(parser, 0x00, sizeof(multipart_parser_t));
+
+	parser->delimiter_len = strlen("\r\n--") + strlen(boundary);
+	strcpy(parser->delimiter, "\r\n--");
+	strcat(parser->delimiter, boundary);
+
+	// The first boundary is not preceded by a line break, start matching after it
+	parser->state = MULTIPART_STATE_PREAMBLE;
+	parser->match = 2;
+	parser->on_data = on_data;
+	parser->ctx = ctx;
+}
+
+/**
+ * Emits a run of body bytes.
+ */
+static esp_err_t multipart_parser_emit(multipart_parser_t *parser, const uint8_t *data, size_t len)
+{
+	if (len == 0)
+	{
+		return ESP_OK;
+	}
+
+	return parser->on_data(parser->ctx, data, len);
+}
+
+esp_err_t multipart_parser_feed(multipart_parser_t *parser, const uint8_t *data, size_t len)
+{
+	size_t i = 0;
+	esp_err_t err;
+
+	while (i < len)
+	{
+		uint8_t c = data[i];
+
+		switch (parser->state)
+		{
+		case MULTIPART_STATE_PREAMBLE:
+			// Skip everything up to the first delimiter
+			if (c == (uint8_t)parser->delimiter[parser->match])
+			{
+				parser->match++;
+			}
+			else
+			{
+				parser->match = (c == '\r') ? 1 : 0;
+			}
+			if (parser->match == parser->delimiter_len)
+			{
+				parser->match = 0;
+				parser->after_boundary = 0;
+				parser->state = MULTIPART_STATE_AFTER_BOUNDARY;
+			}
+			i++;
+			break;
+
+		case MULTIPART_STATE_AFTER_BOUNDARY:
+			// "\r\n" starts the part headers, "--" closes the body
+			if (parser->after_boundary == 0)
+			{
+				parser->after_boundary = c;
+			}
+			else if (parser->after_boundary == '\r' && c == '\n')
+			{
+				parser->header_match = 2;
+				parser->state = MULTIPART_STATE_HEADERS;
+			}
+			else if (parser->after_boundary == '-' && c == '-')
+			{
+				parser->state = MULTIPART_STATE_DONE;
+			}
+			else
+			{
+				parser->state = MULTIPART_STATE_ERROR;
+				return ESP_ERR_INVALID_RESPONSE;
+			}
+			i++;
+			break;
+
+		case MULTIPART_STATE_HEADERS:
+			// Headers end with an empty line
+			if (c == "\r\n\r\n"[parser->header_match])
+			{
+				parser->header_match++;
+			}
+			else
+			{
+				parser->header_match = (c == '\r') ? 1 : 0;
+			}
+			if (parser->header_match == 4)
+			{
+				parser->match = 0;
+				parser->state = MULTIPART_STATE_DATA;
+			}
+			i++;
+			break;
+
+		case MULTIPART_STATE_DATA:
+		{
+			// Hand out runs of bytes that can't be the start of the delimiter
+			size_t start = i;
+
+			while (i < len && parser->match == 0 && data[i] != '\r')
+			{
+				i++;
+			}
+			err = multipart_parser_emit(parser, data + start, i - start);
+			if (err != ESP_OK)
+			{
+				return err;
+			}
+
+			// Match the delimiter, it can be split across chunks
+			while (i < len)
+			{
+				c = data[i];
+
+				if (c == (uint8_t)parser->delimiter[parser->match])
+				{
+					parser->match++;
+					i++;
+					if (parser->match == parser->delimiter_len)
+					{
+						// Only the first part is of interest
+						parser->state = MULTIPART_STATE_DONE;
+						return ESP_OK;
+					}
+					continue;
+				}
+
+				if (parser->match == 0)
+				{
+					break;
+				}
+
+				// False alarm, the held bytes were data. They equal the delimiter prefix.
+				err = multipart_parser_emit(parser, (const uint8_t *)parser->delimiter, parser->match);
+				parser->match = 0;
+				if (err != ESP_OK)
+				{
+					return err;
+				}
+				// Re-examine c, it may start a new delimiter
+			}
+			break;
+		}
+
+		case MULTIPART_STATE_DONE:
+			// Trailing parts and epilogue are ignored
+			return ESP_OK;
+
+		default:
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+	}
+
+	return ESP_OK;
+}
+
+bool multipart_parser_is_done(const multipart_parser_t *parser)
+{
+	return parser->state == MULTIPART_STATE_DONE;
+}
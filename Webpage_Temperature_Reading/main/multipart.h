@@ -0,0 +1,82 @@
+/*
+ * multipart.h
+ *
+ *  Streaming multipart/form-data parser, hands the body of the first part to a
+ *  callback as it arrives without buffering it.
+ */
+
+#ifndef MAIN_MULTIPART_H_
+#define MAIN_MULTIPART_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// RFC 2046 limits boundaries to 70 characters
+#define MULTIPART_MAX_BOUNDARY_LEN 70
+
+/**
+ * Receives a run of body bytes of the first part.
+ * @return ESP_OK to continue parsing, any other value aborts.
+ */
+typedef esp_err_t (*multipart_data_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Parser states
+ */
+typedef enum multipart_state
+{
+	MULTIPART_STATE_PREAMBLE = 0,
+	MULTIPART_STATE_AFTER_BOUNDARY,
+	MULTIPART_STATE_HEADERS,
+	MULTIPART_STATE_DATA,
+	MULTIPART_STATE_DONE,
+	MULTIPART_STATE_ERROR,
+} multipart_state_e;
+
+/**
+ * Parser context
+ */
+typedef struct multipart_parser
+{
+	multipart_state_e state;
+	char delimiter[MULTIPART_MAX_BOUNDARY_LEN + 5]; // "\r\n--" + boundary
+	size_t delimiter_len;
+	size_t match;		 // Delimiter bytes matched so far
+	size_t header_match; // Bytes of "\r\n\r\n" matched so far
+	char after_boundary; // First byte seen after a delimiter
+	multipart_data_cb_t on_data;
+	void *ctx;
+} multipart_parser_t;
+
+/**
+ * Extracts the boundary parameter from a Content-Type header value.
+ * @param content_type header value, e.g. multipart/form-data; boundary=xyz
+ * @param boundary destination buffer of at least MULTIPART_MAX_BOUNDARY_LEN + 1 bytes.
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND if the header is not multipart or has no usable boundary.
+ */
+esp_err_t multipart_get_boundary(const char *content_type, char *boundary);
+
+/**
+ * Initializes the parser.
+ * @param parser parser context.
+ * @param boundary boundary from the Content-Type header.
+ * @param on_data callback receiving the first part's body.
+ * @param ctx argument passed to on_data.
+ */
+void multipart_parser_init(multipart_parser_t *parser, const char *boundary, multipart_data_cb_t on_data, void *ctx);
+
+/**
+ * Feeds a chunk of the request body to the parser.
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE on malformed input, or the callback's error.
+ */
+esp_err_t multipart_parser_feed(multipart_parser_t *parser, const uint8_t *data, size_t len);
+
+/**
+ * Tells whether the first part's body has been completely delivered.
+ */
+bool multipart_parser_is_done(const multipart_parser_t *parser);
+
+#endif /* MAIN_MULTIPART_H_ */
@@ -12,10 +12,12 @@
 #include "esp_sleep.h"
 #include "nvs_flash.h"
 #include "freertos/queue.h"
+#include "ntp.h"
 
 static const char *TAG = "NTP";
 
-QueueHandle_t NTP_QUEUE;
+// Time of the last successful synchronization, 0 until the clock has been set
+static time_t g_sync_time = 0;
 
 static void initialize_sntp(void)
 {
@@ -26,7 +28,6 @@ static void initialize_sntp(void)
     sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
 #endif
     esp_sntp_init();
-    NTP_QUEUE = xQueueCreate(10, 64);
 }
 
 static void obtain_time(void)
@@ -69,7 +70,32 @@ void ntp_wifi_connection_received(void)
     setenv("TZ", "America/Bogota", 1);
     tzset();
     localtime_r(&now, &timeinfo);
+    if (timeinfo.tm_year >= (2016 - 1900))
+    {
+        g_sync_time = now;
+    }
     strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
-    xQueueSend(NTP_QUEUE, &strftime_buf, portMAX_DELAY);
     ESP_LOGI(TAG, "The current date/time in Colombia is: %s", strftime_buf);
 }
+
+time_t ntp_get_sync_time(void)
+{
+    return g_sync_time;
+}
+
+bool ntp_get_time_str(char *buf, size_t len)
+{
+    time_t now;
+    struct tm timeinfo;
+
+    if (g_sync_time == 0)
+    {
+        return false;
+    }
+
+    time(&now);
+    localtime_r(&now, &timeinfo);
+    strftime(buf, len, "%c", &timeinfo);
+
+    return true;
+}
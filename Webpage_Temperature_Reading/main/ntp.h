@@ -1,9 +1,27 @@
 #ifndef MAIN_NTP_H
 #define MAIN_NTP_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
 static void obtain_time(void);
 static void initialize_sntp(void);
 
 void ntp_wifi_connection_received(void);
 
+/**
+ * Gets the time of the last NTP synchronization.
+ * @return sync time, or 0 if the clock has not been set yet.
+ */
+time_t ntp_get_sync_time(void);
+
+/**
+ * Formats the current local time without blocking.
+ * @param buf destination buffer.
+ * @param len size of buf.
+ * @return true if the clock is synchronized and buf was written.
+ */
+bool ntp_get_time_str(char *buf, size_t len);
+
 #endif /* MAIN_RGB_LED_H_ */
\ No newline at end of file
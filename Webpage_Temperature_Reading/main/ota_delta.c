@@ -0,0 +1,316 @@
+/*
+ * ota_delta.c
+ *
+ *  Streaming application of delta OTA patches. The old image is read back
+ *  from the running partition with esp_partition_read, so only the patch
+ *  travels over the network and only a small read buffer is held in RAM.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ota_delta.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "ota_delta";
+
+#define OTA_DELTA_HEADER_LEN (4 + 4 + 32 + 4)
+#define OTA_DELTA_OP_COPY 0x01
+#define OTA_DELTA_OP_ADD 0x02
+#define OTA_DELTA_OP_INSERT 0x03
+
+/**
+ * Patcher states
+ */
+typedef enum ota_delta_state
+{
+	OTA_DELTA_STATE_HEADER = 0,
+	OTA_DELTA_STATE_OP,
+	OTA_DELTA_STATE_ADD,
+	OTA_DELTA_STATE_INSERT,
+	OTA_DELTA_STATE_DONE,
+} ota_delta_state_e;
+
+// Patcher state, only allocated while a delta update is running
+static uint8_t *delta_buf = NULL;
+static const esp_partition_t *delta_base;
+static ota_delta_output_cb_t delta_output;
+static void *delta_ctx;
+static ota_delta_state_e delta_state;
+static uint8_t delta_hdr[OTA_DELTA_HEADER_LEN]; // Header or op being assembled
+static size_t delta_hdr_len;
+static uint32_t delta_base_size;
+static uint32_t delta_target_size;
+static uint32_t delta_produced;
+static uint32_t delta_offset;	 // Base offset of the running op
+static uint32_t delta_remaining; // Bytes left in the running op
+
+static uint32_t ota_delta_get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/**
+ * Hands target bytes to the output, checking they stay within the announced size.
+ */
+static esp_err_t ota_delta_emit(const uint8_t *data, size_t len)
+{
+	if (delta_produced + len > delta_target_size)
+	{
+		ESP_LOGE(TAG, "ota_delta_emit: patch produces more than %lu bytes", (unsigned long)delta_target_size);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+	delta_produced += len;
+
+	return delta_output(delta_ctx, data, len);
+}
+
+/**
+ * Checks that the op's base range lies within the base image.
+ */
+static esp_err_t ota_delta_check_range(uint32_t offset, uint32_t len)
+{
+	if (offset > delta_base_size || len > delta_base_size - offset)
+	{
+		ESP_LOGE(TAG, "ota_delta_check_range: base range 0x%lx+%lu out of bounds", (unsigned long)offset, (unsigned long)len);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * Validates the header and that the running image is the patch's base.
+ */
+static esp_err_t ota_delta_check_header(void)
+{
+	uint8_t sha256[32];
+	esp_err_t err;
+
+	if (memcmp(delta_hdr, "ESPD", 4) != 0)
+	{
+		ESP_LOGE(TAG, "ota_delta_check_header: bad magic");
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+
+	delta_base_size = ota_delta_get_u32(delta_hdr + 4);
+	delta_target_size = ota_delta_get_u32(delta_hdr + 40);
+	if (delta_base_size > delta_base->size)
+	{
+		ESP_LOGE(TAG, "ota_delta_check_header: base image larger than partition %s", delta_base->label);
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	err = esp_partition_get_sha256(delta_base, sha256);
+	if (err != ESP_OK || memcmp(sha256, delta_hdr + 8, sizeof(sha256)) != 0)
+	{
+		ESP_LOGE(TAG, "ota_delta_check_header: patch was not made against the running firmware");
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	ESP_LOGI(TAG, "ota_delta_check_header: patching %lu byte image into %lu bytes",
+			 (unsigned long)delta_base_size, (unsigned long)delta_target_size);
+
+	return ESP_OK;
+}
+
+/**
+ * Emits a run of base bytes, used by COPY.
+ */
+static esp_err_t ota_delta_copy(uint32_t offset, uint32_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	while (len > 0 && err == ESP_OK)
+	{
+		size_t n = (len < OTA_DELTA_BUF_LEN) ? len : OTA_DELTA_BUF_LEN;
+
+		err = esp_partition_read(delta_base, offset, delta_buf, n);
+		if (err == ESP_OK)
+		{
+			err = ota_delta_emit(delta_buf, n);
+		}
+		offset += n;
+		len -= n;
+	}
+
+	return err;
+}
+
+/**
+ * Emits base bytes plus the patch's difference bytes, used by ADD.
+ */
+static esp_err_t ota_delta_add(const uint8_t *diff, size_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	while (len > 0 && err == ESP_OK)
+	{
+		size_t n = (len < OTA_DELTA_BUF_LEN) ? len : OTA_DELTA_BUF_LEN;
+
+		err = esp_partition_read(delta_base, delta_offset, delta_buf, n);
+		if (err == ESP_OK)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				delta_buf[i] += diff[i];
+			}
+			err = ota_delta_emit(delta_buf, n);
+		}
+		delta_offset += n;
+		diff += n;
+		len -= n;
+	}
+
+	return err;
+}
+
+/**
+ * Decodes a complete op header.
+ */
+static esp_err_t ota_delta_start_op(void)
+{
+	uint8_t op = delta_hdr[0];
+	esp_err_t err;
+
+	switch (op)
+	{
+	case OTA_DELTA_OP_COPY:
+	case OTA_DELTA_OP_ADD:
+		delta_offset = ota_delta_get_u32(delta_hdr + 1);
+		delta_remaining = ota_delta_get_u32(delta_hdr + 5);
+		err = ota_delta_check_range(delta_offset, delta_remaining);
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+		if (op == OTA_DELTA_OP_COPY)
+		{
+			err = ota_delta_copy(delta_offset, delta_remaining);
+			delta_state = OTA_DELTA_STATE_OP;
+			return err;
+		}
+		delta_state = OTA_DELTA_STATE_ADD;
+		return ESP_OK;
+
+	case OTA_DELTA_OP_INSERT:
+		delta_remaining = ota_delta_get_u32(delta_hdr + 1);
+		delta_state = OTA_DELTA_STATE_INSERT;
+		return ESP_OK;
+
+	default:
+		ESP_LOGE(TAG, "ota_delta_start_op: unknown op 0x%02x", op);
+		return ESP_ERR_INVALID_RESPONSE;
+	}
+}
+
+/**
+ * Length of the op header starting with op.
+ */
+static size_t ota_delta_op_len(uint8_t op)
+{
+	return (op == OTA_DELTA_OP_INSERT) ? 5 : 9;
+}
+
+esp_err_t ota_delta_begin(const esp_partition_t *base, ota_delta_output_cb_t output, void *ctx)
+{
+	ota_delta_end();
+
+	delta_buf = malloc(OTA_DELTA_BUF_LEN);
+	if (delta_buf == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	delta_base = base;
+	delta_output = output;
+	delta_ctx = ctx;
+	delta_state = OTA_DELTA_STATE_HEADER;
+	delta_hdr_len = 0;
+	delta_produced = 0;
+
+	return ESP_OK;
+}
+
+esp_err_t ota_delta_feed(const uint8_t *data, size_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	if (delta_buf == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	while (len > 0 && err == ESP_OK)
+	{
+		size_t n;
+
+		switch (delta_state)
+		{
+		case OTA_DELTA_STATE_HEADER:
+			n = OTA_DELTA_HEADER_LEN - delta_hdr_len;
+			n = (len < n) ? len : n;
+			memcpy(delta_hdr + delta_hdr_len, data, n);
+			delta_hdr_len += n;
+			if (delta_hdr_len == OTA_DELTA_HEADER_LEN)
+			{
+				err = ota_delta_check_header();
+				delta_hdr_len = 0;
+				delta_state = OTA_DELTA_STATE_OP;
+			}
+			break;
+
+		case OTA_DELTA_STATE_OP:
+			// The op byte tells how long the op header is, it may be split across chunks
+			n = (delta_hdr_len == 0) ? 1 : ota_delta_op_len(delta_hdr[0]) - delta_hdr_len;
+			n = (len < n) ? len : n;
+			memcpy(delta_hdr + delta_hdr_len, data, n);
+			delta_hdr_len += n;
+			if (delta_hdr_len > 1 && delta_hdr_len == ota_delta_op_len(delta_hdr[0]))
+			{
+				delta_hdr_len = 0;
+				err = ota_delta_start_op();
+			}
+			break;
+
+		case OTA_DELTA_STATE_ADD:
+		case OTA_DELTA_STATE_INSERT:
+			n = (len < delta_remaining) ? len : delta_remaining;
+			err = (delta_state == OTA_DELTA_STATE_ADD) ? ota_delta_add(data, n) : ota_delta_emit(data, n);
+			delta_remaining -= n;
+			break;
+
+		default:
+			// Trailing bytes after the target image is complete
+			ESP_LOGE(TAG, "ota_delta_feed: %u unexpected bytes after the patch", (unsigned int)len);
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+
+		data += n;
+		len -= n;
+
+		if (delta_state > OTA_DELTA_STATE_OP && delta_remaining == 0)
+		{
+			delta_state = OTA_DELTA_STATE_OP;
+		}
+		if (delta_state == OTA_DELTA_STATE_OP && delta_hdr_len == 0 && delta_produced == delta_target_size)
+		{
+			delta_state = OTA_DELTA_STATE_DONE;
+		}
+	}
+
+	return err;
+}
+
+bool ota_delta_is_done(void)
+{
+	return delta_state == OTA_DELTA_STATE_DONE;
+}
+
+void ota_delta_end(void)
+{
+	free(delta_buf);
+	delta_buf = NULL;
+}
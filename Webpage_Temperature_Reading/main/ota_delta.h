@@ -0,0 +1,64 @@
+/*
+ * ota_delta.h
+ *
+ *  Streaming application of delta OTA patches produced by tools/ota_delta.py.
+ *
+ *  Patch format (little endian):
+ *    header: "ESPD", u32 base image size, u8[32] base image SHA-256, u32 target image size
+ *    ops:    0x01 COPY   u32 base offset, u32 length
+ *            0x02 ADD    u32 base offset, u32 length, length bytes added to the base bytes
+ *            0x03 INSERT u32 length, length literal bytes
+ *  The ops produce the target image front to back.
+ */
+
+#ifndef MAIN_OTA_DELTA_H_
+#define MAIN_OTA_DELTA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// First byte of a patch ("ESPD")
+#define OTA_DELTA_MAGIC_BYTE 'E'
+
+// Base partition read buffer, allocated for the duration of a delta update
+#define OTA_DELTA_BUF_LEN 1024
+
+/**
+ * Receives a run of target image bytes.
+ * @return ESP_OK to continue, any other value aborts.
+ */
+typedef esp_err_t (*ota_delta_output_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Starts applying a patch against the image in base.
+ * @param base partition holding the image the patch was made against (the running firmware).
+ * @param output callback receiving the target image.
+ * @param ctx argument passed to output.
+ * @return ESP_OK, or ESP_ERR_NO_MEM.
+ */
+esp_err_t ota_delta_begin(const esp_partition_t *base, ota_delta_output_cb_t output, void *ctx);
+
+/**
+ * Feeds a chunk of the patch.
+ * @param data patch bytes.
+ * @param len number of bytes.
+ * @return ESP_OK, ESP_ERR_INVALID_VERSION if the patch was made against another image,
+ * ESP_ERR_INVALID_RESPONSE on a malformed patch, or the output callback's error.
+ */
+esp_err_t ota_delta_feed(const uint8_t *data, size_t len);
+
+/**
+ * Tells whether the whole target image has been produced.
+ */
+bool ota_delta_is_done(void);
+
+/**
+ * Releases the patcher's buffer.
+ */
+void ota_delta_end(void);
+
+#endif /* MAIN_OTA_DELTA_H_ */
@@ -0,0 +1,111 @@
+/*
+ * ota_inflate.c
+ *
+ *  Streaming zlib decompression of compressed OTA images using the miniz
+ *  inflater in ROM. The decompressed stream is produced into a circular
+ *  32 KB window (the deflate history size) and handed out as it is filled,
+ *  so memory use does not depend on the image size.
+ */
+
+#include <stdlib.h>
+
+#include "esp_log.h"
+#include "rom/miniz.h"
+
+#include "ota_inflate.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "ota_inflate";
+
+// Decompressor state, only allocated while a compressed update is running
+static tinfl_decompressor *inflate_decomp = NULL;
+static uint8_t *inflate_window = NULL;
+static size_t inflate_window_ofs;
+static bool inflate_done;
+static ota_inflate_output_cb_t inflate_output;
+static void *inflate_ctx;
+
+esp_err_t ota_inflate_begin(ota_inflate_output_cb_t output, void *ctx)
+{
+	ota_inflate_end();
+
+	inflate_decomp = malloc(sizeof(tinfl_decompressor));
+	inflate_window = malloc(TINFL_LZ_DICT_SIZE);
+	if (inflate_decomp == NULL || inflate_window == NULL)
+	{
+		ESP_LOGE(TAG, "ota_inflate_begin: unable to allocate %u bytes", (unsigned int)(sizeof(tinfl_decompressor) + TINFL_LZ_DICT_SIZE));
+		ota_inflate_end();
+		return ESP_ERR_NO_MEM;
+	}
+
+	tinfl_init(inflate_decomp);
+	inflate_window_ofs = 0;
+	inflate_done = false;
+	inflate_output = output;
+	inflate_ctx = ctx;
+
+	return ESP_OK;
+}
+
+esp_err_t ota_inflate_feed(const uint8_t *data, size_t len)
+{
+	size_t in_ofs = 0;
+	esp_err_t err;
+
+	if (inflate_decomp == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	while (!inflate_done)
+	{
+		size_t in_size = len - in_ofs;
+		size_t out_size = TINFL_LZ_DICT_SIZE - inflate_window_ofs;
+		tinfl_status status;
+
+		status = tinfl_decompress(inflate_decomp, data + in_ofs, &in_size,
+								  inflate_window, inflate_window + inflate_window_ofs, &out_size,
+								  TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+		in_ofs += in_size;
+
+		if (out_size > 0)
+		{
+			err = inflate_output(inflate_ctx, inflate_window + inflate_window_ofs, out_size);
+			if (err != ESP_OK)
+			{
+				return err;
+			}
+			inflate_window_ofs = (inflate_window_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+		}
+
+		if (status < TINFL_STATUS_DONE)
+		{
+			ESP_LOGE(TAG, "ota_inflate_feed: corrupt stream (%d)", status);
+			return ESP_ERR_INVALID_RESPONSE;
+		}
+
+		if (status == TINFL_STATUS_DONE)
+		{
+			inflate_done = true;
+		}
+		else if (status == TINFL_STATUS_NEEDS_MORE_INPUT && in_ofs == len)
+		{
+			break;
+		}
+	}
+
+	return ESP_OK;
+}
+
+bool ota_inflate_is_done(void)
+{
+	return inflate_done;
+}
+
+void ota_inflate_end(void)
+{
+	free(inflate_decomp);
+	free(inflate_window);
+	inflate_decomp = NULL;
+	inflate_window = NULL;
+}
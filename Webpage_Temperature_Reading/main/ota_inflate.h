@@ -0,0 +1,51 @@
+/*
+ * ota_inflate.h
+ *
+ *  Streaming zlib decompression of compressed OTA images.
+ */
+
+#ifndef MAIN_OTA_INFLATE_H_
+#define MAIN_OTA_INFLATE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// First byte of a zlib stream with a 32 KB window (CMF = deflate, CINFO = 7)
+#define OTA_INFLATE_ZLIB_MAGIC 0x78
+
+/**
+ * Receives a run of decompressed bytes.
+ * @return ESP_OK to continue, any other value aborts decompression.
+ */
+typedef esp_err_t (*ota_inflate_output_cb_t)(void *ctx, const uint8_t *data, size_t len);
+
+/**
+ * Allocates the decompressor and its window.
+ * @param output callback receiving the decompressed stream.
+ * @param ctx argument passed to output.
+ * @return ESP_OK, or ESP_ERR_NO_MEM.
+ */
+esp_err_t ota_inflate_begin(ota_inflate_output_cb_t output, void *ctx);
+
+/**
+ * Decompresses a chunk of the compressed stream, output is flushed every time the window wraps.
+ * @param data compressed bytes.
+ * @param len number of bytes.
+ * @return ESP_OK, ESP_ERR_INVALID_RESPONSE on corrupt input, or the output callback's error.
+ */
+esp_err_t ota_inflate_feed(const uint8_t *data, size_t len);
+
+/**
+ * Tells whether the end of the compressed stream has been reached.
+ */
+bool ota_inflate_is_done(void);
+
+/**
+ * Releases the decompressor and its window.
+ */
+void ota_inflate_end(void);
+
+#endif /* MAIN_OTA_INFLATE_H_ */
@@ -0,0 +1,290 @@
+/*
+ * ota_update.c
+ *
+ *  Streams a firmware image into the next OTA slot as it is received.
+ *  The image goes to flash through the writer task's two sector sized
+ *  buffers (ota_writer.c), so RAM use does not depend on its size. Uploads are decoded in layers,
+ *  each recognised by its first byte: zlib compression (tools/ota_compress.py)
+ *  is inflated, then a delta patch (tools/ota_delta.py) is applied against the
+ *  running partition, and the resulting app image is written to flash.
+ */
+
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+
+#include "esp_image_format.h"
+
+#include "metrics.h"
+#include "ota_delta.h"
+#include "ota_inflate.h"
+#include "ota_update.h"
+#include "ota_writer.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "ota_update";
+
+// Log a progress line every this many bytes
+#define OTA_UPDATE_LOG_INTERVAL (64 * 1024)
+
+// Current session, only touched from the httpd task
+static const esp_partition_t *ota_partition = NULL;
+static int64_t ota_start_time;
+static int64_t ota_end_time;
+static ota_update_format_e ota_format;
+static bool ota_compressed;
+
+// Progress, read by the status handler and the metrics scrape
+static volatile ota_update_state_e ota_state = OTA_UPDATE_STATE_IDLE;
+static volatile uint32_t ota_received = 0;
+static volatile uint32_t ota_written = 0;
+static volatile uint32_t ota_total = 0;
+
+// Completed and failed sessions since boot
+static volatile uint32_t ota_updates_total = 0;
+static volatile uint32_t ota_failures_total = 0;
+static bool ota_metrics_registered = false;
+
+esp_err_t ota_update_begin(size_t image_size)
+{
+	esp_err_t err;
+
+	if (ota_state == OTA_UPDATE_STATE_RECEIVING)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (!ota_metrics_registered)
+	{
+		metrics_register("ota_bytes_received", "Upload bytes received by the current or last OTA update", METRICS_TYPE_GAUGE, &ota_received);
+		metrics_register("ota_bytes_written", "Image bytes written by the current or last OTA update", METRICS_TYPE_GAUGE, &ota_written);
+		metrics_register("ota_updates_total", "Successful OTA updates", METRICS_TYPE_COUNTER, &ota_updates_total);
+		metrics_register("ota_failures_total", "Failed OTA updates", METRICS_TYPE_COUNTER, &ota_failures_total);
+		ota_metrics_registered = true;
+	}
+
+	ota_received = 0;
+	ota_written = 0;
+	ota_total = image_size;
+	ota_format = OTA_UPDATE_FORMAT_UNKNOWN;
+	ota_compressed = false;
+	ota_start_time = esp_timer_get_time();
+	ota_end_time = ota_start_time;
+
+	ota_partition = esp_ota_get_next_update_partition(NULL);
+	if (ota_partition == NULL)
+	{
+		ESP_LOGE(TAG, "ota_update_begin: no OTA partition available");
+		ota_state = OTA_UPDATE_STATE_FAILED;
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	if (image_size > ota_partition->size)
+	{
+		ESP_LOGE(TAG, "ota_update_begin: image of %u bytes does not fit in %s", (unsigned int)image_size, ota_partition->label);
+		ota_state = OTA_UPDATE_STATE_FAILED;
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	ESP_LOGI(TAG, "ota_update_begin: writing partition %s at offset 0x%lx", ota_partition->label, (unsigned long)ota_partition->address);
+
+	// Sectors are erased by the writer task as the image grows, not the whole slot up front
+	err = ota_writer_start(ota_partition, true);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_update_begin: unable to start the flash writer (%s)", esp_err_to_name(err));
+		ota_state = OTA_UPDATE_STATE_FAILED;
+		return err;
+	}
+
+	ota_state = OTA_UPDATE_STATE_RECEIVING;
+
+	return ESP_OK;
+}
+
+/**
+ * Hands a run of decoded image bytes to the flash writer task.
+ */
+static esp_err_t ota_update_flash_write(void *ctx, const uint8_t *data, size_t len)
+{
+	esp_err_t err;
+
+	err = ota_writer_write(data, len);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_update_flash_write: flash write failed near offset %lu (%s)", (unsigned long)ota_written, esp_err_to_name(err));
+		return err;
+	}
+
+	if ((ota_written + len) / OTA_UPDATE_LOG_INTERVAL != ota_written / OTA_UPDATE_LOG_INTERVAL)
+	{
+		ESP_LOGI(TAG, "ota_update_flash_write: %lu bytes written, %lu / %lu received",
+				 (unsigned long)(ota_written + len), (unsigned long)ota_received, (unsigned long)ota_total);
+	}
+	ota_written += len;
+
+	return ESP_OK;
+}
+
+/**
+ * Receives the decompressed upload, selects between a plain image and a delta
+ * patch from its first byte.
+ */
+static esp_err_t ota_update_decoded_write(void *ctx, const uint8_t *data, size_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	if (ota_format == OTA_UPDATE_FORMAT_UNKNOWN)
+	{
+		switch (data[0])
+		{
+		case ESP_IMAGE_HEADER_MAGIC:
+			ota_format = OTA_UPDATE_FORMAT_IMAGE;
+			break;
+
+		case OTA_DELTA_MAGIC_BYTE:
+			ESP_LOGI(TAG, "ota_update_decoded_write: delta patch");
+			ota_format = OTA_UPDATE_FORMAT_DELTA;
+			err = ota_delta_begin(esp_ota_get_running_partition(), ota_update_flash_write, NULL);
+			break;
+
+		default:
+			ESP_LOGE(TAG, "ota_update_decoded_write: unknown image format (0x%02x)", data[0]);
+			err = ESP_ERR_NOT_SUPPORTED;
+			break;
+		}
+		if (err != ESP_OK)
+		{
+			return err;
+		}
+	}
+
+	if (ota_format == OTA_UPDATE_FORMAT_DELTA)
+	{
+		return ota_delta_feed(data, len);
+	}
+
+	return ota_update_flash_write(NULL, data, len);
+}
+
+/**
+ * Releases the decoders' buffers.
+ */
+static void ota_update_decoders_end(void)
+{
+	ota_inflate_end();
+	ota_delta_end();
+}
+
+esp_err_t ota_update_write(const uint8_t *data, size_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	if (ota_state != OTA_UPDATE_STATE_RECEIVING)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if (len == 0)
+	{
+		return ESP_OK;
+	}
+
+	if (ota_received == 0 && data[0] == OTA_INFLATE_ZLIB_MAGIC)
+	{
+		ESP_LOGI(TAG, "ota_update_write: compressed upload");
+		ota_compressed = true;
+		err = ota_inflate_begin(ota_update_decoded_write, NULL);
+	}
+
+	if (err == ESP_OK)
+	{
+		ota_received += len;
+		if (ota_compressed)
+		{
+			err = ota_inflate_feed(data, len);
+		}
+		else
+		{
+			err = ota_update_decoded_write(NULL, data, len);
+		}
+	}
+
+	if (err != ESP_OK)
+	{
+		ota_update_abort();
+	}
+
+	return err;
+}
+
+esp_err_t ota_update_end(void)
+{
+	esp_err_t err;
+
+	if (ota_state != OTA_UPDATE_STATE_RECEIVING)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	if ((ota_compressed && !ota_inflate_is_done()) || (ota_format == OTA_UPDATE_FORMAT_DELTA && !ota_delta_is_done()))
+	{
+		ESP_LOGE(TAG, "ota_update_end: upload is truncated");
+		ota_update_abort();
+		return ESP_ERR_INVALID_SIZE;
+	}
+	ota_update_decoders_end();
+
+	// Waits for the last buffer and checks the appended SHA-256 computed on the fly,
+	// esp_ota_set_boot_partition then validates the image header and segments
+	err = ota_writer_finish();
+	if (err == ESP_OK)
+	{
+		err = esp_ota_set_boot_partition(ota_partition);
+	}
+
+	ota_end_time = esp_timer_get_time();
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_update_end: image rejected (%s)", esp_err_to_name(err));
+		ota_state = OTA_UPDATE_STATE_FAILED;
+		ota_failures_total++;
+		return err;
+	}
+
+	ESP_LOGI(TAG, "ota_update_end: %lu bytes received, %lu bytes written in %lu ms, next boot partition %s",
+			 (unsigned long)ota_received, (unsigned long)ota_written,
+			 (unsigned long)((ota_end_time - ota_start_time) / 1000), ota_partition->label);
+	ota_state = OTA_UPDATE_STATE_DONE;
+	ota_updates_total++;
+
+	return ESP_OK;
+}
+
+void ota_update_abort(void)
+{
+	if (ota_state != OTA_UPDATE_STATE_RECEIVING)
+	{
+		return;
+	}
+
+	ESP_LOGW(TAG, "ota_update_abort: aborting after %lu bytes", (unsigned long)ota_received);
+	ota_update_decoders_end();
+	ota_writer_abort();
+
+	ota_end_time = esp_timer_get_time();
+	ota_state = OTA_UPDATE_STATE_FAILED;
+	ota_failures_total++;
+}
+
+void ota_update_get_progress(ota_update_progress_t *progress)
+{
+	int64_t end = (ota_state == OTA_UPDATE_STATE_RECEIVING) ? esp_timer_get_time() : ota_end_time;
+
+	progress->state = ota_state;
+	progress->received = ota_received;
+	progress->written = ota_written;
+	progress->total = ota_total;
+	progress->elapsed_ms = (ota_state == OTA_UPDATE_STATE_IDLE) ? 0 : (uint32_t)((end - ota_start_time) / 1000);
+}
@@ -0,0 +1,80 @@
+/*
+ * ota_update.h
+ *
+ *  Streams a firmware image into the next OTA slot as it is received.
+ */
+
+#ifndef MAIN_OTA_UPDATE_H_
+#define MAIN_OTA_UPDATE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * OTA session states
+ */
+typedef enum ota_update_state
+{
+	OTA_UPDATE_STATE_IDLE = 0,
+	OTA_UPDATE_STATE_RECEIVING,
+	OTA_UPDATE_STATE_DONE,
+	OTA_UPDATE_STATE_FAILED,
+} ota_update_state_e;
+
+/**
+ * Contents of the (decompressed) upload, detected from its first byte
+ */
+typedef enum ota_update_format
+{
+	OTA_UPDATE_FORMAT_UNKNOWN = 0,
+	OTA_UPDATE_FORMAT_IMAGE, // Plain app image
+	OTA_UPDATE_FORMAT_DELTA, // Patch against the running image, see ota_delta.h
+} ota_update_format_e;
+
+/**
+ * Progress of the current (or last) OTA session
+ */
+typedef struct ota_update_progress
+{
+	ota_update_state_e state;
+	uint32_t received; // Upload bytes received
+	uint32_t written;  // Image bytes written to flash
+	uint32_t total;	   // Expected upload size, 0 if unknown
+	uint32_t elapsed_ms;
+} ota_update_progress_t;
+
+/**
+ * Starts an OTA session on the next update partition.
+ * @param image_size expected upload size used for progress reporting, 0 if unknown.
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if a session is already running, or the esp_ota_begin error.
+ */
+esp_err_t ota_update_begin(size_t image_size);
+
+/**
+ * Decodes the next run of uploaded bytes and writes the image to flash.
+ * @param data uploaded bytes: an app image or a delta patch, optionally zlib compressed.
+ * @param len number of bytes.
+ * @return ESP_OK or the decoding / esp_ota_write error, the session is aborted on error.
+ */
+esp_err_t ota_update_write(const uint8_t *data, size_t len);
+
+/**
+ * Validates the written image and selects it as the boot partition.
+ * @return ESP_OK if the device can be restarted into the new image.
+ */
+esp_err_t ota_update_end(void);
+
+/**
+ * Aborts the running session, the partition written so far is discarded.
+ */
+void ota_update_abort(void);
+
+/**
+ * Copies the progress of the current (or last) session.
+ * @param progress destination.
+ */
+void ota_update_get_progress(ota_update_progress_t *progress);
+
+#endif /* MAIN_OTA_UPDATE_H_ */
@@ -0,0 +1,332 @@
+/*
+ * ota_writer.c
+ *
+ *  Flash writer task for OTA updates. The HTTP server task fills one buffer
+ *  while this task writes the other, so receiving and flashing overlap
+ *  instead of taking turns. When no buffer is waiting the task erases the
+ *  next sectors, so a sector erase rarely stalls a write.
+ */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_image_format.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "mbedtls/sha256.h"
+
+#include "ota_writer.h"
+#include "tasks_common.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "ota_writer";
+
+#define OTA_WRITER_HASH_LEN 32
+
+/**
+ * Buffer handed to the writer task, len 0 stops the task
+ */
+typedef struct ota_writer_message
+{
+	uint8_t index;
+	uint16_t len;
+} ota_writer_message_t;
+
+// Buffers and the queues passing them between the two tasks
+static uint8_t *writer_bufs[OTA_WRITER_NUM_BUFFERS];
+static QueueHandle_t writer_full_queue = NULL;
+static QueueHandle_t writer_free_queue = NULL;
+static SemaphoreHandle_t writer_done = NULL;
+
+// Producer side, only touched from the HTTP server task
+static int writer_cur = -1;
+static size_t writer_cur_len;
+
+// Writer task side
+static const esp_partition_t *writer_partition;
+static volatile esp_err_t writer_err;
+static volatile bool writer_aborted;
+static uint32_t writer_offset;
+static uint32_t writer_erased;
+static bool writer_app_image;
+static bool writer_hash_appended;
+static mbedtls_sha256_context writer_sha;
+static uint8_t writer_tail[OTA_WRITER_HASH_LEN]; // Last bytes seen, held back from the hash
+static size_t writer_tail_len;
+
+/**
+ * Hashes the image incrementally, always holding back the last 32 bytes which
+ * are the appended SHA-256 once the image is complete.
+ */
+static void ota_writer_hash(const uint8_t *data, size_t len)
+{
+	if (len >= OTA_WRITER_HASH_LEN)
+	{
+		mbedtls_sha256_update(&writer_sha, writer_tail, writer_tail_len);
+		mbedtls_sha256_update(&writer_sha, data, len - OTA_WRITER_HASH_LEN);
+		memcpy(writer_tail, data + len - OTA_WRITER_HASH_LEN, OTA_WRITER_HASH_LEN);
+		writer_tail_len = OTA_WRITER_HASH_LEN;
+		return;
+	}
+
+	// Short write, push the oldest held back bytes into the hash
+	size_t overflow = (writer_tail_len + len > OTA_WRITER_HASH_LEN) ? writer_tail_len + len - OTA_WRITER_HASH_LEN : 0;
+
+	mbedtls_sha256_update(&writer_sha, writer_tail, overflow);
+	memmove(writer_tail, writer_tail + overflow, writer_tail_len - overflow);
+	memcpy(writer_tail + writer_tail_len - overflow, data, len);
+	writer_tail_len += len - overflow;
+}
+
+/**
+ * Erases the next sector of the partition.
+ */
+static esp_err_t ota_writer_erase_next(void)
+{
+	esp_err_t err;
+
+	if (writer_erased >= writer_partition->size)
+	{
+		ESP_LOGE(TAG, "ota_writer_erase_next: image does not fit in %s", writer_partition->label);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	err = esp_partition_erase_range(writer_partition, writer_erased, writer_partition->erase_size);
+	if (err == ESP_OK)
+	{
+		writer_erased += writer_partition->erase_size;
+	}
+
+	return err;
+}
+
+/**
+ * Writes one buffer at the current offset, erasing first if the erase-ahead fell behind.
+ */
+static esp_err_t ota_writer_flash(const uint8_t *data, size_t len)
+{
+	esp_err_t err = ESP_OK;
+
+	while (err == ESP_OK && writer_erased < writer_offset + len)
+	{
+		err = ota_writer_erase_next();
+	}
+	if (err != ESP_OK)
+	{
+		return err;
+	}
+
+	if (writer_app_image && writer_offset == 0 && len >= sizeof(esp_image_header_t))
+	{
+		writer_hash_appended = ((const esp_image_header_t *)data)->hash_appended;
+	}
+
+	err = esp_partition_write(writer_partition, writer_offset, data, len);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "ota_writer_flash: write at 0x%lx failed (%s)", (unsigned long)writer_offset, esp_err_to_name(err));
+		return err;
+	}
+
+	ota_writer_hash(data, len);
+	writer_offset += len;
+
+	return ESP_OK;
+}
+
+/**
+ * Writer task, consumes filled buffers and erases ahead while idle.
+ * @param pvParameters parameter which can be passed to the task.
+ */
+static void ota_writer_task(void *pvParameters)
+{
+	ota_writer_message_t msg;
+
+	for (;;)
+	{
+		bool erase_ahead = writer_err == ESP_OK && !writer_aborted &&
+						   writer_erased < writer_partition->size &&
+						   writer_erased < writer_offset + OTA_WRITER_ERASE_AHEAD;
+
+		if (xQueueReceive(writer_full_queue, &msg, erase_ahead ? 0 : portMAX_DELAY) != pdTRUE)
+		{
+			writer_err = ota_writer_erase_next();
+			continue;
+		}
+
+		if (msg.len == 0)
+		{
+			break;
+		}
+
+		if (writer_err == ESP_OK && !writer_aborted)
+		{
+			writer_err = ota_writer_flash(writer_bufs[msg.index], msg.len);
+		}
+		xQueueSend(writer_free_queue, &msg.index, portMAX_DELAY);
+	}
+
+	xSemaphoreGive(writer_done);
+	vTaskDelete(NULL);
+}
+
+/**
+ * Hands the current buffer to the writer task.
+ */
+static void ota_writer_submit(void)
+{
+	ota_writer_message_t msg = {
+		.index = writer_cur,
+		.len = writer_cur_len,
+	};
+
+	xQueueSend(writer_full_queue, &msg, portMAX_DELAY);
+	writer_cur = -1;
+	writer_cur_len = 0;
+}
+
+/**
+ * Stops the writer task and releases the buffers.
+ */
+static void ota_writer_stop(void)
+{
+	ota_writer_message_t msg = {
+		.index = 0,
+		.len = 0,
+	};
+
+	xQueueSend(writer_full_queue, &msg, portMAX_DELAY);
+	xSemaphoreTake(writer_done, portMAX_DELAY);
+
+	for (int i = 0; i < OTA_WRITER_NUM_BUFFERS; i++)
+	{
+		free(writer_bufs[i]);
+		writer_bufs[i] = NULL;
+	}
+}
+
+esp_err_t ota_writer_start(const esp_partition_t *partition, bool app_image)
+{
+	if (writer_full_queue == NULL)
+	{
+		writer_full_queue = xQueueCreate(OTA_WRITER_NUM_BUFFERS + 1, sizeof(ota_writer_message_t));
+		writer_free_queue = xQueueCreate(OTA_WRITER_NUM_BUFFERS, sizeof(uint8_t));
+		writer_done = xSemaphoreCreateBinary();
+	}
+	xQueueReset(writer_full_queue);
+	xQueueReset(writer_free_queue);
+
+	for (uint8_t i = 0; i < OTA_WRITER_NUM_BUFFERS; i++)
+	{
+		writer_bufs[i] = malloc(OTA_WRITER_BUF_LEN);
+		if (writer_bufs[i] == NULL)
+		{
+			ESP_LOGE(TAG, "ota_writer_start: unable to allocate the write buffers");
+			for (int j = 0; j < i; j++)
+			{
+				free(writer_bufs[j]);
+				writer_bufs[j] = NULL;
+			}
+			return ESP_ERR_NO_MEM;
+		}
+		xQueueSend(writer_free_queue, &i, 0);
+	}
+
+	writer_partition = partition;
+	writer_err = ESP_OK;
+	writer_aborted = false;
+	writer_offset = 0;
+	writer_erased = 0;
+	writer_app_image = app_image;
+	writer_hash_appended = !app_image;
+	writer_tail_len = 0;
+	writer_cur = -1;
+	writer_cur_len = 0;
+	mbedtls_sha256_init(&writer_sha);
+	mbedtls_sha256_starts(&writer_sha, 0);
+
+	if (xTaskCreatePinnedToCore(&ota_writer_task, "ota_writer", OTA_WRITER_TASK_STACK_SIZE, NULL, OTA_WRITER_TASK_PRIORITY, NULL, OTA_WRITER_TASK_CORE_ID) != pdPASS)
+	{
+		for (int i = 0; i < OTA_WRITER_NUM_BUFFERS; i++)
+		{
+			free(writer_bufs[i]);
+			writer_bufs[i] = NULL;
+		}
+		mbedtls_sha256_free(&writer_sha);
+		return ESP_ERR_NO_MEM;
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t ota_writer_write(const uint8_t *data, size_t len)
+{
+	while (len > 0)
+	{
+		if (writer_err != ESP_OK)
+		{
+			return writer_err;
+		}
+
+		if (writer_cur < 0)
+		{
+			uint8_t index;
+
+			xQueueReceive(writer_free_queue, &index, portMAX_DELAY);
+			writer_cur = index;
+		}
+
+		size_t n = OTA_WRITER_BUF_LEN - writer_cur_len;
+		n = (len < n) ? len : n;
+		memcpy(writer_bufs[writer_cur] + writer_cur_len, data, n);
+		writer_cur_len += n;
+		data += n;
+		len -= n;
+
+		if (writer_cur_len == OTA_WRITER_BUF_LEN)
+		{
+			ota_writer_submit();
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t ota_writer_finish(void)
+{
+	uint8_t sha256[OTA_WRITER_HASH_LEN];
+	esp_err_t err;
+
+	if (writer_cur >= 0 && writer_cur_len > 0)
+	{
+		ota_writer_submit();
+	}
+	ota_writer_stop();
+
+	err = writer_err;
+	if (err == ESP_OK && writer_hash_appended)
+	{
+		mbedtls_sha256_finish(&writer_sha, sha256);
+		if (writer_tail_len != OTA_WRITER_HASH_LEN || memcmp(sha256, writer_tail, OTA_WRITER_HASH_LEN) != 0)
+		{
+			ESP_LOGE(TAG, "ota_writer_finish: SHA-256 mismatch");
+			err = ESP_ERR_IMAGE_INVALID;
+		}
+	}
+	mbedtls_sha256_free(&writer_sha);
+
+	ESP_LOGI(TAG, "ota_writer_finish: %lu bytes written (%s)", (unsigned long)writer_offset, esp_err_to_name(err));
+
+	return err;
+}
+
+void ota_writer_abort(void)
+{
+	writer_aborted = true;
+	ota_writer_stop();
+	mbedtls_sha256_free(&writer_sha);
+}
@@ -0,0 +1,55 @@
+/*
+ * ota_writer.h
+ *
+ *  Flash writer task for OTA updates. Erases run ahead of writes and the
+ *  image hash is computed as data passes, while the HTTP server task keeps
+ *  receiving into the other buffer.
+ */
+
+#ifndef MAIN_OTA_WRITER_H_
+#define MAIN_OTA_WRITER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+
+// Ping-pong buffers, one flash sector each
+#define OTA_WRITER_NUM_BUFFERS 2
+#define OTA_WRITER_BUF_LEN 4096
+
+// How far erases may run ahead of the write position
+#define OTA_WRITER_ERASE_AHEAD (OTA_WRITER_NUM_BUFFERS * OTA_WRITER_BUF_LEN)
+
+/**
+ * Allocates the buffers and starts the writer task.
+ * @param partition partition to write, it is erased as the image grows.
+ * @param app_image true for an app image, whose header says whether a SHA-256 is appended.
+ * Other images always end with the SHA-256 of the preceding bytes.
+ * @return ESP_OK, or ESP_ERR_NO_MEM.
+ */
+esp_err_t ota_writer_start(const esp_partition_t *partition, bool app_image);
+
+/**
+ * Queues image bytes for writing, blocks only while both buffers are in use.
+ * @param data image bytes.
+ * @param len number of bytes.
+ * @return ESP_OK, or the first error reported by the writer task.
+ */
+esp_err_t ota_writer_write(const uint8_t *data, size_t len);
+
+/**
+ * Flushes the last buffer, waits for the writer task and checks the SHA-256
+ * appended to the image against the one computed while writing.
+ * @return ESP_OK, ESP_ERR_IMAGE_INVALID on a hash mismatch, or the first flash error.
+ */
+esp_err_t ota_writer_finish(void);
+
+/**
+ * Stops the writer task and discards pending data.
+ */
+void ota_writer_abort(void);
+
+#endif /* MAIN_OTA_WRITER_H_ */
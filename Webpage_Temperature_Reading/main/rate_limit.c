@@ -0,0 +1,176 @@
+/*
+ * rate_limit.c
+ *
+ *  Per client token bucket rate limiting. Buckets live in a small fixed hash
+ *  table keyed by the peer address and are only touched from the httpd task.
+ *  Refused requests are answered with a 429 before any handler runs, so a
+ *  client polling in a tight loop costs little more than the socket reads.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include "http_request.h"
+#include "metrics.h"
+#include "rate_limit.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "rate_limit";
+
+// Tokens are kept in thousandths so refills don't lose fractions
+#define RATE_LIMIT_TOKEN 1000
+
+/**
+ * Token bucket of one client
+ */
+typedef struct rate_limit_bucket
+{
+	uint8_t addr[16]; // IPv6 or IPv4-mapped address
+	bool used;
+	uint32_t tokens;	 // In thousandths of a token
+	int64_t last_refill; // esp_timer time in microseconds
+} rate_limit_bucket_t;
+
+static rate_limit_bucket_t rate_limit_table[RATE_LIMIT_TABLE_SIZE];
+
+// Exported to the metrics
+static volatile uint32_t rate_limit_refused_total = 0;
+static bool rate_limit_metrics_registered = false;
+
+/**
+ * Gets the peer address of the request as 16 bytes, IPv4 addresses in their IPv4-mapped form.
+ */
+static bool rate_limit_get_peer(httpd_req_t *req, uint8_t addr[16])
+{
+	struct sockaddr_storage peer;
+	socklen_t len = sizeof(peer);
+
+	if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&peer, &len) != 0)
+	{
+		return false;
+	}
+
+	if (peer.ss_family == AF_INET)
+	{
+		memset(addr, 0x00, 10);
+		addr[10] = 0xff;
+		addr[11] = 0xff;
+		memcpy(addr + 12, &((struct sockaddr_in *)&peer)->sin_addr, 4);
+	}
+	else
+	{
+		memcpy(addr, &((struct sockaddr_in6 *)&peer)->sin6_addr, 16);
+	}
+
+	return true;
+}
+
+/**
+ * FNV-1a hash of the address.
+ */
+static uint32_t rate_limit_hash(const uint8_t addr[16])
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < 16; i++)
+	{
+		hash = (hash ^ addr[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Finds the client's bucket, or recycles an empty / the stalest slot in its probe window.
+ */
+static rate_limit_bucket_t *rate_limit_lookup(const uint8_t addr[16], int64_t now)
+{
+	uint32_t start = rate_limit_hash(addr) % RATE_LIMIT_TABLE_SIZE;
+	rate_limit_bucket_t *victim = NULL;
+
+	for (int i = 0; i < RATE_LIMIT_MAX_PROBES; i++)
+	{
+		rate_limit_bucket_t *bucket = &rate_limit_table[(start + i) % RATE_LIMIT_TABLE_SIZE];
+
+		if (bucket->used && memcmp(bucket->addr, addr, 16) == 0)
+		{
+			return bucket;
+		}
+		if (victim == NULL || !bucket->used || (victim->used && bucket->last_refill < victim->last_refill))
+		{
+			victim = bucket;
+		}
+	}
+
+	// New client, starts with a full bucket
+	memcpy(victim->addr, addr, 16);
+	victim->used = true;
+	victim->tokens = RATE_LIMIT_BURST * RATE_LIMIT_TOKEN;
+	victim->last_refill = now;
+
+	return victim;
+}
+
+bool rate_limit_allow(httpd_req_t *req, uint32_t *retry_after_s)
+{
+	uint8_t addr[16];
+	int64_t now = esp_timer_get_time();
+	rate_limit_bucket_t *bucket;
+
+	if (!rate_limit_metrics_registered)
+	{
+		metrics_register("http_rate_limited_total", "Requests refused with 429", METRICS_TYPE_COUNTER, &rate_limit_refused_total);
+		rate_limit_metrics_registered = true;
+	}
+
+	if (!rate_limit_get_peer(req, addr))
+	{
+		return true;
+	}
+
+	bucket = rate_limit_lookup(addr, now);
+
+	// Refill for the time elapsed since the last request, 1 token per 1/RATE s
+	int64_t refill = (now - bucket->last_refill) * RATE_LIMIT_RATE * RATE_LIMIT_TOKEN / 1000000;
+	if (refill > 0)
+	{
+		int64_t tokens = bucket->tokens + refill;
+
+		bucket->tokens = (tokens > RATE_LIMIT_BURST * RATE_LIMIT_TOKEN) ? RATE_LIMIT_BURST * RATE_LIMIT_TOKEN : tokens;
+		bucket->last_refill = now;
+	}
+
+	if (bucket->tokens >= RATE_LIMIT_TOKEN)
+	{
+		bucket->tokens -= RATE_LIMIT_TOKEN;
+		return true;
+	}
+
+	// Round up to whole seconds for Retry-After
+	*retry_after_s = ((RATE_LIMIT_TOKEN - bucket->tokens) / RATE_LIMIT_RATE + 999) / 1000;
+	if (*retry_after_s == 0)
+	{
+		*retry_after_s = 1;
+	}
+	rate_limit_refused_total++;
+
+	return false;
+}
+
+esp_err_t rate_limit_send_429(httpd_req_t *req, uint32_t retry_after_s)
+{
+	char retry_after[12];
+
+	ESP_LOGD(TAG, "rate_limit_send_429: %s refused, retry after %lu s", req->uri, (unsigned long)retry_after_s);
+
+	snprintf(retry_after, sizeof(retry_after), "%lu", (unsigned long)retry_after_s);
+	httpd_resp_set_status(req, "429 Too Many Requests");
+	httpd_resp_set_type(req, "text/plain");
+	httpd_resp_set_hdr(req, "Retry-After", retry_after);
+
+	return http_request_send(req, "Too Many Requests", HTTPD_RESP_USE_STRLEN);
+}
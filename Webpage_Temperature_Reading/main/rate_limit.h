@@ -0,0 +1,43 @@
+/*
+ * rate_limit.h
+ *
+ *  Per client token bucket rate limiting for the HTTP server, built with
+ *  CONFIG_HTTP_SERVER_RATE_LIMIT.
+ */
+
+#ifndef MAIN_RATE_LIMIT_H_
+#define MAIN_RATE_LIMIT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_http_server.h"
+#include "sdkconfig.h"
+
+// Sustained requests per second and burst allowed per client IP
+#define RATE_LIMIT_RATE CONFIG_HTTP_SERVER_RATE_LIMIT_RATE
+#define RATE_LIMIT_BURST CONFIG_HTTP_SERVER_RATE_LIMIT_BURST
+
+// Clients tracked, the stalest entry is recycled when a new client needs a slot
+#define RATE_LIMIT_TABLE_SIZE 16
+
+// Slots looked at from a client's hash position
+#define RATE_LIMIT_MAX_PROBES 4
+
+/**
+ * Takes a token from the bucket of the request's peer.
+ * @param req HTTP request.
+ * @param retry_after_s set to the seconds until a token is available when the request is refused.
+ * @return true if the request may be handled.
+ */
+bool rate_limit_allow(httpd_req_t *req, uint32_t *retry_after_s);
+
+/**
+ * Sends the 429 response for a refused request.
+ * @param req HTTP request.
+ * @param retry_after_s value of the Retry-After header.
+ * @return result of the send.
+ */
+esp_err_t rate_limit_send_429(httpd_req_t *req, uint32_t retry_after_s);
+
+#endif /* MAIN_RATE_LIMIT_H_ */
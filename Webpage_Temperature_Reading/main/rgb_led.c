@@ -5,12 +5,22 @@
  *      Author: kjagu
  */
 
+#include <math.h>
 #include <stdbool.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
 
 #include "driver/ledc.h"
 #include "rgb_led.h"
 #include "freertos/queue.h"
+#include "metrics.h"
+#include "tasks_common.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "rgb_led";
 
 // RGB LED Configuration Array
 ledc_info_t ledc_ch[RGB_LED_CHANNEL_NUM];
@@ -20,7 +30,86 @@ bool g_pwm_init_handle = false;
 
 // ADC Queue
 extern QueueHandle_t ADC_QUEUE;
-extern QueueHandle_t temperatureQueue;
+
+/**
+ * Layer change asked for by another task, taken by the LED task
+ */
+typedef struct rgb_led_layer_request
+{
+	bool pending;
+	bool active;
+	uint32_t rgb;
+	uint32_t timeout_ms;
+} rgb_led_layer_request_t;
+
+/**
+ * Layer as seen by the LED task
+ */
+typedef struct rgb_led_layer_state
+{
+	bool active;
+	bool expires;
+	uint32_t rgb;
+	TickType_t expiry;
+} rgb_led_layer_state_t;
+
+// Layer requests, guarded by g_layer_lock
+static rgb_led_layer_request_t g_layer_requests[RGB_LED_LAYER_COUNT];
+static portMUX_TYPE g_layer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// LEDC duty writes, a channel is only written when its duty changes
+static volatile uint32_t g_duty_writes = 0;
+
+// Temperature rules, double buffered. The HTTP server task fills the inactive
+// buffer and swaps the pointer, the generation counter lets the LED task detect
+// a swap and retry a copy that raced with a second update.
+static led_rules_t g_rules[2];
+static led_rules_t *volatile g_rules_active = NULL;
+static volatile uint32_t g_rules_generation = 0;
+
+// Transition time of the next color change, 0 switches instantly
+static volatile uint32_t g_transition_ms = RGB_LED_TRANSITION_MS;
+
+// Channels with a hardware fade in progress, one bit per channel, cleared by the fade end callback
+static volatile uint32_t g_fading = 0;
+
+// Whether the fade engine and its end callbacks are installed, colors switch instantly otherwise
+static bool g_fade_enabled = false;
+
+// Tick by which the fades in g_fading should have ended, only used by the LED task
+static TickType_t g_fade_deadline;
+
+// Duty written to each channel by the last color change
+static uint32_t g_duty[RGB_LED_CHANNEL_NUM];
+
+// 8 bit color value to PWM duty, filled by rgb_led_pwm_init
+static uint16_t g_gamma[256];
+
+// Rules copy used by the LED task, too large for its stack
+static led_rules_t g_rules_local;
+
+// LED controller task handle
+static TaskHandle_t task_rgb_led = NULL;
+
+/**
+ * LEDC fade end callback, runs in the LEDC interrupt. Marks the channel idle
+ * and wakes the LED task, which may be waiting to start the next transition.
+ * @param param fade event.
+ * @param user_arg channel index into ledc_ch.
+ * @return true if a higher priority task was woken.
+ */
+static bool IRAM_ATTR rgb_led_fade_end_cb(const ledc_cb_param_t *param, void *user_arg)
+{
+	BaseType_t woken = pdFALSE;
+
+	if (param->event == LEDC_FADE_END_EVT)
+	{
+		__atomic_fetch_and(&g_fading, ~(1u << (uintptr_t)user_arg), __ATOMIC_RELEASE);
+		vTaskNotifyGiveFromISR(task_rgb_led, &woken);
+	}
+
+	return woken == pdTRUE;
+}
 
 /**
  * Initializes the RGB LED settings per channel, including
@@ -52,12 +141,23 @@ rgb_led_pwm_init(void)
 	// Configure timer zero
 	ledc_timer_config_t ledc_timer =
 		{
-			.duty_resolution = LEDC_TIMER_8_BIT,
-			.freq_hz = 100,
+			.duty_resolution = RGB_LED_PWM_RESOLUTION,
+			.freq_hz = RGB_LED_PWM_FREQ_HZ,
 			.speed_mode = LEDC_HIGH_SPEED_MODE,
 			.timer_num = LEDC_TIMER_0};
 	ledc_timer_config(&ledc_timer);
 
+	// Perceived brightness is not linear in the duty cycle, with the gamma
+	// curve equal steps of a color value look like equal steps of brightness
+	for (int i = 0; i < 256; i++)
+	{
+		g_gamma[i] = lroundf(powf(i / 255.0f, RGB_LED_GAMMA) * RGB_LED_DUTY_MAX);
+	}
+
+	// Transitions run in the LEDC fade engine, the CPU only starts them
+	esp_err_t err = ledc_fade_func_install(0);
+	g_fade_enabled = err == ESP_OK;
+
 	// Configure channels
 	for (rgb_ch = 0; rgb_ch < RGB_LED_CHANNEL_NUM; rgb_ch++)
 	{
@@ -72,90 +172,314 @@ rgb_led_pwm_init(void)
 				.timer_sel = ledc_ch[rgb_ch].timer_index,
 			};
 		ledc_channel_config(&ledc_channel);
+
+		ledc_cbs_t callbacks = {
+			.fade_cb = rgb_led_fade_end_cb,
+		};
+		if (g_fade_enabled)
+		{
+			err = ledc_cb_register(ledc_ch[rgb_ch].mode, ledc_ch[rgb_ch].channel, &callbacks, (void *)(uintptr_t)rgb_ch);
+			g_fade_enabled = err == ESP_OK;
+		}
+	}
+
+	if (!g_fade_enabled)
+	{
+		// Without the end callback nothing would report a fade as done
+		ESP_LOGW(TAG, "rgb_led_pwm_init: fades disabled, colors switch instantly (%s)", esp_err_to_name(err));
 	}
 
 	g_pwm_init_handle = true;
 }
 
 /**
- * Sets the RGB color.
+ * Moves the LED to a color, fading in hardware unless fade_ms is 0. Returns
+ * as soon as the fades are started, the fade end callback reports completion.
+ * Only channels whose duty changes are written.
+ * @param color packed 0xRRGGBB.
+ * @param fade_ms transition time.
  */
-static void rgb_led_set_color(uint8_t red, uint8_t green, uint8_t blue)
+static void rgb_led_set_color(uint32_t color, uint32_t fade_ms)
 {
-	// Value should be 0 - 255 for 8 bit number
-	ledc_set_duty(ledc_ch[0].mode, ledc_ch[0].channel, red);
-	ledc_update_duty(ledc_ch[0].mode, ledc_ch[0].channel);
+	for (int i = 0; i < RGB_LED_CHANNEL_NUM; i++)
+	{
+		uint32_t duty = g_gamma[(color >> (8 * (RGB_LED_CHANNEL_NUM - 1 - i))) & 0xFF];
 
-	ledc_set_duty(ledc_ch[1].mode, ledc_ch[1].channel, green);
-	ledc_update_duty(ledc_ch[1].mode, ledc_ch[1].channel);
+		if (duty == g_duty[i])
+		{
+			continue;
+		}
+		g_duty[i] = duty;
+		g_duty_writes++;
 
-	ledc_set_duty(ledc_ch[2].mode, ledc_ch[2].channel, blue);
-	ledc_update_duty(ledc_ch[2].mode, ledc_ch[2].channel);
+		if (fade_ms != 0 && g_fade_enabled)
+		{
+			// The bit is set first, the fade may end before the call returns
+			__atomic_fetch_or(&g_fading, 1u << i, __ATOMIC_RELAXED);
+			if (ledc_set_fade_time_and_start(ledc_ch[i].mode, ledc_ch[i].channel, duty, fade_ms, LEDC_FADE_NO_WAIT) == ESP_OK)
+			{
+				g_fade_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(fade_ms + RGB_LED_FADE_MARGIN_MS);
+				continue;
+			}
+			__atomic_fetch_and(&g_fading, ~(1u << i), __ATOMIC_RELEASE);
+		}
+		ledc_set_duty_and_update(ledc_ch[i].mode, ledc_ch[i].channel, duty, 0);
+	}
 }
 
-void rgb_led_wifi_app_started(void)
+/**
+ * Whether a fade is still running. A fade whose end callback is overdue is
+ * treated as ended, so a lost callback cannot stop the LED task for good.
+ * @return true while the LED task should wait for a fade end.
+ */
+static bool rgb_led_fading(void)
 {
-	if (g_pwm_init_handle == false)
+	if (__atomic_load_n(&g_fading, __ATOMIC_ACQUIRE) == 0)
+	{
+		return false;
+	}
+	if ((int32_t)(xTaskGetTickCount() - g_fade_deadline) < 0)
 	{
-		rgb_led_pwm_init();
+		return true;
 	}
 
-	rgb_led_set_color(255, 45, 0);
+	ESP_LOGW(TAG, "rgb_led_fading: no fade end reported, channels 0x%x released", (unsigned int)__atomic_exchange_n(&g_fading, 0, __ATOMIC_ACQ_REL));
+
+	return false;
 }
 
-void rgb_led_http_server_started(void)
+void rgb_led_set_transition_time(uint32_t fade_ms)
 {
-	if (g_pwm_init_handle == false)
+	if (fade_ms > RGB_LED_TRANSITION_MAX_MS)
 	{
-		rgb_led_pwm_init();
+		fade_ms = RGB_LED_TRANSITION_MAX_MS;
 	}
+	__atomic_store_n(&g_transition_ms, fade_ms, __ATOMIC_RELAXED);
+}
 
-	rgb_led_set_color(0, 170, 255);
+void rgb_led_layer_set(rgb_led_layer_e layer, uint32_t rgb, uint32_t timeout_ms)
+{
+	// The temperature layer belongs to the LED task, it follows the rules
+	if (layer >= RGB_LED_LAYER_TEMPERATURE)
+	{
+		return;
+	}
+
+	portENTER_CRITICAL(&g_layer_lock);
+	g_layer_requests[layer].pending = true;
+	g_layer_requests[layer].active = true;
+	g_layer_requests[layer].rgb = rgb;
+	g_layer_requests[layer].timeout_ms = timeout_ms;
+	portEXIT_CRITICAL(&g_layer_lock);
 }
 
-void rgb_led_wifi_connected(void)
+void rgb_led_layer_clear(rgb_led_layer_e layer)
 {
-	if (g_pwm_init_handle == false)
+	if (layer >= RGB_LED_LAYER_TEMPERATURE)
 	{
-		rgb_led_pwm_init();
+		return;
 	}
 
-	rgb_led_set_color(0, 255, 0);
+	portENTER_CRITICAL(&g_layer_lock);
+	g_layer_requests[layer].pending = true;
+	g_layer_requests[layer].active = false;
+	portEXIT_CRITICAL(&g_layer_lock);
+}
+
+void rgb_led_wifi_app_started(void)
+{
+	rgb_led_layer_set(RGB_LED_LAYER_STATUS, LED_RULES_RGB(255, 45, 0), RGB_LED_STATUS_TIMEOUT_MS);
+}
+
+void rgb_led_http_server_started(void)
+{
+	rgb_led_layer_set(RGB_LED_LAYER_STATUS, LED_RULES_RGB(0, 170, 255), RGB_LED_STATUS_TIMEOUT_MS);
+}
+
+void rgb_led_wifi_connected(void)
+{
+	rgb_led_layer_set(RGB_LED_LAYER_STATUS, LED_RULES_RGB(0, 255, 0), RGB_LED_STATUS_TIMEOUT_MS);
+}
+
+void rgb_led_wifi_connect_failed(void)
+{
+	rgb_led_layer_set(RGB_LED_LAYER_ALARM, LED_RULES_RGB(255, 0, 0), RGB_LED_ALARM_TIMEOUT_MS);
 }
 
-void rgb_led_http_received(void)
+void rgb_led_ota_update_failed(void)
+{
+	rgb_led_layer_set(RGB_LED_LAYER_ALARM, LED_RULES_RGB(255, 0, 255), RGB_LED_ALARM_TIMEOUT_MS);
+}
+
+/**
+ * Applies the pending layer requests and drops layers whose timeout passed.
+ * @param layers layer states of the LED task.
+ */
+static void rgb_led_update_layers(rgb_led_layer_state_t *layers)
 {
-	double adc_value;
-	TemperatureValuesLed receivedData;
+	TickType_t now = xTaskGetTickCount();
 
-	if (g_pwm_init_handle == false)
+	portENTER_CRITICAL(&g_layer_lock);
+	for (int i = 0; i < RGB_LED_LAYER_TEMPERATURE; i++)
 	{
-		rgb_led_pwm_init();
+		rgb_led_layer_request_t *request = &g_layer_requests[i];
+
+		if (!request->pending)
+		{
+			continue;
+		}
+		request->pending = false;
+
+		layers[i].active = request->active;
+		if (request->active)
+		{
+			layers[i].rgb = request->rgb;
+			layers[i].expires = request->timeout_ms != 0;
+			layers[i].expiry = now + pdMS_TO_TICKS(request->timeout_ms);
+		}
 	}
+	portEXIT_CRITICAL(&g_layer_lock);
 
-	if (xQueueReceive(temperatureQueue, &receivedData, portMAX_DELAY) == pdPASS)
+	for (int i = 0; i < RGB_LED_LAYER_COUNT; i++)
 	{
-		printf("Received: %d\n", receivedData.r_value_first_led);
+		if (layers[i].active && layers[i].expires && (int32_t)(now - layers[i].expiry) >= 0)
+		{
+			layers[i].active = false;
+		}
 	}
-	// Attempt to receive the ADC value from the queue
-	while (true)
+}
+
+/**
+ * Color of the highest priority active layer. With none active the last
+ * status color stays, so the LED keeps showing the network state until there
+ * is a temperature to show.
+ */
+static uint32_t rgb_led_compose(const rgb_led_layer_state_t *layers)
+{
+	for (int i = 0; i < RGB_LED_LAYER_COUNT; i++)
 	{
-		if (xQueueReceive(ADC_QUEUE, &adc_value, portMAX_DELAY))
+		if (layers[i].active)
 		{
-			printf("Received in Led: %f\n", adc_value);
-			if (adc_value >= receivedData.high_temp_lvalue && adc_value <= receivedData.high_temp_uvalue)
-			{
-				rgb_led_set_color(receivedData.r_value_first_led, receivedData.g_value_first_led, receivedData.b_value_first_led);
-			}
-			else if (adc_value >= receivedData.medium_temp_lvalue && adc_value <= receivedData.medium_temp_uvalue)
+			return layers[i].rgb;
+		}
+	}
+
+	return layers[RGB_LED_LAYER_STATUS].rgb;
+}
+
+void rgb_led_set_rules(const led_rules_t *rules)
+{
+	led_rules_t *next = (g_rules_active == &g_rules[0]) ? &g_rules[1] : &g_rules[0];
+
+	// Single writer (the HTTP server task), the LED task only ever reads the active buffer.
+	// The generation moves after the swap, a reader that sees it also sees the new pointer.
+	*next = *rules;
+	__atomic_store_n(&g_rules_active, next, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&g_rules_generation, 1, __ATOMIC_ACQ_REL);
+}
+
+bool rgb_led_get_rules(led_rules_t *rules, uint32_t *generation)
+{
+	led_rules_t *active;
+	uint32_t gen;
+
+	do
+	{
+		gen = __atomic_load_n(&g_rules_generation, __ATOMIC_ACQUIRE);
+		if (gen == *generation)
+		{
+			return gen != 0;
+		}
+		active = __atomic_load_n(&g_rules_active, __ATOMIC_ACQUIRE);
+		*rules = *active;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		// A second update may have rewritten the buffer while it was copied
+	} while (__atomic_load_n(&g_rules_generation, __ATOMIC_RELAXED) != gen);
+
+	*generation = gen;
+
+	return true;
+}
+
+/**
+ * LED controller task, owns the PWM. Composes the alarm, status and
+ * temperature layers into one color and moves the LED to it.
+ * @param pvParameters parameter which can be passed to the task.
+ */
+static void rgb_led_task(void *pvParameters)
+{
+	led_rules_t *rules = &g_rules_local;
+	rgb_led_layer_state_t layers[RGB_LED_LAYER_COUNT] = {0};
+	uint32_t generation = 0;
+	uint32_t loaded;
+	int entry = -1;
+	uint32_t target = 0;
+	uint32_t shown = 0;
+	double temperature;
+
+	rgb_led_pwm_init();
+
+	for (;;)
+	{
+		bool sample = false;
+
+		if (target != shown && rgb_led_fading())
+		{
+			// A running fade cannot be retargeted, wait for its end callback. Samples wait in ADC_QUEUE meanwhile.
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RGB_LED_TASK_PERIOD_MS));
+		}
+		else if (ADC_QUEUE != NULL)
+		{
+			sample = xQueueReceive(ADC_QUEUE, &temperature, pdMS_TO_TICKS(RGB_LED_TASK_PERIOD_MS)) == pdTRUE;
+		}
+		else
+		{
+			// Sampling not configured yet
+			vTaskDelay(pdMS_TO_TICKS(RGB_LED_TASK_PERIOD_MS));
+		}
+
+		loaded = generation;
+		if (rgb_led_get_rules(rules, &generation))
+		{
+			if (generation != loaded)
 			{
-				rgb_led_set_color(receivedData.r_value_second_led, receivedData.g_value_second_led, receivedData.b_value_second_led);
+				// Entry indexes of the old table mean nothing in the new one
+				entry = -1;
 			}
-			else
+
+			// Nothing to do while the temperature stays in the same zone
+			int next = sample ? led_rules_lookup(rules, led_rules_to_tenths(temperature), entry) : entry;
+			if (next != entry)
 			{
-				rgb_led_set_color(receivedData.r_value_third_led, receivedData.g_value_third_led, receivedData.b_value_third_led);
+				entry = next;
+				layers[RGB_LED_LAYER_TEMPERATURE].active = true;
+				layers[RGB_LED_LAYER_TEMPERATURE].rgb = led_rules_color(rules, entry);
 			}
 		}
-		vTaskDelay(1);
+
+		rgb_led_update_layers(layers);
+		target = rgb_led_compose(layers);
+
+		// Only touch the LEDC registers when the color changes, colors that come
+		// and go during a transition are skipped, the latest one is shown after it
+		if (target != shown && !rgb_led_fading())
+		{
+			rgb_led_set_color(target, __atomic_load_n(&g_transition_ms, __ATOMIC_RELAXED));
+			shown = target;
+		}
+	}
+}
+
+void rgb_led_task_start(void)
+{
+	if (task_rgb_led != NULL)
+	{
+		return;
 	}
+
+	xTaskCreatePinnedToCore(&rgb_led_task, "rgb_led", RGB_LED_TASK_STACK_SIZE, NULL, RGB_LED_TASK_PRIORITY, &task_rgb_led, RGB_LED_TASK_CORE_ID);
+	metrics_register_task(task_rgb_led);
+	metrics_register("rgb_led_duty_writes_total", "LEDC channel duty updates", METRICS_TYPE_COUNTER, &g_duty_writes);
+
+	ESP_LOGI(TAG, "rgb_led_task_start: LED controller started");
 }
@@ -8,6 +8,10 @@
 #ifndef MAIN_RGB_LED_H_
 #define MAIN_RGB_LED_H_
 
+#include <stdint.h>
+
+#include "led_rules.h"
+
 // RGB LED GPIO
 #define RGB_LED_RED_GPIO 21
 #define RGB_LED_GREEN_GPIO 22
@@ -16,6 +20,43 @@
 // RGB LED color mix channels
 #define RGB_LED_CHANNEL_NUM 3
 
+// PWM timer, 13 bits at 5 kHz is well above visible flicker and within the 80 MHz LEDC clock (2^13 * 5 kHz)
+#define RGB_LED_PWM_RESOLUTION LEDC_TIMER_13_BIT
+#define RGB_LED_PWM_FREQ_HZ 5000
+#define RGB_LED_DUTY_MAX ((1 << 13) - 1)
+
+// Gamma of the color value to duty cycle curve
+#define RGB_LED_GAMMA 2.2f
+
+// Longest wait for a temperature sample, status colors are applied at least this often
+#define RGB_LED_TASK_PERIOD_MS 100
+
+// Default color transition time, faded by the LEDC hardware
+#define RGB_LED_TRANSITION_MS 300
+
+// Longest transition, samples queue up in ADC_QUEUE (10 x 100 ms) until it ends
+#define RGB_LED_TRANSITION_MAX_MS 800
+
+// A fade whose end callback has not come this long after its transition time is given up on
+#define RGB_LED_FADE_MARGIN_MS 100
+
+// Status colors are shown over the temperature for this long
+#define RGB_LED_STATUS_TIMEOUT_MS 3000
+
+// Alarm colors are shown over everything for this long
+#define RGB_LED_ALARM_TIMEOUT_MS 5000
+
+/**
+ * Composition layers, highest priority first
+ */
+typedef enum rgb_led_layer
+{
+	RGB_LED_LAYER_ALARM = 0, // Failures that need attention
+	RGB_LED_LAYER_STATUS,	 // Boot and network state
+	RGB_LED_LAYER_TEMPERATURE, // Color of the current temperature, from the rules
+	RGB_LED_LAYER_COUNT,
+} rgb_led_layer_e;
+
 // RGB LED configuration
 typedef struct
 {
@@ -26,24 +67,53 @@ typedef struct
 } ledc_info_t;
 // ledc_info_t ledc_ch[RGB_LED_CHANNEL_NUM]; Move this declaration to the top of rgb_led.c to avoid linker errors
 
-typedef struct TemperatureValuesLed
-{
-	int high_temp_lvalue;
-	int high_temp_uvalue;
-	int medium_temp_lvalue;
-	int medium_temp_uvalue;
-	int low_temp_lvalue;
-	int low_temp_uvalue;
-	int r_value_first_led;
-	int g_value_first_led;
-	int b_value_first_led;
-	int r_value_second_led;
-	int g_value_second_led;
-	int b_value_second_led;
-	int r_value_third_led;
-	int g_value_third_led;
-	int b_value_third_led;
-} TemperatureValuesLed;
+/**
+ * Starts the LED controller task, the only code that drives the PWM.
+ * Status colors and temperature rules are handed to it without blocking the caller.
+ */
+void rgb_led_task_start(void);
+
+/**
+ * Publishes new temperature rules to the LED controller task. The rules are
+ * copied into the inactive half of a double buffer and made current with an
+ * atomic pointer swap, so the caller never waits for the LED task.
+ * Until the first call the LED shows the status colors.
+ * @param rules compiled temperature zones and their colors.
+ */
+void rgb_led_set_rules(const led_rules_t *rules);
+
+/**
+ * Copies the current temperature rules if they changed since the last copy.
+ * Safe from any task, the copy is retried if it raced with an update.
+ * @param rules local copy, updated in place.
+ * @param generation generation of the local copy, updated in place, 0 before the first call.
+ * @return true if temperature rules have been published.
+ */
+bool rgb_led_get_rules(led_rules_t *rules, uint32_t *generation);
+
+/**
+ * Sets the duration of the following color transitions. They run in the LEDC
+ * fade engine without waking the CPU, a color that changes again before a
+ * transition ends is applied when it ends.
+ * @param fade_ms transition time, 0 switches instantly, limited to RGB_LED_TRANSITION_MAX_MS.
+ */
+void rgb_led_set_transition_time(uint32_t fade_ms);
+
+/**
+ * Shows a color on a layer. The LED shows the highest priority active layer
+ * and registers are only written when a channel changes.
+ * @param layer RGB_LED_LAYER_ALARM or RGB_LED_LAYER_STATUS, the temperature layer follows the rules.
+ * @param rgb packed 0xRRGGBB color.
+ * @param timeout_ms time until the layer is dropped again, 0 keeps it until rgb_led_layer_clear.
+ */
+void rgb_led_layer_set(rgb_led_layer_e layer, uint32_t rgb, uint32_t timeout_ms);
+
+/**
+ * Drops a layer, the layer below shows through.
+ * @param layer RGB_LED_LAYER_ALARM or RGB_LED_LAYER_STATUS.
+ */
+void rgb_led_layer_clear(rgb_led_layer_e layer);
+
 /**
  * Color to indicate WiFi application has started.
  */
@@ -59,6 +129,14 @@ void rgb_led_http_server_started(void);
  */
 void rgb_led_wifi_connected(void);
 
-void rgb_led_http_received(void);
+/**
+ * Alarm color to indicate that connecting to an access point failed.
+ */
+void rgb_led_wifi_connect_failed(void);
+
+/**
+ * Alarm color to indicate that a firmware update failed.
+ */
+void rgb_led_ota_update_failed(void);
 
 #endif /* MAIN_RGB_LED_H_ */
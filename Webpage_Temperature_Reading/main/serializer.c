@@ -0,0 +1,395 @@
+/*
+ * serializer.c
+ *
+ *  Response serializer with JSON and CBOR backends. Numbers are formatted
+ *  with integer arithmetic only, no printf.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "http_request.h"
+#include "serializer.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "serializer";
+
+// CBOR major types
+#define CBOR_UINT 0x00
+#define CBOR_NEGINT 0x20
+#define CBOR_TEXT 0x60
+#define CBOR_ARRAY 0x80
+#define CBOR_MAP 0xa0
+#define CBOR_INDEFINITE 0x1f
+#define CBOR_FALSE 0xf4
+#define CBOR_TRUE 0xf5
+#define CBOR_NULL 0xf6
+#define CBOR_FLOAT32 0xfa
+#define CBOR_BREAK 0xff
+
+static const uint32_t serializer_pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+static void serializer_put(serializer_t *s, const void *data, size_t len)
+{
+	if (s->overflow || len > s->size - s->len)
+	{
+		s->overflow = true;
+		return;
+	}
+
+	memcpy(s->buf + s->len, data, len);
+	s->len += len;
+}
+
+static void serializer_put_byte(serializer_t *s, uint8_t byte)
+{
+	serializer_put(s, &byte, 1);
+}
+
+/**
+ * Writes the decimal digits of value.
+ */
+static void serializer_put_decimal(serializer_t *s, uint64_t value)
+{
+	char digits[20];
+	int i = sizeof(digits);
+
+	do
+	{
+		digits[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value > 0);
+
+	serializer_put(s, digits + i, sizeof(digits) - i);
+}
+
+/**
+ * Writes a CBOR head: major type plus argument in the shortest encoding.
+ */
+static void serializer_cbor_head(serializer_t *s, uint8_t major, uint64_t arg)
+{
+	uint8_t head[9];
+	int n;
+
+	if (arg < 24)
+	{
+		head[0] = major | arg;
+		n = 1;
+	}
+	else if (arg <= UINT8_MAX)
+	{
+		head[0] = major | 24;
+		head[1] = arg;
+		n = 2;
+	}
+	else if (arg <= UINT16_MAX)
+	{
+		head[0] = major | 25;
+		head[1] = arg >> 8;
+		head[2] = arg;
+		n = 3;
+	}
+	else if (arg <= UINT32_MAX)
+	{
+		head[0] = major | 26;
+		for (int i = 0; i < 4; i++)
+		{
+			head[1 + i] = arg >> (24 - 8 * i);
+		}
+		n = 5;
+	}
+	else
+	{
+		head[0] = major | 27;
+		for (int i = 0; i < 8; i++)
+		{
+			head[1 + i] = arg >> (56 - 8 * i);
+		}
+		n = 9;
+	}
+
+	serializer_put(s, head, n);
+}
+
+/**
+ * JSON: writes the separator before a new element.
+ */
+static void serializer_json_separator(serializer_t *s)
+{
+	if (s->after_key)
+	{
+		s->after_key = false;
+		return;
+	}
+
+	if (s->need_comma[s->depth])
+	{
+		serializer_put_byte(s, ',');
+	}
+	s->need_comma[s->depth] = true;
+}
+
+static void serializer_begin(serializer_t *s, char json_open, uint8_t cbor_major)
+{
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		serializer_put_byte(s, cbor_major | CBOR_INDEFINITE);
+	}
+	else
+	{
+		serializer_json_separator(s);
+		serializer_put_byte(s, json_open);
+	}
+
+	if (s->depth < SERIALIZER_MAX_DEPTH)
+	{
+		s->depth++;
+		s->need_comma[s->depth] = false;
+	}
+	else
+	{
+		ESP_LOGE(TAG, "serializer_begin: nesting too deep");
+		s->overflow = true;
+	}
+}
+
+static void serializer_end(serializer_t *s, char json_close)
+{
+	serializer_put_byte(s, (s->format == SERIALIZER_FORMAT_CBOR) ? CBOR_BREAK : json_close);
+	if (s->depth > 0)
+	{
+		s->depth--;
+	}
+}
+
+serializer_format_e serializer_negotiate(httpd_req_t *req)
+{
+	char accept[SERIALIZER_ACCEPT_MAX_LEN];
+	esp_err_t err;
+
+	// A longer header arrives cut but NUL terminated, CBOR is still found in its first part
+	err = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+	if ((err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && strstr(accept, "application/cbor") != NULL)
+	{
+		return SERIALIZER_FORMAT_CBOR;
+	}
+
+	return SERIALIZER_FORMAT_JSON;
+}
+
+void serializer_init(serializer_t *s, serializer_format_e format, uint8_t *buf, size_t size)
+{
+	memset(s, 0x00, sizeof(serializer_t));
+	s->format = format;
+	s->buf = buf;
+	s->size = size;
+}
+
+void serializer_begin_map(serializer_t *s)
+{
+	serializer_begin(s, '{', CBOR_MAP);
+}
+
+void serializer_end_map(serializer_t *s)
+{
+	serializer_end(s, '}');
+}
+
+void serializer_begin_array(serializer_t *s)
+{
+	serializer_begin(s, '[', CBOR_ARRAY);
+}
+
+void serializer_end_array(serializer_t *s)
+{
+	serializer_end(s, ']');
+}
+
+void serializer_key(serializer_t *s, const char *key)
+{
+	serializer_string(s, key);
+	if (s->format == SERIALIZER_FORMAT_JSON)
+	{
+		serializer_put_byte(s, ':');
+		s->after_key = true;
+	}
+}
+
+void serializer_uint(serializer_t *s, uint64_t value)
+{
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		serializer_cbor_head(s, CBOR_UINT, value);
+		return;
+	}
+
+	serializer_json_separator(s);
+	serializer_put_decimal(s, value);
+}
+
+void serializer_int(serializer_t *s, int64_t value)
+{
+	if (value >= 0)
+	{
+		serializer_uint(s, value);
+		return;
+	}
+
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		// Negative integers are encoded as -1 - n
+		serializer_cbor_head(s, CBOR_NEGINT, (uint64_t)(-(value + 1)));
+		return;
+	}
+
+	serializer_json_separator(s);
+	serializer_put_byte(s, '-');
+	serializer_put_decimal(s, (uint64_t)(-(value + 1)) + 1);
+}
+
+void serializer_bool(serializer_t *s, bool value)
+{
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		serializer_put_byte(s, value ? CBOR_TRUE : CBOR_FALSE);
+		return;
+	}
+
+	serializer_json_separator(s);
+	if (value)
+	{
+		serializer_put(s, "true", 4);
+	}
+	else
+	{
+		serializer_put(s, "false", 5);
+	}
+}
+
+void serializer_string(serializer_t *s, const char *value)
+{
+	size_t len = strlen(value);
+
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		serializer_cbor_head(s, CBOR_TEXT, len);
+		serializer_put(s, value, len);
+		return;
+	}
+
+	serializer_json_separator(s);
+	serializer_put_byte(s, '"');
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t c = value[i];
+
+		if (c == '"' || c == '\\')
+		{
+			serializer_put_byte(s, '\\');
+			serializer_put_byte(s, c);
+		}
+		else if (c < 0x20)
+		{
+			static const char hex[] = "0123456789abcdef";
+			char escape[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+
+			serializer_put(s, escape, sizeof(escape));
+		}
+		else
+		{
+			serializer_put_byte(s, c);
+		}
+	}
+	serializer_put_byte(s, '"');
+}
+
+void serializer_float(serializer_t *s, float value, int decimals)
+{
+	if (s->format == SERIALIZER_FORMAT_CBOR)
+	{
+		uint32_t bits;
+
+		if (!isfinite(value))
+		{
+			serializer_put_byte(s, CBOR_NULL);
+			return;
+		}
+		memcpy(&bits, &value, sizeof(bits));
+		serializer_put_byte(s, CBOR_FLOAT32);
+		serializer_put_byte(s, bits >> 24);
+		serializer_put_byte(s, bits >> 16);
+		serializer_put_byte(s, bits >> 8);
+		serializer_put_byte(s, bits);
+		return;
+	}
+
+	char text[SERIALIZER_FLOAT_MAX_LEN];
+
+	serializer_json_separator(s);
+	serializer_put(s, text, serializer_format_float(text, value, decimals));
+}
+
+size_t serializer_format_float(char *buf, float value, int decimals)
+{
+	char digits[20];
+	size_t len = 0;
+	int i = sizeof(digits);
+
+	if (!isfinite(value) || fabsf(value) >= 1e12f)
+	{
+		memcpy(buf, "null", 5);
+		return 4;
+	}
+
+	decimals = (decimals < 0) ? 0 : (decimals > 6) ? 6 : decimals;
+
+	// Round once in fixed point, then print the integer and fraction parts
+	uint32_t scale = serializer_pow10[decimals];
+	bool negative = value < 0;
+	uint64_t fixed = (uint64_t)((negative ? -value : value) * scale + 0.5f);
+	uint64_t whole = fixed / scale;
+
+	if (negative && fixed > 0)
+	{
+		buf[len++] = '-';
+	}
+	do
+	{
+		digits[--i] = '0' + whole % 10;
+		whole /= 10;
+	} while (whole > 0);
+	memcpy(buf + len, digits + i, sizeof(digits) - i);
+	len += sizeof(digits) - i;
+
+	if (decimals > 0)
+	{
+		uint32_t rest = fixed % scale;
+
+		buf[len] = '.';
+		for (int d = decimals; d > 0; d--)
+		{
+			buf[len + d] = '0' + rest % 10;
+			rest /= 10;
+		}
+		len += decimals + 1;
+	}
+	buf[len] = '\0';
+
+	return len;
+}
+
+esp_err_t serializer_send(httpd_req_t *req, serializer_t *s)
+{
+	if (s->overflow)
+	{
+		ESP_LOGE(TAG, "serializer_send: response larger than %u bytes", (unsigned int)s->size);
+		return httpd_resp_send_500(req);
+	}
+
+	httpd_resp_set_type(req, (s->format == SERIALIZER_FORMAT_CBOR) ? "application/cbor" : "application/json");
+	httpd_resp_set_hdr(req, "Vary", "Accept");
+
+	return http_request_send(req, (const char *)s->buf, s->len);
+}
@@ -0,0 +1,110 @@
+/*
+ * serializer.h
+ *
+ *  Response serializer with JSON and CBOR (RFC 8949) backends, chosen per
+ *  request from the Accept header. Handlers describe the document once and
+ *  the backend encodes it into a caller provided buffer.
+ */
+
+#ifndef MAIN_SERIALIZER_H_
+#define MAIN_SERIALIZER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_http_server.h"
+
+// Maximum nesting of maps and arrays
+#define SERIALIZER_MAX_DEPTH 4
+
+// Size of the Accept header buffer, a longer header is searched up to this length
+#define SERIALIZER_ACCEPT_MAX_LEN 128
+
+// Buffer size for serializer_format_float: sign, 12 integer digits, point, 6 decimals and NUL
+#define SERIALIZER_FLOAT_MAX_LEN 24
+
+/**
+ * Output formats
+ */
+typedef enum serializer_format
+{
+	SERIALIZER_FORMAT_JSON = 0,
+	SERIALIZER_FORMAT_CBOR,
+} serializer_format_e;
+
+/**
+ * Serializer state
+ */
+typedef struct serializer
+{
+	serializer_format_e format;
+	uint8_t *buf;
+	size_t size;
+	size_t len;
+	bool overflow;
+	int depth;
+	bool need_comma[SERIALIZER_MAX_DEPTH + 1]; // JSON: an element was already written at this depth
+	bool after_key;							   // JSON: the next value belongs to a key
+} serializer_t;
+
+/**
+ * Picks the output format from the request's Accept header, CBOR if application/cbor is accepted, JSON otherwise.
+ * @param req HTTP request.
+ * @return output format.
+ */
+serializer_format_e serializer_negotiate(httpd_req_t *req);
+
+/**
+ * Initializes a serializer writing into buf.
+ */
+void serializer_init(serializer_t *s, serializer_format_e format, uint8_t *buf, size_t size);
+
+/**
+ * Opens and closes maps and arrays, CBOR uses indefinite length containers.
+ */
+void serializer_begin_map(serializer_t *s);
+void serializer_end_map(serializer_t *s);
+void serializer_begin_array(serializer_t *s);
+void serializer_end_array(serializer_t *s);
+
+/**
+ * Writes a map key, the next call writes its value.
+ */
+void serializer_key(serializer_t *s, const char *key);
+
+/**
+ * Values.
+ */
+void serializer_int(serializer_t *s, int64_t value);
+void serializer_uint(serializer_t *s, uint64_t value);
+void serializer_bool(serializer_t *s, bool value);
+void serializer_string(serializer_t *s, const char *value);
+
+/**
+ * Writes a float, JSON prints it with a fixed number of decimals, CBOR stores a single precision float.
+ * @param s serializer.
+ * @param value value, NaN and infinities are written as null.
+ * @param decimals JSON decimals (0 - 6).
+ */
+void serializer_float(serializer_t *s, float value, int decimals);
+
+/**
+ * Formats a float with a fixed number of decimals in integer arithmetic, the
+ * JSON text of serializer_float without the cost of printf("%f").
+ * @param buf destination, SERIALIZER_FLOAT_MAX_LEN bytes, NUL terminated.
+ * @param value value, NaN, infinities and magnitudes from 1e12 give "null".
+ * @param decimals decimals (0 - 6).
+ * @return length of the text.
+ */
+size_t serializer_format_float(char *buf, float value, int decimals);
+
+/**
+ * Sends the document with the matching Content-Type, or a 500 if it did not fit in the buffer.
+ * @param req HTTP request.
+ * @param s serializer.
+ * @return result of the send.
+ */
+esp_err_t serializer_send(httpd_req_t *req, serializer_t *s);
+
+#endif /* MAIN_SERIALIZER_H_ */
@@ -0,0 +1,187 @@
+/*
+ * strip_display.c
+ *
+ *  Temperature display on an addressable WS2812 strip driven by the RMT
+ *  peripheral through espressif/led_strip. A low priority task renders a frame
+ *  at a fixed rate from the ADC snapshot and history rollups, colors every
+ *  pixel with the LED rules posted to /tempRange.json, and only sends the
+ *  frame to the strip when it differs from the one shown.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "led_strip.h"
+#include "sdkconfig.h"
+
+#include "adc.h"
+#include "led_rules.h"
+#include "metrics.h"
+#include "rgb_led.h"
+#include "strip_display.h"
+#include "tasks_common.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "strip_display";
+
+#if CONFIG_STRIP_DISPLAY_NUM_LEDS > STRIP_DISPLAY_MAX_LEDS
+#error "CONFIG_STRIP_DISPLAY_NUM_LEDS is larger than STRIP_DISPLAY_MAX_LEDS"
+#endif
+
+// Frame period of the display task
+#define STRIP_DISPLAY_FRAME_MS (1000 / CONFIG_STRIP_DISPLAY_FPS)
+
+// RMT tick resolution, 10 MHz gives the 0.1 us steps of the WS2812 timing
+#define STRIP_DISPLAY_RMT_RESOLUTION_HZ (10 * 1000 * 1000)
+
+// Strip device
+static led_strip_handle_t strip_display_handle = NULL;
+
+// Rules used for the pixel colors, only touched by the display task. Until
+// rules are posted a blue to red gradient over the bar range is used.
+static led_rules_t strip_display_rules;
+static uint32_t strip_display_generation = 0;
+
+// Frames sent to the strip, unchanged frames are skipped
+static volatile uint32_t strip_display_refreshes = 0;
+
+// Display task handle
+static TaskHandle_t task_strip_display = NULL;
+
+/**
+ * Compiles the gradient used until temperature rules are posted.
+ */
+static void strip_display_default_rules(void)
+{
+	const led_rules_point_t points[] = {
+		{CONFIG_STRIP_DISPLAY_BAR_MIN * 10, LED_RULES_RGB(0, 0, 255)},
+		{(CONFIG_STRIP_DISPLAY_BAR_MIN + CONFIG_STRIP_DISPLAY_BAR_MAX) * 5, LED_RULES_RGB(0, 255, 0)},
+		{CONFIG_STRIP_DISPLAY_BAR_MAX * 10, LED_RULES_RGB(255, 0, 0)},
+	};
+
+	led_rules_compile_gradient(&strip_display_rules, points, sizeof(points) / sizeof(points[0]));
+}
+
+/**
+ * Color of a temperature under the current rules, scaled to the configured brightness.
+ */
+static uint32_t strip_display_color(double temperature)
+{
+	uint32_t rgb = led_rules_color(&strip_display_rules, led_rules_lookup(&strip_display_rules, led_rules_to_tenths(temperature), -1));
+	uint32_t r = ((rgb >> 16) & 0xFF) * CONFIG_STRIP_DISPLAY_BRIGHTNESS / 100;
+	uint32_t g = ((rgb >> 8) & 0xFF) * CONFIG_STRIP_DISPLAY_BRIGHTNESS / 100;
+	uint32_t b = (rgb & 0xFF) * CONFIG_STRIP_DISPLAY_BRIGHTNESS / 100;
+
+	return LED_RULES_RGB(r, g, b);
+}
+
+#if CONFIG_STRIP_DISPLAY_MODE_BAR
+/**
+ * Bar graph of the filtered temperature over CONFIG_STRIP_DISPLAY_BAR_MIN to
+ * CONFIG_STRIP_DISPLAY_BAR_MAX, every lit pixel in the color of the temperature it stands for.
+ */
+static void strip_display_render(uint32_t *frame)
+{
+	adc_snapshot_t snapshot;
+	double step = (double)(CONFIG_STRIP_DISPLAY_BAR_MAX - CONFIG_STRIP_DISPLAY_BAR_MIN) / CONFIG_STRIP_DISPLAY_NUM_LEDS;
+
+	adc_get_snapshot(&snapshot);
+
+	for (int i = 0; i < CONFIG_STRIP_DISPLAY_NUM_LEDS; i++)
+	{
+		double pixel = CONFIG_STRIP_DISPLAY_BAR_MIN + step * i;
+
+		frame[i] = (snapshot.samples > 0 && snapshot.filtered >= pixel) ? strip_display_color(pixel + step / 2) : 0;
+	}
+}
+#else
+/**
+ * Heatmap of the history, one bucket mean per pixel, the newest at the end of the strip.
+ */
+static void strip_display_render(uint32_t *frame)
+{
+	static adc_history_bucket_t history[CONFIG_STRIP_DISPLAY_NUM_LEDS];
+	int count = adc_get_history(history, CONFIG_STRIP_DISPLAY_NUM_LEDS);
+	int first = CONFIG_STRIP_DISPLAY_NUM_LEDS - count;
+
+	for (int i = 0; i < CONFIG_STRIP_DISPLAY_NUM_LEDS; i++)
+	{
+		frame[i] = (i >= first) ? strip_display_color(history[i - first].mean) : 0;
+	}
+}
+#endif
+
+/**
+ * Display task, renders at CONFIG_STRIP_DISPLAY_FPS and sends changed frames to the strip.
+ * @param pvParameters parameter which can be passed to the task.
+ */
+static void strip_display_task(void *pvParameters)
+{
+	static uint32_t frame[CONFIG_STRIP_DISPLAY_NUM_LEDS];
+	static uint32_t shown[CONFIG_STRIP_DISPLAY_NUM_LEDS];
+	TickType_t wake = xTaskGetTickCount();
+
+	strip_display_default_rules();
+
+	for (;;)
+	{
+		// Fixed rate, a slow frame shortens the next wait instead of shifting the schedule
+		vTaskDelayUntil(&wake, pdMS_TO_TICKS(STRIP_DISPLAY_FRAME_MS));
+
+		rgb_led_get_rules(&strip_display_rules, &strip_display_generation);
+		strip_display_render(frame);
+
+		if (memcmp(frame, shown, sizeof(frame)) == 0)
+		{
+			continue;
+		}
+
+		for (int i = 0; i < CONFIG_STRIP_DISPLAY_NUM_LEDS; i++)
+		{
+			led_strip_set_pixel(strip_display_handle, i, (frame[i] >> 16) & 0xFF, (frame[i] >> 8) & 0xFF, frame[i] & 0xFF);
+		}
+
+		// Waits for the RMT transfer, only this task ever does
+		if (led_strip_refresh(strip_display_handle) == ESP_OK)
+		{
+			memcpy(shown, frame, sizeof(frame));
+			strip_display_refreshes++;
+		}
+	}
+}
+
+void strip_display_start(void)
+{
+	esp_err_t err;
+
+	if (task_strip_display != NULL)
+	{
+		return;
+	}
+
+	led_strip_config_t strip_config = {
+		.strip_gpio_num = CONFIG_STRIP_DISPLAY_GPIO,
+		.max_leds = CONFIG_STRIP_DISPLAY_NUM_LEDS,
+		.led_pixel_format = LED_PIXEL_FORMAT_GRB,
+		.led_model = LED_MODEL_WS2812,
+	};
+	led_strip_rmt_config_t rmt_config = {
+		.resolution_hz = STRIP_DISPLAY_RMT_RESOLUTION_HZ,
+	};
+
+	err = led_strip_new_rmt_device(&strip_config, &rmt_config, &strip_display_handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "strip_display_start: unable to create the strip device (%s)", esp_err_to_name(err));
+		return;
+	}
+	led_strip_clear(strip_display_handle);
+
+	xTaskCreatePinnedToCore(&strip_display_task, "strip_display", STRIP_DISPLAY_TASK_STACK_SIZE, NULL, STRIP_DISPLAY_TASK_PRIORITY, &task_strip_display, STRIP_DISPLAY_TASK_CORE_ID);
+	metrics_register_task(task_strip_display);
+	metrics_register("strip_display_refreshes_total", "Frames sent to the LED strip", METRICS_TYPE_COUNTER, &strip_display_refreshes);
+
+	ESP_LOGI(TAG, "strip_display_start: %d LEDs on GPIO %d at %d fps", CONFIG_STRIP_DISPLAY_NUM_LEDS, CONFIG_STRIP_DISPLAY_GPIO, CONFIG_STRIP_DISPLAY_FPS);
+}
@@ -0,0 +1,20 @@
+/*
+ * strip_display.h
+ *
+ *  Temperature display on an addressable WS2812 strip, as a bar graph of the
+ *  current temperature or a heatmap of the recent history.
+ */
+
+#ifndef MAIN_STRIP_DISPLAY_H_
+#define MAIN_STRIP_DISPLAY_H_
+
+// Largest strip, one pixel per history bucket in heatmap mode
+#define STRIP_DISPLAY_MAX_LEDS 64
+
+/**
+ * Creates the RMT strip device and starts the frame task. Rendering and the
+ * RMT transfer only run in that task, callers never wait for the strip.
+ */
+void strip_display_start(void);
+
+#endif /* MAIN_STRIP_DISPLAY_H_ */
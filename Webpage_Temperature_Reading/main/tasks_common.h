@@ -17,10 +17,26 @@
 #define HTTP_SERVER_TASK_STACK_SIZE 8192
 #define HTTP_SERVER_TASK_PRIORITY 4
 #define HTTP_SERVER_TASK_CORE_ID 0
+#define HTTP_SERVER_TLS_TASK_STACK_SIZE 12288
 
 // HTTP Server Monitor task
 #define HTTP_SERVER_MONITOR_STACK_SIZE 4096
 #define HTTP_SERVER_MONITOR_PRIORITY 3
 #define HTTP_SERVER_MONITOR_CORE_ID 0
 
+// OTA flash writer task, only runs during a firmware update
+#define OTA_WRITER_TASK_STACK_SIZE 4096
+#define OTA_WRITER_TASK_PRIORITY 5
+#define OTA_WRITER_TASK_CORE_ID 1
+
+// RGB LED controller task
+#define RGB_LED_TASK_STACK_SIZE 2048
+#define RGB_LED_TASK_PRIORITY 3
+#define RGB_LED_TASK_CORE_ID 1
+
+// LED strip display task
+#define STRIP_DISPLAY_TASK_STACK_SIZE 3072
+#define STRIP_DISPLAY_TASK_PRIORITY 2
+#define STRIP_DISPLAY_TASK_CORE_ID 1
+
 #endif /* MAIN_TASKS_COMMON_H_ */
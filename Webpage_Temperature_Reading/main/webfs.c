@@ -0,0 +1,266 @@
+/*
+ * webfs.c
+ *
+ *  Serves the web page from a read-only image on the "www" partition instead of
+ *  files linked into the app. The partition is memory mapped once, files are
+ *  found with a single probe of the perfect hash table built by tools/mkwebfs.py
+ *  and sent straight from flash, already gzip compressed. New images are
+ *  written through the OTA flash writer, so the page can be updated without
+ *  a firmware update.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "mbedtls/sha256.h"
+
+#include "ota_writer.h"
+#include "webfs.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "webfs";
+
+// Length of the SHA-256 that follows the image
+#define WEBFS_HASH_LEN 32
+
+// File served for "/" and other directory paths
+#define WEBFS_INDEX_NAME "index.html"
+
+// Mapped image, only touched from the HTTP server task
+static const esp_partition_t *webfs_partition = NULL;
+static esp_partition_mmap_handle_t webfs_mmap_handle;
+static const uint8_t *webfs_image = NULL;
+static const webfs_header_t *webfs_header = NULL;
+static const webfs_entry_t *webfs_table = NULL;
+
+/**
+ * FNV-1a over len bytes, continuing from h. Must match fnv1a() in mkwebfs.py.
+ */
+static uint32_t webfs_hash(uint32_t h, const char *s, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (uint8_t)s[i];
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+/**
+ * Checks that a NUL terminated string at offset lies inside the image.
+ */
+static bool webfs_string_valid(uint32_t offset, uint32_t image_len)
+{
+	return offset > 0 && offset < image_len && memchr(webfs_image + offset, '\0', image_len - offset) != NULL;
+}
+
+/**
+ * Checks the header, every table slot and the SHA-256 of the mapped image.
+ */
+static esp_err_t webfs_validate(void)
+{
+	const webfs_header_t *header = (const webfs_header_t *)webfs_image;
+	uint8_t sha256[WEBFS_HASH_LEN];
+	uint32_t table_end;
+
+	if (header->magic != WEBFS_MAGIC || header->version != WEBFS_VERSION)
+	{
+		ESP_LOGW(TAG, "webfs_validate: no image on partition %s", webfs_partition->label);
+		return ESP_ERR_INVALID_VERSION;
+	}
+
+	table_end = sizeof(webfs_header_t) + (uint32_t)header->table_size * sizeof(webfs_entry_t);
+	if (header->table_size == 0 || (header->table_size & (header->table_size - 1)) != 0 ||
+		header->image_len < table_end || header->image_len > webfs_partition->size - WEBFS_HASH_LEN)
+	{
+		ESP_LOGE(TAG, "webfs_validate: bad header");
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	mbedtls_sha256(webfs_image, header->image_len, sha256, 0);
+	if (memcmp(sha256, webfs_image + header->image_len, WEBFS_HASH_LEN) != 0)
+	{
+		ESP_LOGE(TAG, "webfs_validate: SHA-256 mismatch");
+		return ESP_ERR_INVALID_CRC;
+	}
+
+	// Checked once here so lookups can trust the table
+	const webfs_entry_t *table = (const webfs_entry_t *)(webfs_image + sizeof(webfs_header_t));
+	for (int i = 0; i < header->table_size; i++)
+	{
+		if (table[i].path_offset == 0)
+		{
+			continue;
+		}
+		if (!webfs_string_valid(table[i].path_offset, header->image_len) ||
+			!webfs_string_valid(table[i].type_offset, header->image_len) ||
+			table[i].data_offset > header->image_len || table[i].data_len > header->image_len - table[i].data_offset)
+		{
+			ESP_LOGE(TAG, "webfs_validate: slot %d is out of bounds", i);
+			return ESP_ERR_INVALID_SIZE;
+		}
+	}
+
+	return ESP_OK;
+}
+
+esp_err_t webfs_mount(void)
+{
+	const void *ptr;
+	esp_err_t err;
+
+	if (webfs_image != NULL)
+	{
+		return ESP_OK;
+	}
+
+	webfs_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WEBFS_PARTITION_LABEL);
+	if (webfs_partition == NULL)
+	{
+		ESP_LOGE(TAG, "webfs_mount: no %s partition", WEBFS_PARTITION_LABEL);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	// Files are sent from the mapping, no copy to RAM
+	err = esp_partition_mmap(webfs_partition, 0, webfs_partition->size, ESP_PARTITION_MMAP_DATA, &ptr, &webfs_mmap_handle);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "webfs_mount: mmap failed (%s)", esp_err_to_name(err));
+		return err;
+	}
+	webfs_image = ptr;
+
+	err = webfs_validate();
+	if (err != ESP_OK)
+	{
+		webfs_unmount();
+		return err;
+	}
+
+	webfs_header = (const webfs_header_t *)webfs_image;
+	webfs_table = (const webfs_entry_t *)(webfs_image + sizeof(webfs_header_t));
+
+	ESP_LOGI(TAG, "webfs_mount: %u files, %lu bytes", webfs_header->num_files, (unsigned long)webfs_header->image_len);
+
+	return ESP_OK;
+}
+
+void webfs_unmount(void)
+{
+	if (webfs_image != NULL)
+	{
+		esp_partition_munmap(webfs_mmap_handle);
+	}
+	webfs_image = NULL;
+	webfs_header = NULL;
+	webfs_table = NULL;
+}
+
+bool webfs_is_mounted(void)
+{
+	return webfs_header != NULL;
+}
+
+bool webfs_find(const char *path, webfs_file_t *file)
+{
+	const webfs_entry_t *entry;
+	const char *stored;
+	size_t len = strcspn(path, "?");
+	bool index = (len == 0 || path[len - 1] == '/');
+	uint32_t h;
+
+	if (webfs_header == NULL)
+	{
+		return false;
+	}
+
+	// Directory paths hash as if index.html were appended, without copying the path
+	h = webfs_hash(0x811C9DC5 ^ webfs_header->seed, path, len);
+	if (index)
+	{
+		h = webfs_hash(h, WEBFS_INDEX_NAME, strlen(WEBFS_INDEX_NAME));
+	}
+
+	entry = &webfs_table[h & (webfs_header->table_size - 1)];
+	if (entry->path_offset == 0)
+	{
+		return false;
+	}
+
+	// A perfect hash only separates the stored paths, anything else still needs the compare
+	stored = (const char *)webfs_image + entry->path_offset;
+	if (strncmp(stored, path, len) != 0 || strcmp(stored + len, index ? WEBFS_INDEX_NAME : "") != 0)
+	{
+		return false;
+	}
+
+	file->data = webfs_image + entry->data_offset;
+	file->len = entry->data_len;
+	file->content_type = (const char *)webfs_image + entry->type_offset;
+	file->etag = entry->etag;
+	file->gzip = (entry->flags & WEBFS_FLAG_GZIP) != 0;
+	file->is_template = (entry->flags & WEBFS_FLAG_TEMPLATE) != 0;
+
+	return true;
+}
+
+esp_err_t webfs_update_begin(size_t image_size)
+{
+	esp_err_t err;
+
+	if (webfs_partition == NULL)
+	{
+		webfs_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, WEBFS_PARTITION_LABEL);
+		if (webfs_partition == NULL)
+		{
+			ESP_LOGE(TAG, "webfs_update_begin: no %s partition", WEBFS_PARTITION_LABEL);
+			return ESP_ERR_NOT_FOUND;
+		}
+	}
+
+	if (image_size > webfs_partition->size)
+	{
+		ESP_LOGE(TAG, "webfs_update_begin: image of %u bytes does not fit in %s", (unsigned int)image_size, webfs_partition->label);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// The mapping must not be read while the partition is rewritten
+	webfs_unmount();
+
+	// Not an app image, the writer checks the SHA-256 mkwebfs.py appends
+	err = ota_writer_start(webfs_partition, false);
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "webfs_update_begin: unable to start the flash writer (%s)", esp_err_to_name(err));
+		webfs_mount();
+	}
+
+	return err;
+}
+
+esp_err_t webfs_update_write(const uint8_t *data, size_t len)
+{
+	return ota_writer_write(data, len);
+}
+
+esp_err_t webfs_update_end(void)
+{
+	esp_err_t err;
+
+	err = ota_writer_finish();
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "webfs_update_end: image rejected (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	return webfs_mount();
+}
+
+void webfs_update_abort(void)
+{
+	ota_writer_abort();
+	ESP_LOGW(TAG, "webfs_update_abort: %s holds no valid image until the next upload", WEBFS_PARTITION_LABEL);
+}
@@ -0,0 +1,117 @@
+/*
+ * webfs.h
+ *
+ *  Read-only web asset store on the "www" partition, built by tools/mkwebfs.py.
+ */
+
+#ifndef MAIN_WEBFS_H_
+#define MAIN_WEBFS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Label of the data partition holding the image
+#define WEBFS_PARTITION_LABEL "www"
+
+// "WEBF" read as a little endian word
+#define WEBFS_MAGIC 0x46424557
+#define WEBFS_VERSION 1
+
+// File is stored gzip compressed
+#define WEBFS_FLAG_GZIP 0x0001
+// File holds index_render placeholders, stored uncompressed
+#define WEBFS_FLAG_TEMPLATE 0x0002
+
+/**
+ * Image header, at offset 0 of the partition
+ */
+typedef struct webfs_header
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t num_files;
+	uint16_t table_size; // Power of two
+	uint16_t reserved;
+	uint32_t seed;		 // Perfect hash seed found by mkwebfs.py
+	uint32_t image_len;	 // Bytes covered by the SHA-256 that follows the image
+} webfs_header_t;
+
+/**
+ * Hash table slot, path_offset is 0 for an empty slot. Offsets are from the start of the image.
+ */
+typedef struct webfs_entry
+{
+	uint32_t path_offset;
+	uint32_t type_offset;
+	uint32_t data_offset;
+	uint32_t data_len;
+	uint32_t etag;
+	uint16_t flags;
+	uint16_t reserved;
+} webfs_entry_t;
+
+/**
+ * File found by webfs_find, pointers stay valid until webfs_unmount
+ */
+typedef struct webfs_file
+{
+	const uint8_t *data;
+	size_t len;
+	const char *content_type;
+	uint32_t etag;
+	bool gzip;
+	bool is_template;
+} webfs_file_t;
+
+/**
+ * Maps the www partition and validates the image.
+ * @return ESP_OK, ESP_ERR_NOT_FOUND without a www partition, or ESP_ERR_INVALID_VERSION / ESP_ERR_INVALID_CRC for a missing or damaged image.
+ */
+esp_err_t webfs_mount(void);
+
+/**
+ * Unmaps the partition, pointers returned by webfs_find become invalid.
+ */
+void webfs_unmount(void);
+
+/**
+ * @return true if an image is mounted.
+ */
+bool webfs_is_mounted(void);
+
+/**
+ * Looks a file up in the perfect hash table.
+ * @param path request path, "/" and paths ending in "/" resolve to index.html. Anything from a '?' on is ignored.
+ * @param file filled in when the file exists.
+ * @return true if the file exists.
+ */
+bool webfs_find(const char *path, webfs_file_t *file);
+
+/**
+ * Unmounts the image and starts writing a new one to the partition.
+ * @param image_size image size, 0 if unknown.
+ * @return ESP_OK, or an error if the partition is missing, too small or the writer cannot start.
+ */
+esp_err_t webfs_update_begin(size_t image_size);
+
+/**
+ * Writes the next part of the uploaded image.
+ * @return ESP_OK, or the flash error.
+ */
+esp_err_t webfs_update_write(const uint8_t *data, size_t len);
+
+/**
+ * Checks the image SHA-256 and mounts the new image.
+ * @return ESP_OK, or the error that rejected the image.
+ */
+esp_err_t webfs_update_end(void);
+
+/**
+ * Stops the upload, the partition is left without a valid image.
+ */
+void webfs_update_abort(void);
+
+#endif /* MAIN_WEBFS_H_ */
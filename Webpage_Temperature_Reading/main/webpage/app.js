@@ -3,12 +3,13 @@
  */
 var seconds = null;
 var otaTimerVar = null;
-var wifiConnectInterval = null;
+var wifiConnectPending = false;
 
 /**
  * Initialize functions here.
  */
 $(document).ready(function () {
+  getUpdateStatus();
   $("#connect_wifi").on("click", function () {
     checkCredentials();
   });
@@ -43,6 +44,8 @@ function updateFirmware() {
     var request = new XMLHttpRequest();
 
     request.upload.addEventListener("progress", updateProgress);
+    request.addEventListener("load", getUpdateStatus);
+    request.addEventListener("error", getUpdateStatus);
     request.open("POST", "/OTAupdate");
     request.responseType = "blob";
     request.send(formData);
@@ -52,13 +55,42 @@ function updateFirmware() {
 }
 
 /**
- * Progress on transfers from the server to the client (downloads).
+ * Progress of the upload, the device writes each chunk to flash as it arrives.
  */
 function updateProgress(oEvent) {
   if (oEvent.lengthComputable) {
-    getUpdateStatus();
-  } else {
-    window.alert("total size is unknown");
+    var percent = Math.floor((oEvent.loaded * 100) / oEvent.total);
+    document.getElementById("ota_update_status").innerHTML =
+      "Firmware Update in Progress... " + percent + "%";
+  }
+}
+
+/**
+ * Gets the firmware update status and the running firmware's compile date and time.
+ */
+function getUpdateStatus() {
+  var xhr = new XMLHttpRequest();
+  var requestURL = "/OTAstatus";
+  xhr.open("POST", requestURL, false);
+  xhr.send("ota_update_status");
+
+  if (xhr.readyState == 4 && xhr.status == 200) {
+    var response = JSON.parse(xhr.responseText);
+
+    document.getElementById("latest_firmware").innerHTML =
+      response.compile_date + " - " + response.compile_time;
+
+    // If flashing was complete it will return a 1, else -1
+    // A return of 0 is just for information on the Latest Firmware request
+    if (response.ota_update_status == 1) {
+      // Set the countdown timer time
+      seconds = 10;
+      // Start the countdown timer
+      otaRebootTimer();
+    } else if (response.ota_update_status == -1) {
+      document.getElementById("ota_update_status").innerHTML =
+        "!!! Upload Error !!!";
+    }
   }
 }
 
@@ -78,109 +110,83 @@ function otaRebootTimer() {
   }
 }
 
-function updateADCValue() {
-  fetch("/adc_value")
+/**
+ * Updates the temperature reading and its indicator dot.
+ */
+function updateTemperature(value) {
+  document.getElementById("adcValue").innerText = value;
+
+  // Define your range
+  let lowerLimit = 0;
+  let upperLimit = 30;
+
+  // Get the element you want to change the color of
+  let element = document.getElementById("dot");
+
+  // Check if value is within range
+  if (value >= lowerLimit && value <= upperLimit) {
+    // Change color to green if within range
+    element.style.backgroundColor = "green";
+  } else if (value > upperLimit) {
+    // Change color to red if out of range
+    element.style.backgroundColor = "red";
+  } else {
+    element.style.backgroundColor = "blue";
+  }
+}
+
+/**
+ * Fetches the aggregated device state (temperature, WiFi status and time) in one request.
+ */
+function updateTelemetry() {
+  fetch("/telemetry")
     .then((response) => {
       if (!response.ok) {
         throw new Error("Network response was not ok " + response.statusText);
       }
-      return response.text();
+      return response.json();
     })
     .then((data) => {
-      console.log("ADC Value:", data); // Logging ADC value to the console
-      document.getElementById("adcValue").innerText = data;
-
-      let value = parseInt(data);
-
-      // Define your range
-      let lowerLimit = 0;
-      let upperLimit = 30;
-
-      // Get the element you want to change the color of
-      let element = document.getElementById("dot");
-
-      // Check if value is within range
-      if (value >= lowerLimit && value <= upperLimit) {
-        // Change color to green if within range
-        element.style.backgroundColor = "green";
-      } else if (value > upperLimit) {
-        // Change color to red if out of range
-        element.style.backgroundColor = "red";
-      } else {
-        element.style.backgroundColor = "blue";
+      if (data.samples > 0) {
+        updateTemperature(parseInt(data.temp));
+      }
+      updateWifiConnectStatus(data.wifi_connect_status);
+
+      if (data.time != "") {
+        document.getElementById("ntp_time").innerText = data.time;
+        document.getElementById("ntp_time").style.display = "block";
       }
     })
     .catch((error) => {
       console.error("There was a problem with the fetch operation:", error);
     });
 }
-// Update every 2 seconds
-setInterval(updateADCValue, 500);
+// Update every 500 milliseconds
+setInterval(updateTelemetry, 500);
 
 /**
- * Clears the connection status interval.
+ * Updates the WiFi connection status while a connection attempt is pending.
  */
-function stopWifiConnectStatusInterval() {
-  if (wifiConnectInterval != null) {
-    clearInterval(wifiConnectInterval);
-    wifiConnectInterval = null;
+function updateWifiConnectStatus(status) {
+  if (!wifiConnectPending) {
+    return;
   }
-}
 
-/**
- * Gets the WiFi connection status.
- */
-function getWifiConnectStatus() {
-  var xhr = new XMLHttpRequest();
-  var requestURL = "/wifiConnectStatus";
-  xhr.open("POST", requestURL, false);
-  xhr.send("wifi_connect_status");
-
-  if (xhr.readyState == 4 && xhr.status == 200) {
-    var response = JSON.parse(xhr.responseText);
-
-    document.getElementById("wifi_connect_status").innerHTML = "Conectando...";
-
-    if (response.wifi_connect_status == 2) {
-      document.getElementById("wifi_connect_status").innerHTML =
-        "<h4 class='rd'>Failed to Connect. Please check your AP credentials and compatibility</h4>";
-      stopWifiConnectStatusInterval();
-    } else if (response.wifi_connect_status == 3) {
-      document.getElementById("wifi_connect_status").innerHTML =
-        "Conexión Exitosa";
-      document.getElementById("WiFiForm").style.display = "none";
-      document.getElementById("dot_wifi").style.display = "block";
-
-      fetch("/ntp_value")
-        .then((response) => {
-          if (!response.ok) {
-            throw new Error(
-              "Network response was not ok " + response.statusText
-            );
-          }
-          return response.text();
-        })
-        .then((data) => {
-          console.log("Ntp value:", data);
-          document.getElementById("ntp_time").innerText = data;
-          document.getElementById("ntp_time").style.display = "block";
-        })
-        .catch((error) => {
-          console.error("There was a problem with the fetch operation:", error);
-        });
-
-      stopWifiConnectStatusInterval();
-    }
+  document.getElementById("wifi_connect_status").innerHTML = "Conectando...";
+
+  if (status == 2) {
+    document.getElementById("wifi_connect_status").innerHTML =
+      "<h4 class='rd'>Failed to Connect. Please check your AP credentials and compatibility</h4>";
+    wifiConnectPending = false;
+  } else if (status == 3) {
+    document.getElementById("wifi_connect_status").innerHTML =
+      "Conexión Exitosa";
+    document.getElementById("WiFiForm").style.display = "none";
+    document.getElementById("dot_wifi").style.display = "block";
+    wifiConnectPending = false;
   }
 }
 
-/**
- * Starts the interval for checking the connection status.
- */
-function startWifiConnectStatusInterval() {
-  wifiConnectInterval = setInterval(getWifiConnectStatus, 2800);
-}
-
 /**
  * Connect WiFi function called using the SSID and password entered into the text fields.
  */
@@ -228,7 +234,7 @@ function connectWifi() {
     },
   });
 
-  startWifiConnectStatusInterval();
+  wifiConnectPending = true;
 }
 
 /**
@@ -11,6 +11,8 @@
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "lwip/netdb.h"
 
@@ -19,6 +21,8 @@
 #include "tasks_common.h"
 #include "wifi_app.h"
 #include "ntp.h"
+#include "metrics.h"
+#include "wifi_store.h"
 
 // Tag used for ESP serial console messages
 static const char TAG[] = "wifi_app";
@@ -26,8 +30,86 @@ static const char TAG[] = "wifi_app";
 // Used for returning the WiFi configuration
 wifi_config_t *wifi_config = NULL;
 
-// Used to track the number for retries when a connection attempt fails
-static int g_retry_number;
+/**
+ * Station connection state, only changed by the WiFi application task
+ */
+typedef enum wifi_app_sta_state
+{
+	WIFI_APP_STA_IDLE = 0, // No credentials, given up, or disconnected by the user
+	WIFI_APP_STA_CONNECTING,
+	WIFI_APP_STA_CONNECTED,
+	WIFI_APP_STA_BACKOFF, // Waiting for the reconnect timer
+} wifi_app_sta_state_e;
+
+/**
+ * Groups of disconnect reasons sharing a reconnection policy
+ */
+typedef enum wifi_app_reconnect_group
+{
+	WIFI_APP_RECONNECT_LINK_LOST = 0,
+	WIFI_APP_RECONNECT_NO_AP,
+	WIFI_APP_RECONNECT_AUTH,
+	WIFI_APP_RECONNECT_AP_BUSY,
+	WIFI_APP_RECONNECT_LEFT,
+	WIFI_APP_RECONNECT_OTHER,
+	WIFI_APP_RECONNECT_GROUP_COUNT,
+} wifi_app_reconnect_group_e;
+
+/**
+ * Reconnection policy of a group
+ */
+typedef struct wifi_app_reconnect_policy
+{
+	const char *name; // Label of the disconnect counter
+	uint32_t base_ms; // Delay before the first reconnection, 0 for none
+	uint32_t max_ms;  // Longest delay
+} wifi_app_reconnect_policy_t;
+
+// Indexed by wifi_app_reconnect_group_e
+static const wifi_app_reconnect_policy_t wifi_app_reconnect_policies[WIFI_APP_RECONNECT_GROUP_COUNT] = {
+	{"link_lost", 100, 30000}, // Beacons or keepalives stopped, usually back quickly
+	{"no_ap", 1000, 60000},	   // AP rebooting or out of range
+	{"auth", 2000, 60000},	   // Handshake failed, wrong password or a struggling AP
+	{"ap_busy", 5000, 120000}, // Association refused, hammering makes it worse
+	{"left", 0, 0},			   // The station left on purpose, never scheduled
+	{"other", 500, 60000},
+};
+
+// State of the station, the attempt counters cover the current outage
+static wifi_app_sta_state_e g_sta_state = WIFI_APP_STA_IDLE;
+static uint32_t g_sta_attempts;
+static uint32_t g_sta_auth_failures;
+static uint32_t g_sta_backoff_ms;
+
+// Set while an ASSOC_LEAVE caused by the task itself is still to come
+static bool g_sta_leave_expected;
+
+// Set once the credentials got an IP, rejected credentials are only retried forever after that
+static bool g_sta_verified;
+
+// Reason of the latest disconnect handled, exported to the metrics
+static uint8_t g_sta_disconnect_reason;
+
+// Fires WIFI_APP_MSG_STA_RECONNECT at the end of a backoff delay
+static esp_timer_handle_t wifi_app_reconnect_timer = NULL;
+
+// Set while the radio runs the SoftAP next to the station
+static bool g_ap_enabled = true;
+
+// Fires WIFI_APP_MSG_AP_POLICY when the SoftAP is due to be switched off or back on
+static esp_timer_handle_t wifi_app_ap_timer = NULL;
+
+// Total number of reconnection attempts since boot, exported to the metrics
+static uint32_t g_reconnect_count;
+
+// Disconnects since boot per reconnection group, exported to the metrics
+static uint32_t g_disconnect_count[WIFI_APP_RECONNECT_GROUP_COUNT];
+
+// Set while the station config targets the saved BSSID and channel instead of scanning
+static volatile bool g_sta_directed;
+
+// Milliseconds from boot to the first IP address, exported to the metrics
+static uint32_t g_connect_time_ms;
 
 // Queue handle used to manipulate the main queue of events
 static QueueHandle_t wifi_app_queue_handle;
@@ -36,6 +118,19 @@ static QueueHandle_t wifi_app_queue_handle;
 esp_netif_t *esp_netif_sta = NULL;
 esp_netif_t *esp_netif_ap = NULL;
 
+/**
+ * Sends WIFI_APP_MSG_STA_DISCONNECTED carrying the reason, every queued
+ * disconnect is handled with its own reason.
+ * @param reason wifi_err_reason_t of the event.
+ */
+static BaseType_t wifi_app_send_sta_disconnected(uint8_t reason)
+{
+	wifi_app_queue_message_t msg;
+	msg.msgID = WIFI_APP_MSG_STA_DISCONNECTED;
+	msg.reason = reason;
+	return xQueueSend(wifi_app_queue_handle, &msg, portMAX_DELAY);
+}
+
 /**
  * WiFi application event handler
  * @param arg data, aside from event data, that is passed to the handler when it is called
@@ -75,21 +170,9 @@ static void wifi_app_event_handler(void *arg, esp_event_base_t event_base, int32
 			break;
 
 		case WIFI_EVENT_STA_DISCONNECTED:
-			ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED");
-
-			wifi_event_sta_disconnected_t *wifi_event_sta_disconnected = (wifi_event_sta_disconnected_t *)malloc(sizeof(wifi_event_sta_disconnected_t));
-			*wifi_event_sta_disconnected = *((wifi_event_sta_disconnected_t *)event_data);
-			printf("WIFI_EVENT_STA_DISCONNECTED, reason code %d\n", wifi_event_sta_disconnected->reason);
-
-			if (g_retry_number < MAX_CONNECTION_RETRIES)
-			{
-				esp_wifi_connect();
-				g_retry_number++;
-			}
-			else
-			{
-				wifi_app_send_message(WIFI_APP_MSG_STA_DISCONNECTED);
-			}
+			// Only the reason is passed on, the WiFi task decides what to do with it
+			ESP_LOGI(TAG, "WIFI_EVENT_STA_DISCONNECTED, reason code %d", ((wifi_event_sta_disconnected_t *)event_data)->reason);
+			wifi_app_send_sta_disconnected(((wifi_event_sta_disconnected_t *)event_data)->reason);
 
 			break;
 		}
@@ -179,15 +262,350 @@ wifi_config_t *wifi_app_get_wifi_config(void)
 	return wifi_config;
 }
 
+int8_t wifi_app_get_rssi(void)
+{
+	wifi_ap_record_t wifi_data;
+
+	// Not associated with an access point
+	if (esp_wifi_sta_get_ap_info(&wifi_data) != ESP_OK)
+	{
+		return 0;
+	}
+
+	return wifi_data.rssi;
+}
+
+/**
+ * Makes the station scan every channel for the SSID, for new credentials or
+ * when the saved access point could not be reached.
+ */
+static void wifi_app_sta_scan_all(void)
+{
+	g_sta_directed = false;
+	wifi_config->sta.bssid_set = false;
+	wifi_config->sta.channel = 0;
+	wifi_config->sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+}
+
+/**
+ * @return true while the station is associated with an AP.
+ */
+static bool wifi_app_sta_associated(void)
+{
+	wifi_ap_record_t ap_info;
+
+	return esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK;
+}
+
 /**
  * Connects the ESP32 to an external AP using the updated station configuration
+ * and starts a new outage count, for new credentials or the saved ones.
  */
 static void wifi_app_connect_sta(void)
 {
+	esp_timer_stop(wifi_app_reconnect_timer);
+	g_sta_state = WIFI_APP_STA_CONNECTING;
+	g_sta_attempts = 0;
+	g_sta_auth_failures = 0;
+	g_sta_backoff_ms = 0;
+
+	// A new config makes an associated station leave its AP first
+	g_sta_leave_expected = g_sta_leave_expected || wifi_app_sta_associated();
+
 	ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, wifi_app_get_wifi_config()));
 	ESP_ERROR_CHECK(esp_wifi_connect());
 }
 
+/**
+ * Reconnect timer callback, runs in the esp_timer task.
+ */
+static void wifi_app_reconnect_timer_callback(void *arg)
+{
+	wifi_app_send_message(WIFI_APP_MSG_STA_RECONNECT);
+}
+
+/**
+ * Maps a disconnect reason to its reconnection group.
+ */
+static wifi_app_reconnect_group_e wifi_app_reconnect_group(uint8_t reason)
+{
+	switch (reason)
+	{
+	case WIFI_REASON_BEACON_TIMEOUT:
+	case WIFI_REASON_AUTH_EXPIRE:
+	case WIFI_REASON_ASSOC_EXPIRE:
+	case WIFI_REASON_AP_TSF_RESET:
+	case WIFI_REASON_ROAMING:
+		return WIFI_APP_RECONNECT_LINK_LOST;
+
+	case WIFI_REASON_NO_AP_FOUND:
+		return WIFI_APP_RECONNECT_NO_AP;
+
+	case WIFI_REASON_AUTH_FAIL:
+	case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+	case WIFI_REASON_HANDSHAKE_TIMEOUT:
+	case WIFI_REASON_MIC_FAILURE:
+	case WIFI_REASON_802_1X_AUTH_FAILED:
+		return WIFI_APP_RECONNECT_AUTH;
+
+	case WIFI_REASON_ASSOC_TOOMANY:
+	case WIFI_REASON_ASSOC_FAIL:
+		return WIFI_APP_RECONNECT_AP_BUSY;
+
+	case WIFI_REASON_ASSOC_LEAVE:
+		return WIFI_APP_RECONNECT_LEFT;
+
+	default:
+		return WIFI_APP_RECONNECT_OTHER;
+	}
+}
+
+/**
+ * Backoff delay before reconnection attempt number attempts + 1: the policy
+ * base doubled per failed attempt up to its maximum, minus a random part of up
+ * to WIFI_APP_RECONNECT_JITTER_PCT percent so that devices that lost the same
+ * AP do not come back in lockstep.
+ */
+static uint32_t wifi_app_reconnect_delay(const wifi_app_reconnect_policy_t *policy, uint32_t attempts)
+{
+	uint32_t delay = policy->max_ms;
+
+	if (attempts < 16 && (policy->base_ms << attempts) < policy->max_ms)
+	{
+		delay = policy->base_ms << attempts;
+	}
+
+	return delay - esp_random() % (delay * WIFI_APP_RECONNECT_JITTER_PCT / 100 + 1);
+}
+
+/**
+ * Handles a station disconnect: falls back from the saved access point to a
+ * full scan, schedules the next attempt after the backoff of the reason's
+ * policy, or gives up on credentials that were rejected and never connected.
+ * @param reason wifi_err_reason_t of the disconnect.
+ */
+static void wifi_app_sta_disconnected(uint8_t reason)
+{
+	wifi_app_reconnect_group_e group = wifi_app_reconnect_group(reason);
+	const wifi_app_reconnect_policy_t *policy;
+
+	g_sta_disconnect_reason = reason;
+
+	if (group == WIFI_APP_RECONNECT_LEFT)
+	{
+		if (g_sta_state == WIFI_APP_STA_IDLE || g_sta_leave_expected)
+		{
+			// The task's own esp_wifi_set_config or esp_wifi_disconnect, nothing to recover from
+			g_sta_leave_expected = false;
+			g_disconnect_count[group]++;
+			return;
+		}
+
+		// Sent by the AP, a lost link like any other
+		group = WIFI_APP_RECONNECT_OTHER;
+	}
+	policy = &wifi_app_reconnect_policies[group];
+	g_disconnect_count[group]++;
+
+	// Nothing to do when disconnected on purpose, or for a second event of an attempt already handled
+	if (g_sta_state == WIFI_APP_STA_IDLE || g_sta_state == WIFI_APP_STA_BACKOFF)
+	{
+		return;
+	}
+
+	if (g_sta_directed)
+	{
+		// The saved access point moved or is gone, scan for the SSID right away
+		ESP_LOGI(TAG, "Saved access point not reachable (reason %d), scanning", reason);
+		wifi_app_sta_scan_all();
+		wifi_app_connect_sta();
+		return;
+	}
+
+	g_sta_attempts++;
+	if (group == WIFI_APP_RECONNECT_AUTH && !g_sta_verified && ++g_sta_auth_failures >= WIFI_APP_AUTH_RETRIES)
+	{
+		ESP_LOGW(TAG, "Credentials rejected %lu times, not reconnecting", (unsigned long)g_sta_auth_failures);
+		g_sta_state = WIFI_APP_STA_IDLE;
+		http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
+		return;
+	}
+
+	// The page is told once per outage, reconnection goes on in the background
+	if (g_sta_attempts == MAX_CONNECTION_RETRIES)
+	{
+		http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
+	}
+
+	g_sta_backoff_ms = wifi_app_reconnect_delay(policy, g_sta_attempts - 1);
+	g_sta_state = WIFI_APP_STA_BACKOFF;
+	ESP_ERROR_CHECK(esp_timer_start_once(wifi_app_reconnect_timer, (uint64_t)g_sta_backoff_ms * 1000));
+
+	ESP_LOGI(TAG, "Reconnecting in %lu ms (reason %d, %s, attempt %lu)", (unsigned long)g_sta_backoff_ms, reason, policy->name, (unsigned long)g_sta_attempts);
+}
+
+/**
+ * Reconnects at the end of a backoff delay.
+ */
+static void wifi_app_sta_reconnect(void)
+{
+	esp_err_t err;
+
+	if (g_sta_state != WIFI_APP_STA_BACKOFF)
+	{
+		return;
+	}
+
+	g_reconnect_count++;
+	g_sta_state = WIFI_APP_STA_CONNECTING;
+	err = esp_wifi_connect();
+	if (err != ESP_OK)
+	{
+		// Same delay again, a driver refusing to connect is not worth escalating for
+		ESP_LOGW(TAG, "esp_wifi_connect failed (%s)", esp_err_to_name(err));
+		g_sta_state = WIFI_APP_STA_BACKOFF;
+		ESP_ERROR_CHECK(esp_timer_start_once(wifi_app_reconnect_timer, (uint64_t)g_sta_backoff_ms * 1000));
+	}
+}
+
+/**
+ * SoftAP timer callback, runs in the esp_timer task.
+ */
+static void wifi_app_ap_timer_callback(void *arg)
+{
+	wifi_app_send_message(WIFI_APP_MSG_AP_POLICY);
+}
+
+/**
+ * Switches the SoftAP on (WIFI_MODE_APSTA) or off (WIFI_MODE_STA). The AP
+ * configuration and its static IP are kept by the driver and netif, and the
+ * station stays associated across the switch.
+ */
+static void wifi_app_ap_set_enabled(bool enabled)
+{
+	esp_err_t err = esp_wifi_set_mode(enabled ? WIFI_MODE_APSTA : WIFI_MODE_STA);
+
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "Unable to switch the SoftAP %s (%s)", enabled ? "on" : "off", esp_err_to_name(err));
+		return;
+	}
+	g_ap_enabled = enabled;
+
+	ESP_LOGI(TAG, "SoftAP %s", enabled ? "restored" : "switched off, station only");
+}
+
+/**
+ * Runs after every WiFi task message. A station with an IP and the SoftAP on
+ * gets the SoftAP switched off after WIFI_APP_AP_GRACE_MS, leaving time to
+ * read the new address on the page. A station without one and the SoftAP off
+ * gets it back after WIFI_APP_AP_RESTORE_MS, or right away when no station is
+ * left to wait for. The timer is only started when the condition starts to
+ * hold, so repeated disconnects during an outage do not postpone the restore.
+ * @param timer_fired the AP timer ran out.
+ */
+static void wifi_app_ap_policy(bool timer_fired)
+{
+	bool connected = (g_sta_state == WIFI_APP_STA_CONNECTED);
+
+	// Consistent: AP on without a station, or station only
+	if (connected != g_ap_enabled)
+	{
+		esp_timer_stop(wifi_app_ap_timer);
+		return;
+	}
+
+	if (timer_fired || (!connected && g_sta_state == WIFI_APP_STA_IDLE))
+	{
+		esp_timer_stop(wifi_app_ap_timer);
+		wifi_app_ap_set_enabled(!connected);
+	}
+	else if (!esp_timer_is_active(wifi_app_ap_timer))
+	{
+		ESP_ERROR_CHECK(esp_timer_start_once(wifi_app_ap_timer, (uint64_t)(connected ? WIFI_APP_AP_GRACE_MS : WIFI_APP_AP_RESTORE_MS) * 1000));
+	}
+}
+
+/**
+ * Exports the reconnection statistics.
+ */
+static void wifi_app_metrics_collector(metrics_writer_t *writer, void *arg)
+{
+	metrics_writer_family(writer, "wifi_disconnects_total", "Station disconnects per reconnection policy", METRICS_TYPE_COUNTER);
+	for (int i = 0; i < WIFI_APP_RECONNECT_GROUP_COUNT; i++)
+	{
+		metrics_writer_printf(writer, "wifi_disconnects_total{policy=\"%s\"} %lu\n", wifi_app_reconnect_policies[i].name, (unsigned long)g_disconnect_count[i]);
+	}
+
+	metrics_writer_family(writer, "wifi_reconnect_attempts", "Failed attempts in the current outage", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "wifi_reconnect_attempts %lu\n", (unsigned long)g_sta_attempts);
+
+	metrics_writer_family(writer, "wifi_reconnect_backoff_ms", "Latest reconnection delay", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "wifi_reconnect_backoff_ms %lu\n", (unsigned long)g_sta_backoff_ms);
+
+	metrics_writer_family(writer, "wifi_last_disconnect_reason", "Reason code of the latest disconnect", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "wifi_last_disconnect_reason %d\n", g_sta_disconnect_reason);
+
+	metrics_writer_family(writer, "wifi_softap_enabled", "1 while the SoftAP runs next to the station", METRICS_TYPE_GAUGE);
+	metrics_writer_printf(writer, "wifi_softap_enabled %d\n", g_ap_enabled ? 1 : 0);
+}
+
+/**
+ * Connects with the saved station, straight to the saved BSSID on the saved
+ * channel when they are known so no scan is needed.
+ * @return true if a station was saved.
+ */
+static bool wifi_app_connect_saved_sta(void)
+{
+	wifi_store_sta_t sta;
+
+	if (wifi_store_load(&sta) != ESP_OK || sta.ssid[0] == '\0')
+	{
+		return false;
+	}
+
+	memcpy(wifi_config->sta.ssid, sta.ssid, sizeof(sta.ssid));
+	memcpy(wifi_config->sta.password, sta.password, sizeof(sta.password));
+	wifi_app_sta_scan_all();
+	if (sta.channel != 0)
+	{
+		memcpy(wifi_config->sta.bssid, sta.bssid, sizeof(sta.bssid));
+		wifi_config->sta.bssid_set = true;
+		wifi_config->sta.channel = sta.channel;
+		wifi_config->sta.scan_method = WIFI_FAST_SCAN;
+		g_sta_directed = true;
+	}
+
+	ESP_LOGI(TAG, "Connecting to saved SSID %.*s%s", MAX_SSID_LENGTH, (const char *)sta.ssid, g_sta_directed ? " without scanning" : "");
+
+	// Saved only after getting an IP, so a rejection later is the AP's problem rather than a typo
+	g_sta_verified = true;
+	wifi_app_connect_sta();
+
+	return true;
+}
+
+/**
+ * Saves the credentials along with the BSSID and channel of the access point
+ * the station is connected to. Only written when something changed.
+ */
+static void wifi_app_save_sta(void)
+{
+	wifi_store_sta_t sta;
+	wifi_ap_record_t ap_info;
+
+	memset(&sta, 0x00, sizeof(sta));
+	memcpy(sta.ssid, wifi_config->sta.ssid, sizeof(sta.ssid));
+	memcpy(sta.password, wifi_config->sta.password, sizeof(sta.password));
+	if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK)
+	{
+		memcpy(sta.bssid, ap_info.bssid, sizeof(sta.bssid));
+		sta.channel = ap_info.primary;
+	}
+
+	wifi_store_save(&sta);
+}
+
 /**
  * Main task for the WiFi application
  * @param pvParameters parameter which can be passed to the task
@@ -205,11 +623,28 @@ static void wifi_app_task(void *pvParameters)
 	// SoftAP config
 	wifi_app_soft_ap_config();
 
+	// Reconnect timer
+	const esp_timer_create_args_t reconnect_timer_args = {
+		.callback = &wifi_app_reconnect_timer_callback,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "wifi_app_reconnect"};
+	ESP_ERROR_CHECK(esp_timer_create(&reconnect_timer_args, &wifi_app_reconnect_timer));
+
+	// SoftAP policy timer
+	const esp_timer_create_args_t ap_timer_args = {
+		.callback = &wifi_app_ap_timer_callback,
+		.arg = NULL,
+		.dispatch_method = ESP_TIMER_TASK,
+		.name = "wifi_app_ap"};
+	ESP_ERROR_CHECK(esp_timer_create(&ap_timer_args, &wifi_app_ap_timer));
+
 	// Start WiFi
 	ESP_ERROR_CHECK(esp_wifi_start());
 
-	// Send first event message
+	// Start the HTTP server, whose monitor reports the connection, then connect with the saved station
 	wifi_app_send_message(WIFI_APP_MSG_START_HTTP_SERVER);
+	wifi_app_send_message(WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS);
 
 	for (;;)
 	{
@@ -228,14 +663,49 @@ static void wifi_app_task(void *pvParameters)
 			case WIFI_APP_MSG_CONNECTING_FROM_HTTP_SERVER:
 				ESP_LOGI(TAG, "WIFI_APP_MSG_CONNECTING_FROM_HTTP_SERVER");
 
+				wifi_app_sta_scan_all();
+				g_sta_verified = false;
 				wifi_app_connect_sta();
-				g_retry_number = 0;
 				http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_INIT);
 
 				break;
 
+			case WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS:
+				ESP_LOGI(TAG, "WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS");
+
+				if (wifi_app_connect_saved_sta())
+				{
+					http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_INIT);
+				}
+
+				break;
+
+			case WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT:
+				ESP_LOGI(TAG, "WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT");
+
+				// No reconnection, and no automatic connection at the next boot
+				esp_timer_stop(wifi_app_reconnect_timer);
+				g_sta_state = WIFI_APP_STA_IDLE;
+				g_sta_directed = false;
+				g_sta_leave_expected = g_sta_leave_expected || wifi_app_sta_associated();
+				esp_wifi_disconnect();
+				wifi_store_clear();
+
+				break;
+
 			case WIFI_APP_MSG_STA_CONNECTED_GOT_IP:
 				ESP_LOGI(TAG, "WIFI_APP_MSG_STA_CONNECTED_GOT_IP");
+				if (g_connect_time_ms == 0)
+				{
+					g_connect_time_ms = esp_timer_get_time() / 1000;
+					ESP_LOGI(TAG, "Connected %lu ms after boot", (unsigned long)g_connect_time_ms);
+				}
+				g_sta_state = WIFI_APP_STA_CONNECTED;
+				g_sta_attempts = 0;
+				g_sta_auth_failures = 0;
+				g_sta_leave_expected = false;
+				g_sta_verified = true;
+				wifi_app_save_sta();
 				rgb_led_wifi_connected();
 				http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_SUCCESS);
 				break;
@@ -243,13 +713,27 @@ static void wifi_app_task(void *pvParameters)
 			case WIFI_APP_MSG_STA_DISCONNECTED:
 				ESP_LOGI(TAG, "WIFI_APP_MSG_STA_DISCONNECTED");
 
-				http_server_monitor_send_message(HTTP_MSG_WIFI_CONNECT_FAIL);
+				wifi_app_sta_disconnected(msg.reason);
 
 				break;
 
+			case WIFI_APP_MSG_STA_RECONNECT:
+				ESP_LOGI(TAG, "WIFI_APP_MSG_STA_RECONNECT");
+
+				wifi_app_sta_reconnect();
+
+				break;
+
+			case WIFI_APP_MSG_AP_POLICY:
+				ESP_LOGI(TAG, "WIFI_APP_MSG_AP_POLICY");
+				break;
+
 			default:
 				break;
 			}
+
+			// Every message may change the station state the SoftAP follows
+			wifi_app_ap_policy(msg.msgID == WIFI_APP_MSG_AP_POLICY);
 		}
 	}
 }
@@ -258,6 +742,7 @@ BaseType_t wifi_app_send_message(wifi_app_message_e msgID)
 {
 	wifi_app_queue_message_t msg;
 	msg.msgID = msgID;
+	msg.reason = 0;
 	return xQueueSend(wifi_app_queue_handle, &msg, portMAX_DELAY);
 }
 
@@ -276,8 +761,15 @@ void wifi_app_start(void)
 	memset(wifi_config, 0x00, sizeof(wifi_config_t));
 
 	// Create message queue
-	wifi_app_queue_handle = xQueueCreate(3, sizeof(wifi_app_queue_message_t));
+	wifi_app_queue_handle = xQueueCreate(4, sizeof(wifi_app_queue_message_t));
 
 	// Start the WiFi application task
-	xTaskCreatePinnedToCore(&wifi_app_task, "wifi_app_task", WIFI_APP_TASK_STACK_SIZE, NULL, WIFI_APP_TASK_PRIORITY, NULL, WIFI_APP_TASK_CORE_ID);
+	TaskHandle_t wifi_app_task_handle = NULL;
+	xTaskCreatePinnedToCore(&wifi_app_task, "wifi_app_task", WIFI_APP_TASK_STACK_SIZE, NULL, WIFI_APP_TASK_PRIORITY, &wifi_app_task_handle, WIFI_APP_TASK_CORE_ID);
+
+	// Export the reconnect counter and task stack usage
+	metrics_register("wifi_reconnects_total", "Station reconnection attempts", METRICS_TYPE_COUNTER, &g_reconnect_count);
+	metrics_register("wifi_connect_time_ms", "Milliseconds from boot to the first station IP address", METRICS_TYPE_GAUGE, &g_connect_time_ms);
+	metrics_register_collector(wifi_app_metrics_collector, NULL);
+	metrics_register_task(wifi_app_task_handle);
 }
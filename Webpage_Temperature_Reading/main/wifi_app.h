@@ -29,7 +29,17 @@ typedef void (*wifi_connected_event_callback_t)(void);
 #define WIFI_STA_POWER_SAVE WIFI_PS_NONE // Power save not used
 #define MAX_SSID_LENGTH 32				 // IEEE standard maximum
 #define MAX_PASSWORD_LENGTH 64			 // IEEE standard maximum
-#define MAX_CONNECTION_RETRIES 5		 // Retry number on disconnect
+#define MAX_CONNECTION_RETRIES 5		 // Failed reconnections before the page is told, retries go on
+
+// Station reconnection backoff, the delay doubles per failed attempt up to the
+// policy maximum and is then jittered down by up to half
+#define WIFI_APP_RECONNECT_JITTER_PCT 50
+#define WIFI_APP_AUTH_RETRIES 3 // Rejected credentials never connected are dropped after this many attempts
+
+// SoftAP policy: the access point is switched off this long after the station
+// got an IP, and back on when the station has been down this long
+#define WIFI_APP_AP_GRACE_MS 60000
+#define WIFI_APP_AP_RESTORE_MS 30000
 
 // netif object for the Station and Access Point
 extern esp_netif_t *esp_netif_sta;
@@ -47,6 +57,8 @@ typedef enum wifi_app_message
 	WIFI_APP_MSG_USER_REQUESTED_STA_DISCONNECT,
 	WIFI_APP_MSG_LOAD_SAVED_CREDENTIALS,
 	WIFI_APP_MSG_STA_DISCONNECTED,
+	WIFI_APP_MSG_STA_RECONNECT,
+	WIFI_APP_MSG_AP_POLICY,
 } wifi_app_message_e;
 
 /**
@@ -56,6 +68,7 @@ typedef enum wifi_app_message
 typedef struct wifi_app_queue_message
 {
 	wifi_app_message_e msgID;
+	uint8_t reason; // wifi_err_reason_t of WIFI_APP_MSG_STA_DISCONNECTED
 } wifi_app_queue_message_t;
 
 /**
@@ -0,0 +1,113 @@
+/*
+ * wifi_store.c
+ *
+ *  Persists the station in one versioned NVS blob. The last blob read or
+ *  written is kept in RAM so that saving an unchanged station, which happens
+ *  on every reconnection, costs no flash write.
+ */
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "wifi_store.h"
+
+// Tag used for ESP serial console messages
+static const char TAG[] = "wifi_store";
+
+// Blob layout: version, then the wifi_store_sta_t byte arrays in order
+#define WIFI_STORE_BLOB_LEN (1 + sizeof(wifi_store_sta_t))
+
+// Blob last read from or written to NVS, only used by the WiFi application task
+static uint8_t wifi_store_saved[WIFI_STORE_BLOB_LEN];
+static bool wifi_store_saved_valid = false;
+
+esp_err_t wifi_store_load(wifi_store_sta_t *sta)
+{
+	nvs_handle_t handle;
+	size_t len = sizeof(wifi_store_saved);
+	esp_err_t err;
+
+	err = nvs_open(WIFI_STORE_NVS_NAMESPACE, NVS_READONLY, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_get_blob(handle, WIFI_STORE_NVS_KEY, wifi_store_saved, &len);
+		nvs_close(handle);
+	}
+	if (err != ESP_OK)
+	{
+		// A namespace that was never written does not exist yet either
+		ESP_LOGI(TAG, "wifi_store_load: no saved station (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	if (len != WIFI_STORE_BLOB_LEN || wifi_store_saved[0] != WIFI_STORE_VERSION)
+	{
+		ESP_LOGW(TAG, "wifi_store_load: saved station ignored (version %d, %u bytes)", wifi_store_saved[0], (unsigned int)len);
+		return ESP_ERR_INVALID_VERSION;
+	}
+	wifi_store_saved_valid = true;
+
+	memcpy(sta, wifi_store_saved + 1, sizeof(*sta));
+
+	return ESP_OK;
+}
+
+esp_err_t wifi_store_save(const wifi_store_sta_t *sta)
+{
+	uint8_t blob[WIFI_STORE_BLOB_LEN];
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	blob[0] = WIFI_STORE_VERSION;
+	memcpy(blob + 1, sta, sizeof(*sta));
+
+	if (wifi_store_saved_valid && memcmp(blob, wifi_store_saved, sizeof(blob)) == 0)
+	{
+		return ESP_OK;
+	}
+
+	err = nvs_open(WIFI_STORE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_set_blob(handle, WIFI_STORE_NVS_KEY, blob, sizeof(blob));
+		if (err == ESP_OK)
+		{
+			err = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	if (err != ESP_OK)
+	{
+		ESP_LOGE(TAG, "wifi_store_save: unable to write (%s)", esp_err_to_name(err));
+		return err;
+	}
+
+	memcpy(wifi_store_saved, blob, sizeof(blob));
+	wifi_store_saved_valid = true;
+
+	ESP_LOGI(TAG, "wifi_store_save: station saved, channel %d", sta->channel);
+
+	return ESP_OK;
+}
+
+esp_err_t wifi_store_clear(void)
+{
+	nvs_handle_t handle;
+	esp_err_t err;
+
+	err = nvs_open(WIFI_STORE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+	if (err == ESP_OK)
+	{
+		err = nvs_erase_key(handle, WIFI_STORE_NVS_KEY);
+		if (err == ESP_OK)
+		{
+			err = nvs_commit(handle);
+		}
+		nvs_close(handle);
+	}
+	wifi_store_saved_valid = false;
+
+	return (err == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : err;
+}
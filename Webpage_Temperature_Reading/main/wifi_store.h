@@ -0,0 +1,55 @@
+/*
+ * wifi_store.h
+ *
+ *  Station credentials and the access point they last connected to, kept in
+ *  NVS so the station reconnects on boot without the web page.
+ */
+
+#ifndef MAIN_WIFI_STORE_H_
+#define MAIN_WIFI_STORE_H_
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "wifi_app.h"
+
+// NVS location of the station blob
+#define WIFI_STORE_NVS_NAMESPACE "wifi_store"
+#define WIFI_STORE_NVS_KEY "sta"
+
+// Blob layout version, a blob of another version is ignored
+#define WIFI_STORE_VERSION 1
+
+/**
+ * Saved station, the strings are NUL padded and not terminated at full length
+ */
+typedef struct wifi_store_sta
+{
+	uint8_t ssid[MAX_SSID_LENGTH];
+	uint8_t password[MAX_PASSWORD_LENGTH];
+	uint8_t bssid[6]; // Access point last connected to
+	uint8_t channel;  // Its channel, 0 if unknown
+} wifi_store_sta_t;
+
+/**
+ * Loads the saved station.
+ * @param sta destination.
+ * @return ESP_OK, ESP_ERR_NVS_NOT_FOUND if nothing was saved, or an error for an unreadable blob.
+ */
+esp_err_t wifi_store_load(wifi_store_sta_t *sta);
+
+/**
+ * Saves the station. Nothing is written when it matches the saved one, so it
+ * can be called on every connection.
+ * @param sta station to save.
+ * @return ESP_OK, or the NVS error.
+ */
+esp_err_t wifi_store_save(const wifi_store_sta_t *sta);
+
+/**
+ * Erases the saved station.
+ * @return ESP_OK, or the NVS error.
+ */
+esp_err_t wifi_store_clear(void);
+
+#endif /* MAIN_WIFI_STORE_H_ */
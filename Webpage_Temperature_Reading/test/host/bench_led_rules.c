@@ -0,0 +1,132 @@
+/*
+ * bench_led_rules.c
+ *
+ *  Host benchmark of the per sample LED rule lookup, with the three ranges
+ *  of the original page (scanned) and with 16 zones (binary searched),
+ *  against the three range if/else chain it replaced. Random temperatures
+ *  exercise the lookup, a slow drift the hint fast path.
+ *
+ *    gcc -O2 -Wall -Wextra -Itest/host/stubs -Imain test/host/bench_led_rules.c main/led_rules.c main/json_parser.c -o bench_led_rules && ./bench_led_rules
+ *
+ *  Run from Webpage_Temperature_Reading. Host timings only compare the two
+ *  approaches, they are not ESP32 cycle counts.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "led_rules.h"
+
+// Samples per run
+#define BENCH_SAMPLES 10000000
+
+// Ranges of the original three range page
+#define BENCH_HIGH_LOW 30
+#define BENCH_HIGH_HIGH 50
+#define BENCH_MEDIUM_LOW 10
+#define BENCH_MEDIUM_HIGH 29
+
+static double bench_samples[BENCH_SAMPLES];
+
+// Keeps the loops from being optimized away
+static volatile uint32_t bench_sink;
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Times the rule lookup over the samples.
+ * @return nanoseconds per sample.
+ */
+static double bench_rules(const led_rules_t *rules)
+{
+	uint32_t sink = 0;
+	int hint = -1;
+	double start = bench_now();
+
+	for (int i = 0; i < BENCH_SAMPLES; i++)
+	{
+		hint = led_rules_lookup(rules, led_rules_to_tenths(bench_samples[i]), hint);
+		sink += led_rules_color(rules, hint);
+	}
+	bench_sink = sink;
+
+	return (bench_now() - start) / BENCH_SAMPLES * 1e9;
+}
+
+/**
+ * Times the three range if/else chain over the samples.
+ * @return nanoseconds per sample.
+ */
+static double bench_branch(void)
+{
+	uint32_t sink = 0;
+	double start = bench_now();
+
+	for (int i = 0; i < BENCH_SAMPLES; i++)
+	{
+		double t = bench_samples[i];
+
+		if (t >= BENCH_HIGH_LOW && t <= BENCH_HIGH_HIGH)
+		{
+			sink += 1;
+		}
+		else if (t >= BENCH_MEDIUM_LOW && t <= BENCH_MEDIUM_HIGH)
+		{
+			sink += 2;
+		}
+		else
+		{
+			sink += 3;
+		}
+	}
+	bench_sink = sink;
+
+	return (bench_now() - start) / BENCH_SAMPLES * 1e9;
+}
+
+int main(void)
+{
+	static led_rules_t rules;
+	static led_rules_t ranges;
+	led_rules_zone_t zones[16];
+	const led_rules_zone_t range_zones[] = {
+		{BENCH_HIGH_LOW * 10, BENCH_HIGH_HIGH * 10 + 9, 1},
+		{BENCH_MEDIUM_LOW * 10, BENCH_MEDIUM_HIGH * 10 + 9, 2},
+	};
+	double drift = 20.0;
+
+	led_rules_compile(&ranges, range_zones, 2, 3);
+	for (int i = 0; i < 16; i++)
+	{
+		zones[i].low = -400 + i * 60;
+		zones[i].high = -400 + i * 60 + 59;
+		zones[i].rgb = i;
+	}
+	led_rules_compile(&rules, zones, 16, 99);
+
+	srand(1);
+	for (int i = 0; i < BENCH_SAMPLES; i++)
+	{
+		bench_samples[i] = -45 + (rand() % 1000) / 10.0;
+	}
+	printf("random: ranges %.1f ns/sample (%d entries), rules %.1f ns/sample (%d entries), branch %.1f ns/sample\n",
+		   bench_rules(&ranges), ranges.count, bench_rules(&rules), rules.count, bench_branch());
+
+	for (int i = 0; i < BENCH_SAMPLES; i++)
+	{
+		drift += (rand() % 3 - 1) * 0.05;
+		bench_samples[i] = drift;
+	}
+	printf("drift:  ranges %.1f ns/sample, rules %.1f ns/sample, branch %.1f ns/sample\n", bench_rules(&ranges), bench_rules(&rules), bench_branch());
+
+	return 0;
+}
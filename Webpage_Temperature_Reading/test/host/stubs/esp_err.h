@@ -0,0 +1,26 @@
+/*
+ * esp_err.h
+ *
+ *  Host stand-in for the ESP-IDF header, just the codes used by the modules
+ *  built on the host.
+ */
+
+#ifndef HOST_STUBS_ESP_ERR_H_
+#define HOST_STUBS_ESP_ERR_H_
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_INVALID_SIZE 0x104
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_NOT_SUPPORTED 0x106
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+#define ESP_ERR_INVALID_CRC 0x109
+#define ESP_ERR_INVALID_VERSION 0x10A
+
+#endif /* HOST_STUBS_ESP_ERR_H_ */
@@ -0,0 +1,197 @@
+/*
+ * test_led_rules.c
+ *
+ *  Host unit test of the LED rule tables and their JSON parsing. Zone tables
+ *  are checked against a brute force scan of the zones on random zone sets.
+ *
+ *    gcc -O2 -Wall -Wextra -Itest/host/stubs -Imain test/host/test_led_rules.c main/led_rules.c main/json_parser.c -o test_led_rules && ./test_led_rules
+ *
+ *  Run from Webpage_Temperature_Reading, exits non-zero on the first failure.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_parser.h"
+#include "led_rules.h"
+
+// Random zone sets compared with the brute force scan
+#define TEST_ZONE_SETS 20000
+
+#define CHECK(cond)                                                             \
+	do                                                                          \
+	{                                                                           \
+		if (!(cond))                                                            \
+		{                                                                       \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+			exit(1);                                                            \
+		}                                                                       \
+	} while (0)
+
+/**
+ * Color of a temperature as the zones define it: the first zone containing it wins.
+ */
+static uint32_t test_brute_force(const led_rules_zone_t *zones, int num_zones, int tenths, uint32_t default_rgb)
+{
+	for (int i = 0; i < num_zones; i++)
+	{
+		if (tenths >= zones[i].low && tenths <= zones[i].high)
+		{
+			return zones[i].rgb;
+		}
+	}
+
+	return default_rgb;
+}
+
+/**
+ * Random overlapping zone sets, every temperature looked up with and without a hint.
+ */
+static void test_zones(void)
+{
+	static led_rules_t rules;
+	led_rules_zone_t zones[LED_RULES_MAX_ZONES];
+	led_rules_zone_t bad = {10, 5, 0};
+
+	srand(1);
+	for (int set = 0; set < TEST_ZONE_SETS; set++)
+	{
+		int num_zones = rand() % (LED_RULES_MAX_ZONES + 1);
+		int hint = -1;
+
+		for (int i = 0; i < num_zones; i++)
+		{
+			int low = rand() % 2000 - 1000;
+			int high = low + rand() % 500;
+
+			zones[i].low = (rand() % 20 == 0) ? INT16_MIN : low;
+			zones[i].high = (rand() % 20 == 0) ? INT16_MAX : high;
+			zones[i].rgb = rand() % 4;
+		}
+
+		CHECK(led_rules_compile(&rules, zones, num_zones, 7) == ESP_OK);
+		CHECK(rules.count <= LED_RULES_MAX_ENTRIES && rules.start[0] == INT16_MIN);
+
+		for (int t = -1200; t <= 1700; t++)
+		{
+			int entry = led_rules_lookup(&rules, t, hint);
+
+			CHECK(rules.rgb[entry] == test_brute_force(zones, num_zones, t, 7));
+			CHECK(led_rules_lookup(&rules, t, -1) == entry);
+			hint = entry;
+		}
+
+		for (int k = 0; k < 200; k++)
+		{
+			int t = rand() % 65536 - 32768;
+			int entry = led_rules_lookup(&rules, t, rand() % rules.count);
+
+			CHECK(rules.rgb[entry] == test_brute_force(zones, num_zones, t, 7));
+		}
+	}
+
+	CHECK(led_rules_compile(&rules, &bad, 1, 0) == ESP_ERR_INVALID_ARG);
+}
+
+/**
+ * Gradient endpoints, clamping outside the points and monotone channels.
+ */
+static void test_gradient(void)
+{
+	static led_rules_t rules;
+	const led_rules_point_t points[] = {{100, 0x0000FF}, {250, 0x00FF00}, {350, 0xFF0000}};
+	const led_rules_point_t full[] = {{INT16_MIN, 0x000000}, {INT16_MAX, 0xFFFFFF}};
+	const led_rules_point_t bad[] = {{5, 0}, {5, 1}};
+
+	CHECK(led_rules_compile_gradient(&rules, points, 3) == ESP_OK);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, -500, -1)) == 0x0000FF);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, 100, -1)) == 0x0000FF);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, 350, -1)) == 0xFF0000);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, INT16_MAX, -1)) == 0xFF0000);
+	for (int i = 1; i < LED_RULES_GRADIENT_STEPS; i++)
+	{
+		CHECK(((rules.gradient_rgb[i] >> 16) & 0xFF) >= ((rules.gradient_rgb[i - 1] >> 16) & 0xFF));
+	}
+
+	CHECK(led_rules_compile_gradient(&rules, full, 2) == ESP_OK);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, INT16_MIN, -1)) == 0x000000);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, INT16_MAX, -1)) == 0xFFFFFF);
+
+	CHECK(led_rules_compile_gradient(&rules, points, 1) == ESP_OK);
+	CHECK(led_rules_color(&rules, led_rules_lookup(&rules, 5, -1)) == 0x0000FF);
+
+	CHECK(led_rules_compile_gradient(&rules, bad, 2) == ESP_ERR_INVALID_ARG);
+}
+
+/**
+ * Parses js into tokens.
+ * @return number of tokens.
+ */
+static int test_parse(char *js, const char *text, json_token_t *tokens, unsigned int max_tokens)
+{
+	json_parser_t parser;
+
+	strcpy(js, text);
+	json_parser_init(&parser);
+
+	return json_parser_parse(&parser, js, strlen(js), tokens, max_tokens);
+}
+
+/**
+ * Zone and color parsing, fixed point conversion and saturation.
+ */
+static void test_parsing(void)
+{
+	char js[512];
+	json_token_t tokens[64];
+	json_token_t token;
+	led_rules_zone_t zones[LED_RULES_MAX_ZONES];
+	uint32_t rgb;
+	int num_tokens;
+	int num_zones;
+	int value;
+
+	num_tokens = test_parse(js, "{\"zones\":[{\"low\":-5.5,\"high\":20,\"color\":\"#0000ff\"},"
+								"{\"low\":20.1,\"high\":\"30.25\",\"color\":\"#FF8000\"}],\"default\":\"#123456\"}",
+							tokens, 64);
+	CHECK(num_tokens > 0);
+	CHECK(led_rules_parse_zones(js, tokens, num_tokens, json_parser_find(js, tokens, num_tokens, 0, "zones"), zones, &num_zones) == ESP_OK);
+	CHECK(num_zones == 2);
+	CHECK(zones[0].low == -55 && zones[0].high == 200 && zones[0].rgb == 0x0000FF);
+	CHECK(zones[1].low == 201 && zones[1].high == 302 && zones[1].rgb == 0xFF8000);
+	CHECK(led_rules_parse_color(js, &tokens[json_parser_find(js, tokens, num_tokens, 0, "default")], &rgb) == ESP_OK);
+	CHECK(rgb == 0x123456);
+
+	num_tokens = test_parse(js, "{\"zones\":[{\"low\":1,\"color\":\"#000000\"}]}", tokens, 64);
+	CHECK(led_rules_parse_zones(js, tokens, num_tokens, json_parser_find(js, tokens, num_tokens, 0, "zones"), zones, &num_zones) == ESP_ERR_INVALID_ARG);
+
+	CHECK(led_rules_to_tenths(21.3) == 213);
+	CHECK(led_rules_to_tenths(-0.05) == -1);
+	CHECK(led_rules_to_tenths(1e9) == INT16_MAX);
+	CHECK(led_rules_to_tenths(-1e9) == INT16_MIN);
+
+	strcpy(js, "12.7");
+	token.type = JSON_TYPE_PRIMITIVE;
+	token.start = 0;
+	token.end = 4;
+	CHECK(json_parser_token_to_int(js, &token, &value) == 0 && value == 12);
+	CHECK(json_parser_token_to_fixed(js, &token, 2, &value) == 0 && value == 1270);
+
+	strcpy(js, "99999999999");
+	token.end = 11;
+	json_parser_token_to_int(js, &token, &value);
+	CHECK(value == INT32_MAX);
+}
+
+int main(void)
+{
+	test_zones();
+	test_gradient();
+	test_parsing();
+
+	printf("test_led_rules: ok\n");
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+#!/bin/sh
+# Generates the self signed certificate and key embedded for HTTPS mode, the
+# build runs it when they are missing. The key must never be committed.
+# ECDSA P-256 keeps the device side of a full handshake far cheaper than RSA.
+mkdir -p "$(dirname "$0")/../main/certs" || exit 1
+cd "$(dirname "$0")/../main/certs" || exit 1
+umask 077
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+	-keyout prvtkey.pem -out servercert.pem -days 3650 \
+	-subj "/CN=esp32.local" -addext "subjectAltName=DNS:esp32.local,IP:192.168.0.1"
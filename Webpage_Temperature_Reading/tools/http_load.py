@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""
+http_load.py
+
+Load generator for the web server: a number of concurrent clients send a
+weighted mix of requests, over keep-alive connections or a new connection per
+request, and the tool reports throughput and p50/p99/p999 latency per endpoint.
+
+    python tools/http_load.py 192.168.0.1 -c 4 -d 30 --mix /telemetry=8,/adc_value=1,/=1
+    python tools/http_load.py 192.168.0.1 -c 4 --mix POST:/OTAstatus=1 --no-keep-alive
+
+A run can be saved and later runs checked against it, the exit status is 1
+when throughput drops or p99 latency grows by more than the tolerance:
+
+    python tools/http_load.py 192.168.0.1 --save baseline.json
+    python tools/http_load.py 192.168.0.1 --baseline baseline.json --tolerance 10
+
+The server rate limits each client address and all clients of one run share
+an address, so turn off CONFIG_HTTP_SERVER_RATE_LIMIT in a benchmark build
+(idf.py menuconfig, Temperature Web Server Configuration), or raise its rate
+and burst options, or the 429 responses are what gets measured. The server
+side view of the same run is in /http_stats.
+"""
+
+import argparse
+import json
+import socket
+import sys
+import threading
+import time
+
+
+class Endpoint:
+    def __init__(self, spec):
+        target, _, weight = spec.partition("=")
+        method, _, path = target.rpartition(":")
+        self.method = method or "GET"
+        self.path = path
+        self.weight = int(weight or 1)
+        self.name = "%s %s" % (self.method, self.path)
+
+
+def recv_more(sock, buf):
+    data = sock.recv(4096)
+    if not data:
+        raise ConnectionError("connection closed")
+    return buf + data
+
+
+def recv_response(sock, buf):
+    """Reads one response, returns (status, body length, leftover bytes, headers)."""
+    while b"\r\n\r\n" not in buf:
+        buf = recv_more(sock, buf)
+
+    head, _, buf = buf.partition(b"\r\n\r\n")
+    lines = head.decode("latin-1").split("\r\n")
+    status = int(lines[0].split()[1])
+    headers = {}
+    for line in lines[1:]:
+        name, _, value = line.partition(":")
+        headers[name.strip().lower()] = value.strip()
+
+    if headers.get("transfer-encoding", "").lower() == "chunked":
+        length = 0
+        while True:
+            while b"\r\n" not in buf:
+                buf = recv_more(sock, buf)
+            size_line, _, buf = buf.partition(b"\r\n")
+            size = int(size_line.split(b";")[0], 16)
+            while len(buf) < size + 2:
+                buf = recv_more(sock, buf)
+            buf = buf[size + 2:]
+            length += size
+            if size == 0:
+                return status, length, buf, headers
+
+    length = int(headers.get("content-length", 0))
+    while len(buf) < length:
+        buf = recv_more(sock, buf)
+    return status, length, buf[length:], headers
+
+
+def client(args, schedule, samples, stop):
+    """Sends requests until stopped, appends (start, latency, endpoint, status, length) to samples, status None for errors."""
+    sock = None
+    buf = b""
+    connection = "keep-alive" if args.keep_alive else "close"
+    i = 0
+
+    while not stop.is_set():
+        endpoint = schedule[i % len(schedule)]
+        i += 1
+        request = "%s %s HTTP/1.1\r\nHost: %s\r\nConnection: %s\r\nContent-Length: 0\r\n\r\n" % (
+            endpoint.method, endpoint.path, args.host, connection)
+
+        start = time.perf_counter()
+        try:
+            if sock is None:
+                sock = socket.create_connection((args.host, args.port), timeout=args.timeout)
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                buf = b""
+            sock.sendall(request.encode())
+            status, length, buf, headers = recv_response(sock, buf)
+
+            if not args.keep_alive or headers.get("connection", "").lower() == "close":
+                sock.close()
+                sock = None
+        except (OSError, ValueError, IndexError):
+            if sock is not None:
+                sock.close()
+                sock = None
+            status, length = None, 0
+
+        samples.append((start, time.perf_counter() - start, endpoint.name, status, length))
+
+    if sock is not None:
+        sock.close()
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(p / 100.0 * len(sorted_values)))
+    return sorted_values[index]
+
+
+def summarize(name, samples, duration):
+    latencies = sorted(latency for _, latency, _, status, _ in samples if status is not None)
+    status_counts = {}
+    for _, _, _, status, _ in samples:
+        if status is not None:
+            status_counts[str(status)] = status_counts.get(str(status), 0) + 1
+    return {
+        "endpoint": name,
+        "requests": len(latencies),
+        "errors": sum(1 for sample in samples if sample[3] is None),
+        "status": dict(sorted(status_counts.items())),
+        "rps": len(latencies) / duration,
+        "bytes": sum(sample[4] for sample in samples),
+        "p50_ms": 1000 * percentile(latencies, 50),
+        "p99_ms": 1000 * percentile(latencies, 99),
+        "p999_ms": 1000 * percentile(latencies, 99.9),
+        "max_ms": 1000 * (latencies[-1] if latencies else 0.0),
+    }
+
+
+def report(rows):
+    print("%-24s %8s %8s %9s %9s %9s %9s %6s  %s" % ("endpoint", "requests", "req/s", "p50 ms", "p99 ms", "p999 ms", "max ms", "errors", "status"))
+    for row in rows:
+        print("%-24s %8d %8.1f %9.2f %9.2f %9.2f %9.2f %6d  %s" % (
+            row["endpoint"], row["requests"], row["rps"], row["p50_ms"], row["p99_ms"], row["p999_ms"], row["max_ms"],
+            row["errors"], " ".join("%s:%d" % kv for kv in row["status"].items())))
+
+
+def compare(rows, baseline, tolerance):
+    """Returns the regressions of rows against a saved run."""
+    before = {row["endpoint"]: row for row in baseline["endpoints"]}
+    regressions = []
+    for row in rows:
+        old = before.get(row["endpoint"])
+        if old is None:
+            continue
+        if row["rps"] < old["rps"] * (1 - tolerance / 100.0):
+            regressions.append("%s: %.1f req/s, was %.1f" % (row["endpoint"], row["rps"], old["rps"]))
+        if row["p99_ms"] > old["p99_ms"] * (1 + tolerance / 100.0):
+            regressions.append("%s: p99 %.2f ms, was %.2f" % (row["endpoint"], row["p99_ms"], old["p99_ms"]))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="HTTP load and latency benchmark")
+    parser.add_argument("host", help="device address")
+    parser.add_argument("-p", "--port", type=int, default=80)
+    parser.add_argument("-c", "--concurrency", type=int, default=4, help="concurrent clients (default: 4)")
+    parser.add_argument("-d", "--duration", type=float, default=10, help="seconds to run (default: 10)")
+    parser.add_argument("-w", "--warmup", type=float, default=1, help="seconds discarded at the start (default: 1)")
+    parser.add_argument("--mix", default="/telemetry=8,/adc_value=1,/=1",
+                        help="comma separated [METHOD:]path=weight list (default: /telemetry=8,/adc_value=1,/=1)")
+    parser.add_argument("--no-keep-alive", dest="keep_alive", action="store_false", help="new connection per request")
+    parser.add_argument("--timeout", type=float, default=5, help="socket timeout in seconds (default: 5)")
+    parser.add_argument("--save", metavar="FILE", help="write the results as JSON")
+    parser.add_argument("--baseline", metavar="FILE", help="compare against results saved with --save")
+    parser.add_argument("--tolerance", type=float, default=10, help="allowed regression in percent (default: 10)")
+    args = parser.parse_args()
+
+    endpoints = [Endpoint(spec) for spec in args.mix.split(",") if spec]
+    if not endpoints:
+        sys.exit("empty --mix")
+
+    # Interleave the endpoints by weight, each client starts at a different point
+    schedule = []
+    for round_ in range(max(e.weight for e in endpoints)):
+        schedule += [e for e in endpoints if e.weight > round_]
+
+    stop = threading.Event()
+    threads = []
+    per_client = []
+    for n in range(args.concurrency):
+        offset = (n * len(schedule)) // args.concurrency
+        samples = []
+        per_client.append(samples)
+        thread = threading.Thread(target=client, args=(args, schedule[offset:] + schedule[:offset], samples, stop), daemon=True)
+        threads.append(thread)
+        thread.start()
+
+    # Only requests started and finished inside the window after the warm-up count
+    window_start = time.perf_counter() + args.warmup
+    time.sleep(args.warmup + args.duration)
+    window_end = time.perf_counter()
+    stop.set()
+    for thread in threads:
+        thread.join(args.timeout + 1)
+
+    duration = window_end - window_start
+    measured = [sample for samples in per_client for sample in list(samples)
+                if sample[0] >= window_start and sample[0] + sample[1] <= window_end]
+
+    rows = [summarize(e.name, [s for s in measured if s[2] == e.name], duration) for e in endpoints]
+    rows.append(summarize("total", measured, duration))
+
+    print("%s:%d, %d clients, %s, %.1f s" % (args.host, args.port, args.concurrency, "keep-alive" if args.keep_alive else "close", duration))
+    report(rows)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump({"concurrency": args.concurrency, "keep_alive": args.keep_alive, "mix": args.mix, "endpoints": rows}, f, indent=2)
+
+    if args.baseline:
+        with open(args.baseline) as f:
+            regressions = compare(rows, json.load(f), args.tolerance)
+        for line in regressions:
+            print("REGRESSION " + line)
+        if regressions:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,70 @@
+#!/usr/bin/env python3
+"""
+https_bench.py
+
+Measures TLS handshakes per second against the device in HTTPS mode, once
+with full handshakes and once resuming the first session's ticket.
+
+    python tools/https_bench.py 192.168.0.1 -n 20
+"""
+
+import argparse
+import socket
+import ssl
+import time
+
+
+def handshake(host, port, context, session=None):
+    start = time.perf_counter()
+    with socket.create_connection((host, port), timeout=10) as sock:
+        # Keep delayed ACKs from dominating the short resumed handshake
+        sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        with context.wrap_socket(sock, server_hostname=host, session=session) as tls:
+            # Tickets arrive after the handshake, a request makes sure it was read
+            tls.sendall(b"GET /favicon.ico HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n" % host.encode())
+            while tls.recv(4096):
+                pass
+            return time.perf_counter() - start, tls.session, tls.session_reused
+
+
+def run(host, port, count, context, resume):
+    _, session, _ = handshake(host, port, context)
+    times = []
+    reused = 0
+    for _ in range(count):
+        elapsed, new_session, was_reused = handshake(host, port, context, session if resume else None)
+        times.append(elapsed)
+        reused += was_reused
+        if resume and new_session is not None:
+            session = new_session
+    return times, reused
+
+
+def report(name, times, reused):
+    total = sum(times)
+    times = sorted(times)
+    print(
+        "%-8s %6.2f handshakes/s  mean %6.1f ms  p50 %6.1f ms  max %6.1f ms  resumed %d/%d"
+        % (name, len(times) / total, 1000 * total / len(times), 1000 * times[len(times) // 2], 1000 * times[-1], reused, len(times))
+    )
+
+
+def main():
+    parser = argparse.ArgumentParser(description="TLS handshake benchmark")
+    parser.add_argument("host", help="device address")
+    parser.add_argument("-p", "--port", type=int, default=443)
+    parser.add_argument("-n", "--count", type=int, default=20, help="handshakes per run")
+    args = parser.parse_args()
+
+    # The device certificate is self signed, and its mbedTLS build speaks TLS 1.2
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_CLIENT)
+    context.check_hostname = False
+    context.verify_mode = ssl.CERT_NONE
+    context.maximum_version = ssl.TLSVersion.TLSv1_2
+
+    report("full", *run(args.host, args.port, args.count, context, resume=False))
+    report("resumed", *run(args.host, args.port, args.count, context, resume=True))
+
+
+if __name__ == "__main__":
+    main()
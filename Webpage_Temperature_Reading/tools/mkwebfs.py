@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""
+mkwebfs.py
+
+Packs the web page into a read-only image for the "www" partition, served by
+main/webfs.c when HTTP_SERVER_WEBFS is enabled. Files are gzip compressed
+ahead of time and indexed by a perfect hash table, so the device finds a file
+with one probe and sends it straight from the memory mapped partition.
+
+    python tools/mkwebfs.py main/webpage build/www.bin
+    parttool.py write_partition --partition-name www --input build/www.bin
+
+A running device also takes the image over HTTP, without a firmware update:
+
+    python tools/mkwebfs.py main/webpage build/www.bin --upload http://192.168.0.1
+
+Layout (little endian):
+    header   magic "WEBF", version, file count, table size, seed, image length
+    table    table_size entries, a file sits at fnv1a(path, seed) & (table_size - 1)
+    strings  NUL terminated paths and content types
+    data     file contents, 4 byte aligned, gzip compressed unless that does not
+             help or the page holds placeholders for the device to fill in
+    SHA-256  of everything before it, checked on upload and at mount
+"""
+
+import argparse
+import gzip
+import hashlib
+import os
+import struct
+import sys
+import urllib.request
+
+WEBFS_MAGIC = 0x46424557  # "WEBF"
+WEBFS_VERSION = 1
+
+HEADER = struct.Struct("<IHHHHII")
+ENTRY = struct.Struct("<IIIIIHH")
+
+FLAG_GZIP = 0x0001
+FLAG_TEMPLATE = 0x0002
+
+# Placeholders filled in by main/index_render.c, e.g. <!--#temp-->
+TEMPLATE_MARKER = b"<!--#"
+
+# Give up on a table size after this many seeds and double it
+MAX_SEEDS = 1 << 20
+
+CONTENT_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".ico": "image/x-icon",
+    ".png": "image/png",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+}
+
+
+def fnv1a(data, seed):
+    h = (0x811C9DC5 ^ seed) & 0xFFFFFFFF
+    for b in data:
+        h ^= b
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def find_seed(paths):
+    """Returns (table_size, seed) such that every path hashes to its own slot."""
+    table_size = 1
+    while table_size < 2 * len(paths):
+        table_size *= 2
+
+    while True:
+        mask = table_size - 1
+        for seed in range(MAX_SEEDS):
+            slots = set()
+            for path in paths:
+                slot = fnv1a(path, seed) & mask
+                if slot in slots:
+                    break
+                slots.add(slot)
+            else:
+                return table_size, seed
+        table_size *= 2
+
+
+def collect(root):
+    files = []
+    for dirpath, _, names in os.walk(root):
+        for name in sorted(names):
+            full = os.path.join(dirpath, name)
+            path = "/" + os.path.relpath(full, root).replace(os.sep, "/")
+            with open(full, "rb") as f:
+                files.append((path, f.read()))
+    return sorted(files)
+
+
+def align4(n):
+    return (n + 3) & ~3
+
+
+def content_type(path):
+    return CONTENT_TYPES.get(os.path.splitext(path)[1], "application/octet-stream")
+
+
+def build(files):
+    paths = [p.encode() for p, _ in files]
+    table_size, seed = find_seed(paths)
+
+    # Strings first, the data region starts after them
+    strings_offset = HEADER.size + table_size * ENTRY.size
+    strings = bytearray()
+    string_offsets = []
+    for path, _ in files:
+        path_offset = strings_offset + len(strings)
+        strings += path.encode() + b"\0"
+        type_offset = strings_offset + len(strings)
+        strings += content_type(path).encode() + b"\0"
+        string_offsets.append((path_offset, type_offset))
+    strings += b"\0" * (align4(len(strings)) - len(strings))
+
+    data_offset = strings_offset + len(strings)
+    data = bytearray()
+    entries = [None] * table_size
+
+    for (path, content), path_bytes, (path_offset, type_offset) in zip(files, paths, string_offsets):
+        # mtime=0 keeps the image reproducible
+        compressed = gzip.compress(content, compresslevel=9, mtime=0)
+        flags = 0
+        if path.endswith(".html") and TEMPLATE_MARKER in content:
+            # The device fills the placeholders in, it needs the page uncompressed
+            flags |= FLAG_TEMPLATE
+        elif len(compressed) < len(content):
+            content = compressed
+            flags |= FLAG_GZIP
+
+        offset = data_offset + len(data)
+        data += content
+        data += b"\0" * (align4(len(data)) - len(data))
+
+        etag = struct.unpack("<I", hashlib.sha256(content).digest()[:4])[0]
+        entries[fnv1a(path_bytes, seed) & (table_size - 1)] = (path_offset, type_offset, offset, len(content), etag, flags, 0)
+
+    image_len = data_offset + len(data)
+
+    image = bytearray(HEADER.pack(WEBFS_MAGIC, WEBFS_VERSION, len(files), table_size, 0, seed, image_len))
+    for entry in entries:
+        image += ENTRY.pack(*(entry or (0, 0, 0, 0, 0, 0, 0)))
+    image += strings
+    image += data
+    image += hashlib.sha256(image).digest()
+
+    return bytes(image), table_size, seed
+
+
+def upload(url, image):
+    request = urllib.request.Request(url.rstrip("/") + "/WWWupdate", data=image, method="POST",
+                                     headers={"Content-Type": "application/octet-stream"})
+    with urllib.request.urlopen(request, timeout=60) as response:
+        print(response.read().decode())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build the www partition image")
+    parser.add_argument("root", help="directory holding the web page (main/webpage)")
+    parser.add_argument("output", help="image file to write")
+    parser.add_argument("--size", type=lambda s: int(s, 0), default=0xE0000, help="partition size (default: 0xE0000)")
+    parser.add_argument("--upload", metavar="URL", help="also upload the image to a running device")
+    args = parser.parse_args()
+
+    files = collect(args.root)
+    if not files:
+        sys.exit("%s holds no files" % args.root)
+
+    image, table_size, seed = build(files)
+    if len(image) > args.size:
+        sys.exit("image of %d bytes does not fit in the %d byte partition" % (len(image), args.size))
+
+    with open(args.output, "wb") as f:
+        f.write(image)
+
+    raw = sum(len(content) for _, content in files)
+    print("%s: %d files, %d -> %d bytes, table %d slots, seed %d" % (args.output, len(files), raw, len(image), table_size, seed))
+
+    if args.upload:
+        upload(args.upload, image)
+
+
+if __name__ == "__main__":
+    main()
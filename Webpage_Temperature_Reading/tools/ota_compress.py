@@ -0,0 +1,48 @@
+#!/usr/bin/env python3
+"""
+ota_compress.py
+
+Compresses an app image for upload through /OTAupdate. The device detects the
+zlib header and inflates the image while writing it, with a 32 KB window.
+
+    python tools/ota_compress.py build/Webpage_Temperature_Reading.bin
+"""
+
+import argparse
+import sys
+import zlib
+
+# First byte of an ESP app image
+ESP_IMAGE_HEADER_MAGIC = 0xE9
+
+# The device decompresses into a 32 KB window, the largest deflate history
+WINDOW_BITS = 15
+
+
+def compress(image):
+    compressor = zlib.compressobj(level=9, method=zlib.DEFLATED, wbits=WINDOW_BITS)
+    return compressor.compress(image) + compressor.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compress an app image for OTA upload")
+    parser.add_argument("image", help="app image (.bin) produced by idf.py build")
+    parser.add_argument("-o", "--output", help="output file (default: <image>.z)")
+    args = parser.parse_args()
+
+    with open(args.image, "rb") as f:
+        image = f.read()
+
+    if not image or image[0] != ESP_IMAGE_HEADER_MAGIC:
+        sys.exit("%s is not an ESP app image" % args.image)
+
+    compressed = compress(image)
+    output = args.output or args.image + ".z"
+    with open(output, "wb") as f:
+        f.write(compressed)
+
+    print("%s: %d -> %d bytes (%.1f%%)" % (output, len(image), len(compressed), 100.0 * len(compressed) / len(image)))
+
+
+if __name__ == "__main__":
+    main()
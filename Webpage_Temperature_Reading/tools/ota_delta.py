@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+ota_delta.py
+
+Builds a delta OTA patch that turns the running app image (base) into a new
+one (target). The device applies it while streaming, reading the base image
+back from its running partition. See main/ota_delta.h for the format.
+
+    python tools/ota_delta.py old.bin build/Webpage_Temperature_Reading.bin -o update.espd.z
+
+Matching follows bsdiff: regions of the target are matched against the base
+and extended while most bytes agree, the differences are sent as ADD bytes
+that are mostly zero and compress well.
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+
+from ota_compress import ESP_IMAGE_HEADER_MAGIC, compress
+
+OP_COPY = 0x01
+OP_ADD = 0x02
+OP_INSERT = 0x03
+
+# Length of the seeds used to find matches, and the alignment of indexed base offsets
+SEED_LEN = 16
+SEED_STEP = 4
+
+# Shortest match worth an op instead of literal bytes
+MIN_MATCH = 24
+
+# esp_image_header_t.hash_appended, set when a SHA-256 of the image follows it
+IMAGE_HASH_APPENDED_OFFSET = 23
+IMAGE_HASH_LEN = 32
+
+
+def image_sha256(image):
+    """Digest esp_partition_get_sha256() reports for the running app, as
+    bootloader_common_get_sha256_of_partition: the appended hash covers the
+    image without those last 32 bytes."""
+    if len(image) > IMAGE_HASH_APPENDED_OFFSET and image[IMAGE_HASH_APPENDED_OFFSET] == 1:
+        return hashlib.sha256(image[:-IMAGE_HASH_LEN]).digest()
+    return hashlib.sha256(image).digest()
+
+
+def index_base(base):
+    index = {}
+    for i in range(0, len(base) - SEED_LEN + 1, SEED_STEP):
+        index.setdefault(base[i : i + SEED_LEN], i)
+    return index
+
+
+def extend(base, target, b, t):
+    """Extends a match forward, tolerating mismatches while at least half the bytes agree."""
+    score = 0
+    best_score = 0
+    best_len = 0
+    n = min(len(base) - b, len(target) - t)
+    for k in range(n):
+        score += 1 if base[b + k] == target[t + k] else -1
+        if score > best_score:
+            best_score = score
+            best_len = k + 1
+        elif score < best_score - 64:
+            break
+    return best_len
+
+
+def diff(base, target):
+    index = index_base(base)
+    ops = []
+    literal_start = 0
+    t = 0
+    while t <= len(target) - SEED_LEN:
+        b = index.get(target[t : t + SEED_LEN])
+        if b is None:
+            t += 1
+            continue
+        length = extend(base, target, b, t)
+        if length < MIN_MATCH:
+            t += 1
+            continue
+        if literal_start < t:
+            ops.append((OP_INSERT, target[literal_start:t]))
+        ops.append((b, base[b : b + length], target[t : t + length]))
+        t += length
+        literal_start = t
+    if literal_start < len(target):
+        ops.append((OP_INSERT, target[literal_start:]))
+    return ops
+
+
+def encode(base, target, ops):
+    out = bytearray(b"ESPD")
+    out += struct.pack("<I", len(base))
+    out += image_sha256(base)
+    out += struct.pack("<I", len(target))
+    for op in ops:
+        if op[0] == OP_INSERT and len(op) == 2:
+            out += struct.pack("<BI", OP_INSERT, len(op[1]))
+            out += op[1]
+            continue
+        offset, old, new = op
+        if old == new:
+            out += struct.pack("<BII", OP_COPY, offset, len(new))
+        else:
+            out += struct.pack("<BII", OP_ADD, offset, len(new))
+            out += bytes((n - o) & 0xFF for o, n in zip(old, new))
+    return bytes(out)
+
+
+def apply(base, patch):
+    """Reference implementation of the device side, used to check every patch."""
+    base_size, = struct.unpack_from("<I", patch, 4)
+    target_size, = struct.unpack_from("<I", patch, 40)
+    pos = 44
+    out = bytearray()
+    while pos < len(patch):
+        op = patch[pos]
+        if op == OP_INSERT:
+            length, = struct.unpack_from("<I", patch, pos + 1)
+            pos += 5
+            out += patch[pos : pos + length]
+            pos += length
+        else:
+            offset, length = struct.unpack_from("<II", patch, pos + 1)
+            pos += 9
+            if op == OP_COPY:
+                out += base[offset : offset + length]
+            else:
+                out += bytes((o + d) & 0xFF for o, d in zip(base[offset : offset + length], patch[pos : pos + length]))
+                pos += length
+    assert base_size == len(base) and target_size == len(out)
+    assert patch[8:40] == image_sha256(base), "base hash does not match what the device checks"
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Build a delta OTA patch")
+    parser.add_argument("base", help="app image currently running on the device")
+    parser.add_argument("target", help="new app image")
+    parser.add_argument("-o", "--output", required=True, help="patch file")
+    parser.add_argument("--raw", action="store_true", help="do not zlib compress the patch")
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        base = f.read()
+    with open(args.target, "rb") as f:
+        target = f.read()
+
+    for name, image in ((args.base, base), (args.target, target)):
+        if not image or image[0] != ESP_IMAGE_HEADER_MAGIC:
+            sys.exit("%s is not an ESP app image" % name)
+
+    patch = encode(base, target, diff(base, target))
+    if apply(base, patch) != target:
+        sys.exit("internal error: patch does not reproduce the target image")
+
+    if not args.raw:
+        patch = compress(patch)
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+
+    print("%s: %d byte image -> %d byte patch (%.1f%%)" % (args.output, len(target), len(patch), 100.0 * len(patch) / len(target)))
+
+
+if __name__ == "__main__":
+    main()